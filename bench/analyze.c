@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2016 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Benchmark for the RTP stream analyzer. Loads one or more ad-hoc format
+ * recordings (e.g. tests/call1_*.rtp), then feeds every packet through
+ * update_rtpp_stats() niters times over. Reports nanoseconds per packet
+ * along with the resulting stats, so that different implementations can
+ * be compared for both speed and correctness.
+ *
+ * cc -O2 -DWITHOUT_SIPLOG -I../src -o analyze analyze.c ../src/rtp_analyze.c \
+ *   ../src/rtp.c
+ * ./analyze [-n niters] file.rtp [file.rtp ...]
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/udp.h>
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rtp.h"
+#include "rtp_info.h"
+#include "rtpp_ssrc.h"
+#include "rtpa_stats.h"
+#include "rtp_analyze.h"
+#include "rtpp_network.h"
+#include "rtpp_record_private.h"
+
+#define	NITERS_DEFAULT	200
+
+struct bpkt {
+    rtp_hdr_t *hdr;
+    struct rtp_info rinfo;
+    double rtime;
+};
+
+/* Allocator normally provided by the rtpp_mallocs.c */
+void *
+rtpp_zmalloc(size_t msize)
+{
+
+    return (calloc(1, msize));
+}
+
+static double
+getdtime(void)
+{
+    struct timespec tp;
+
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return (tp.tv_sec + tp.tv_nsec / 1000000000.0);
+}
+
+static struct bpkt *
+load(const char *fname, int *npkts)
+{
+    struct pkt_hdr_adhoc *ahp;
+    struct bpkt *pkts;
+    unsigned char *buf, *cp;
+    struct stat sb;
+    FILE *f;
+    int n;
+
+    f = fopen(fname, "r");
+    if (f == NULL || fstat(fileno(f), &sb) < 0)
+        err(1, "%s", fname);
+    buf = malloc(sb.st_size);
+    /* There can't be more packets than that */
+    pkts = malloc(sizeof(*pkts) * (sb.st_size / sizeof(rtp_hdr_t)));
+    if (buf == NULL || pkts == NULL)
+        err(1, "malloc");
+    if (fread(buf, 1, sb.st_size, f) != (size_t)sb.st_size)
+        err(1, "%s", fname);
+    fclose(f);
+    n = 0;
+    for (cp = buf; cp + sizeof(*ahp) <= buf + sb.st_size; cp += ahp->plen) {
+        ahp = (struct pkt_hdr_adhoc *)cp;
+        cp += sizeof(*ahp);
+        if (cp + ahp->plen > buf + sb.st_size)
+            break;
+        if (rtp_packet_parse_raw(cp, ahp->plen, &pkts[n].rinfo) != RTP_PARSER_OK)
+            continue;
+        pkts[n].hdr = (rtp_hdr_t *)cp;
+        pkts[n].rtime = ahp->time;
+        n++;
+    }
+    *npkts = n;
+    return (pkts);
+}
+
+static void
+run(const char *fname, int niters)
+{
+    struct rtpp_session_stat stat;
+    struct rtpa_stats_jitter jst;
+    struct bpkt *pkts;
+    double etime, stime;
+    int i, j, npkts, njs;
+
+    njs = 0;
+
+    pkts = load(fname, &npkts);
+    if (npkts == 0)
+        errx(1, "%s: no RTP packets found", fname);
+    etime = 0.0;
+    for (i = 0; i < niters; i++) {
+        if (rtpp_stats_init(&stat) != 0)
+            err(1, "rtpp_stats_init");
+        stime = getdtime();
+        for (j = 0; j < npkts; j++) {
+            update_rtpp_stats(NULL, &stat, pkts[j].hdr, &pkts[j].rinfo,
+              pkts[j].rtime);
+        }
+        etime += getdtime() - stime;
+        memset(&jst, '\0', sizeof(jst));
+        njs = get_jitter_stats(stat.jdata, &jst);
+        update_rtpp_totals(&stat, &stat);
+        if (i < niters - 1)
+            rtpp_stats_destroy(&stat);
+    }
+    printf("%s: %d pkts, %.2f ns/pkt, psent=%u precvd=%u dups=%u "
+      "ssrc_changes=%u jss=%d jlast=%f jmax=%f javg=%f jvcount=%lu\n",
+      fname, npkts, etime * 1000000000.0 / ((double)npkts * niters),
+      stat.psent, stat.precvd, stat.duplicates, stat.ssrc_changes, njs,
+      jst.jlast, jst.jmax, jst.javg, jst.jvcount);
+    rtpp_stats_destroy(&stat);
+    free(pkts);
+}
+
+int
+main(int argc, char **argv)
+{
+    int ch, niters;
+
+    niters = NITERS_DEFAULT;
+    while ((ch = getopt(argc, argv, "n:")) != -1) {
+        switch (ch) {
+        case 'n':
+            niters = atoi(optarg);
+            break;
+
+        default:
+            errx(1, "usage: analyze [-n niters] file.rtp [file.rtp ...]");
+        }
+    }
+    argc -= optind;
+    argv += optind;
+    if (argc == 0)
+        errx(1, "usage: analyze [-n niters] file.rtp [file.rtp ...]");
+    for (; argc > 0; argc--, argv++)
+        run(argv[0], niters);
+    return (0);
+}
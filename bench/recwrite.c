@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2016 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Benchmark for the recording writer I/O methods. Simulates NFILES
+ * recordings being written concurrently, each receiving 64KB buffers
+ * of 172-byte packets, and reports files x packets per second for the
+ * plain writev(2) path and for the io_uring(7) path.
+ *
+ * cc -O2 -DHAVE_LINUX_IO_URING_H -I../src -o recwrite recwrite.c \
+ *   ../src/rtpp_record_uring.c
+ * ./recwrite [dir [nfiles [nbufs]]]
+ *
+ * The dir defaults to /dev/shm, so that the numbers reflect syscall
+ * overhead rather than the storage speed.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <err.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rtpp_record_uring.h"
+
+#define BUFSIZE  (64 * 1024)
+#define PKTSIZE  172
+#define BATCH    64
+
+static double
+getdtime(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (tv.tv_sec + tv.tv_usec / 1000000.0);
+}
+
+static void
+setres(void *arg, int res)
+{
+
+    if (res != BUFSIZE)
+        errx(1, "io_uring write failed: %d", res);
+}
+
+static double
+run(const char *dir, int nfiles, int nbufs, struct rtpp_record_uring *rup)
+{
+    char path[1024], *buf;
+    struct iovec iov;
+    int *fds, i, j, k;
+    double stime;
+
+    fds = malloc(nfiles * sizeof(fds[0]));
+    buf = malloc(BUFSIZE);
+    if (fds == NULL || buf == NULL)
+        err(1, "malloc");
+    memset(buf, 0xa5, BUFSIZE);
+    for (i = 0; i < nfiles; i++) {
+        snprintf(path, sizeof(path), "%s/recwrite.%d", dir, i);
+        fds[i] = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fds[i] == -1)
+            err(1, "%s", path);
+    }
+    iov.iov_base = buf;
+    iov.iov_len = BUFSIZE;
+    stime = getdtime();
+    for (j = 0; j < nbufs; j++) {
+        for (i = 0; i < nfiles; i += BATCH) {
+            for (k = i; k < nfiles && k < i + BATCH; k++) {
+                if (rup == NULL) {
+                    if (writev(fds[k], &iov, 1) != BUFSIZE)
+                        err(1, "writev");
+                } else if (rtpp_record_uring_writev(rup, fds[k], &iov, 1,
+                  NULL) != 0) {
+                    errx(1, "io_uring queue is full");
+                }
+            }
+            if (rup != NULL && rtpp_record_uring_run(rup, setres) != 0)
+                err(1, "io_uring_enter");
+        }
+    }
+    for (i = 0; i < nfiles; i++) {
+        close(fds[i]);
+        snprintf(path, sizeof(path), "%s/recwrite.%d", dir, i);
+        unlink(path);
+    }
+    stime = getdtime() - stime;
+    free(buf);
+    free(fds);
+    return (stime);
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *dir;
+    int nfiles, nbufs;
+    double npkts, etime;
+    struct rtpp_record_uring *rup;
+
+    dir = (argc > 1) ? argv[1] : "/dev/shm";
+    nfiles = (argc > 2) ? atoi(argv[2]) : 1000;
+    nbufs = (argc > 3) ? atoi(argv[3]) : 16;
+    npkts = (double)nfiles * nbufs * (BUFSIZE / PKTSIZE);
+
+    etime = run(dir, nfiles, nbufs, NULL);
+    printf("writev:   %d files, %.0f packets/sec, %.1f MB/sec\n", nfiles,
+      npkts / etime, nfiles * (double)nbufs * BUFSIZE / etime / 1e6);
+
+    rup = rtpp_record_uring_ctor(BATCH);
+    if (rup == NULL) {
+        printf("io_uring: not available\n");
+        exit(0);
+    }
+    etime = run(dir, nfiles, nbufs, rup);
+    printf("io_uring: %d files, %.0f packets/sec, %.1f MB/sec\n", nfiles,
+      npkts / etime, nfiles * (double)nbufs * BUFSIZE / etime / 1e6);
+    rtpp_record_uring_dtor(rup);
+
+    exit(0);
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2016 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Benchmark for the RTP resizer (re-packetizer). Feeds a G.711 (or
+ * G.722/L16 when the payload type is given) stream through rtp_resizer_enqueue() and pulls output packets with
+ * rtp_resizer_get(), for the 20ms->30ms and 10ms->60ms cases, as well as
+ * the opposite direction where input packets have to be split. The last
+ * depth packets out of every 16 are sent in reverse order. Reports input
+ * packets per second and a checksum over the output stream, so that
+ * different implementations can be compared for both speed and
+ * correctness.
+ *
+ * cc -O2 -I../src -o resizer resizer.c ../src/rtp_resizer.c ../src/rtp.c
+ * ./resizer [npkts [iptime optime [depth [pt]]]]
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rtp.h"
+#include "rtp_info.h"
+#include "rtp_packet.h"
+#include "rtp_resizer.h"
+#include "rtpp_types.h"
+#include "rtpp_proc.h"
+
+#define	NPKTS_DEFAULT	(1024 * 1024)
+#define	BATCH		64
+#define	REORDER_DEPTH_DEFAULT	2
+
+/* Allocator normally provided by the rtpp_mallocs.c */
+void *
+rtpp_zmalloc(size_t msize)
+{
+
+    return (calloc(1, msize));
+}
+
+static double
+getdtime(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (tv.tv_sec + tv.tv_usec / 1000000.0);
+}
+
+static struct rtp_packet *
+mkpacket(int i, int iptime, int arrival, int pt)
+{
+    struct rtp_packet *pkt;
+    int nsamples, nbytes;
+
+    nsamples = iptime * rtp_profiles[pt].ts_rate / 1000;
+    switch (pt) {
+    case RTP_L16_MONO:
+    case RTP_L16_STEREO:
+        nbytes = nsamples * 2 * rtp_profiles[pt].nchannels;
+        break;
+
+    default:
+        nbytes = nsamples;
+        break;
+    }
+    pkt = rtp_packet_alloc();
+    if (pkt == NULL)
+        abort();
+    pkt->data.header.version = 2;
+    pkt->data.header.pt = pt;
+    pkt->data.header.seq = htons(i);
+    pkt->data.header.ts = htonl(i * nsamples);
+    pkt->data.header.ssrc = htonl(0x12345678);
+    memset(pkt->data.buf + sizeof(rtp_hdr_t), i & 0xff, nbytes);
+    pkt->size = sizeof(rtp_hdr_t) + nbytes;
+    pkt->rtime = 1000.0 + (double)arrival * iptime / 1000.0;
+    return (pkt);
+}
+
+/*
+ * Payload of each input packet is filled with the low byte of its index,
+ * so looking at the RTP header and at every 10th sample is enough to tell
+ * if the output has been put together right.
+ */
+static uint32_t
+csum_update(uint32_t csum, const struct rtp_packet *pkt)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(rtp_hdr_t); i++)
+        csum = csum * 31 + pkt->data.buf[i];
+    for (; i < pkt->size; i += 10)
+        csum = csum * 31 + pkt->data.buf[i];
+    return (csum * 31 + pkt->size);
+}
+
+static void
+run(int iptime, int optime, int npkts, int depth, int pt)
+{
+    struct rtp_resizer *rsz;
+    struct rtp_packet *pkts[BATCH], *pkt;
+    struct rtpp_proc_rstats rs;
+    double stime, etime, dtime;
+    uint32_t csum;
+    int i, j, k, nout;
+
+    memset(&rs, '\0', sizeof(rs));
+    rsz = rtp_resizer_new(optime);
+    csum = 0;
+    nout = 0;
+    etime = 0.0;
+    dtime = 0.0;
+    for (i = 0; i < npkts; i += BATCH) {
+        /*
+         * Packets are allocated in batches outside of the timed loop,
+         * the last depth packets in every 16 are reversed to exercise
+         * out-of-order insertion.
+         */
+        for (k = 0; k < BATCH; k++) {
+            j = i + k;
+            if ((j % 16) >= 16 - depth)
+                j = (j - (j % 16)) + 15 - (j % 16) + (16 - depth);
+            pkts[k] = mkpacket(j, iptime, i + k, pt);
+        }
+        stime = getdtime();
+        for (k = 0; k < BATCH; k++) {
+            dtime = pkts[k]->rtime;
+            rtp_resizer_enqueue(rsz, &pkts[k], &rs);
+            if (pkts[k] != NULL)
+                rtp_packet_free(pkts[k]);
+            while ((pkt = rtp_resizer_get(rsz, dtime)) != NULL) {
+                csum = csum_update(csum, pkt);
+                nout++;
+                rtp_packet_free(pkt);
+            }
+        }
+        etime += getdtime() - stime;
+    }
+    /* Drain whatever has been left */
+    while ((pkt = rtp_resizer_get(rsz, dtime + 1.0)) != NULL) {
+        csum = csum_update(csum, pkt);
+        nout++;
+        rtp_packet_free(pkt);
+    }
+    rtp_resizer_free(NULL, rsz);
+    printf("%2dms -> %2dms: %d in, %d out, %llu discarded, %.2f Mpkts/s, "
+      "csum %08x\n", iptime, optime, npkts, nout,
+      (unsigned long long)rs.npkts_resizer_discard.cnt,
+      npkts / etime / 1000000.0, csum);
+}
+
+int
+main(int argc, char **argv)
+{
+    int npkts, depth, pt;
+
+    npkts = (argc > 1) ? atoi(argv[1]) : NPKTS_DEFAULT;
+    depth = (argc > 4) ? atoi(argv[4]) : REORDER_DEPTH_DEFAULT;
+    if (depth < 1 || depth > 16)
+        errx(1, "%s: reorder depth should be in 1..16 range", argv[4]);
+    pt = (argc > 5) ? atoi(argv[5]) : RTP_PCMU;
+    if (pt != RTP_PCMU && pt != RTP_PCMA && pt != RTP_G722 &&
+      pt != RTP_L16_MONO && pt != RTP_L16_STEREO)
+        errx(1, "%s: unsupported payload type", argv[5]);
+    if (argc > 3) {
+        run(atoi(argv[2]), atoi(argv[3]), npkts, depth, pt);
+        return (0);
+    }
+    run(20, 30, npkts, depth, pt);
+    run(10, 60, npkts, depth, pt);
+    run(30, 20, npkts, depth, pt);
+    run(60, 10, npkts, depth, pt);
+    return (0);
+}
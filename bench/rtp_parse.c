@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2016 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Micro-benchmark for the RTP parser. Compares the header-only parse done
+ * by rtp_packet_parse() on the plain relay path with the full one done by
+ * rtp_packet_parse_samples() for the resizer, which also has to look into
+ * the payload to count samples. Reports nanoseconds per packet for a few
+ * typical payloads.
+ *
+ * cc -O2 -I../src -o rtp_parse rtp_parse.c ../src/rtp.c
+ * ./rtp_parse [niters]
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rtp.h"
+#include "rtp_info.h"
+#include "rtp_packet.h"
+
+#define	NITERS_DEFAULT	(16 * 1024 * 1024)
+
+/* Allocator normally provided by the rtpp_mallocs.c */
+void *
+rtpp_zmalloc(size_t msize)
+{
+
+    return (calloc(1, msize));
+}
+
+static double
+getdtime(void)
+{
+    struct timespec tp;
+
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return (tp.tv_sec + tp.tv_nsec / 1000000000.0);
+}
+
+static struct rtp_packet *
+mkpacket(int pt, int nbytes, int fbyte)
+{
+    struct rtp_packet *pkt;
+
+    pkt = rtp_packet_alloc();
+    if (pkt == NULL)
+        abort();
+    pkt->data.header.version = 2;
+    pkt->data.header.pt = pt;
+    pkt->data.header.seq = htons(1);
+    pkt->data.header.ts = htonl(160);
+    pkt->data.header.ssrc = htonl(0x12345678);
+    memset(pkt->data.buf + sizeof(rtp_hdr_t), fbyte, nbytes);
+    pkt->size = sizeof(rtp_hdr_t) + nbytes;
+    return (pkt);
+}
+
+static double
+run(struct rtp_packet *pkt, rtp_parser_err_t (*parse)(struct rtp_packet *),
+  int niters, uint32_t *csum)
+{
+    double stime;
+    int i;
+
+    stime = getdtime();
+    for (i = 0; i < niters; i++) {
+        pkt->parse_result = RTP_PARSER_NOTPARSED;
+        pkt->parsed = NULL;
+        if (parse(pkt) != RTP_PARSER_OK)
+            abort();
+        /* Make sure the compiler can't optimize the parse away */
+        *csum += pkt->parsed->ssrc + pkt->parsed->seq + pkt->parsed->nsamples;
+    }
+    return ((getdtime() - stime) * 1000000000.0 / niters);
+}
+
+int
+main(int argc, char **argv)
+{
+    static const struct {
+        const char *name;
+        int pt;
+        int nbytes;
+        int fbyte;
+    } tests[] = {
+        {"PCMU 20ms", RTP_PCMU, 160, 0xff},
+        {"G.729 20ms", RTP_G729, 20, 0x00},
+        {"G.723 60ms", RTP_G723, 48, 0x00}, /* 2 x 6.3kbit/s frames */
+        {"G.723 240ms", RTP_G723, 192, 0x00},
+        {NULL}
+    };
+    struct rtp_packet *pkt;
+    double hdr, full;
+    uint32_t csum;
+    int i, niters;
+
+    niters = (argc > 1) ? atoi(argv[1]) : NITERS_DEFAULT;
+    csum = 0;
+    for (i = 0; tests[i].name != NULL; i++) {
+        pkt = mkpacket(tests[i].pt, tests[i].nbytes, tests[i].fbyte);
+        hdr = run(pkt, rtp_packet_parse, niters, &csum);
+        full = run(pkt, rtp_packet_parse_samples, niters, &csum);
+        printf("%-12s: header-only %.2f ns/pkt, full %.2f ns/pkt, "
+          "saved %.2f ns/pkt\n", tests[i].name, hdr, full, full - hdr);
+        rtp_packet_free(pkt);
+    }
+    printf("csum %08x\n", csum);
+    return (0);
+}
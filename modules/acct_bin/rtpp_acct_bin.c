@@ -0,0 +1,653 @@
+/*
+ * Copyright (c) 2016 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Binary columnar accounting. The file starts with the schema header:
+ *
+ *   struct rab_fhdr, followed by ncols x struct rab_coldesc
+ *
+ * and is followed by any number of blocks, one per batch of records
+ * delivered by the core:
+ *
+ *   struct rab_bhdr, node_id (nid_len bytes), then ncols columns, each
+ *   holding nrecs values of its type back to back.
+ *
+ * Strings are stored as (nrecs + 1) uint32_t offsets followed by the
+ * string data. Addresses are IPv6 or IPv4-mapped, 16 bytes in network
+ * byte order, all other values are in the host byte order, which can be
+ * figured out from the bom field. SSRCs that have not been seen are
+ * stored as -1. Node id, each column and each block are padded to the
+ * multiple of 8 bytes, so that the whole file can be mmap()ed and
+ * columns used in place.
+ */
+
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rtpp_ssrc.h"
+#include "rtpa_stats.h"
+#include "rtpp_monotime.h"
+#include "rtpp_types.h"
+#include "rtpp_log.h"
+#include "rtpp_log_obj.h"
+#include "rtpp_pcount.h"
+#include "rtpp_pcnt_strm.h"
+#include "rtpp_acct_pipe.h"
+#include "rtpp_acct.h"
+#include "rtpp_module.h"
+#include "rtpp_netaddr.h"
+#include "rtpp_cfg_stable.h"
+#include "rtpp_refcnt.h"
+
+#define RAB_FMAGIC      "RTPPACB"
+#define RAB_BMAGIC      0x4B424152 /* "RABK" */
+#define RAB_BOM         0x01020304
+/* Bump this when the schema below changes */
+#define RAB_VERSION     1
+
+enum rab_type {
+    RAB_T_U8 = 1, RAB_T_I32 = 2, RAB_T_U32 = 3, RAB_T_I64 = 4, RAB_T_U64 = 5,
+    RAB_T_F64 = 6, RAB_T_IP6 = 7, RAB_T_STR = 8
+};
+
+struct rab_fhdr {
+    char magic[8];
+    uint32_t bom;
+    uint32_t version;
+    uint32_t hlen;
+    uint32_t ncols;
+};
+
+struct rab_coldesc {
+    uint32_t type;
+    char name[28];
+};
+
+struct rab_bhdr {
+    uint32_t magic;
+    uint32_t blen;
+    uint32_t nrecs;
+    int32_t pid;
+    uint32_t nid_len;
+    uint32_t _pad;
+};
+
+#define RAB_ALIGN(len) (((len) + 7) & ~(size_t)7)
+
+struct rab_rtpa {
+    uint64_t psent;
+    uint64_t precvd;
+    uint64_t pdups;
+    uint64_t plost;
+    uint64_t pecount;
+    int64_t ssrc_last;
+    uint64_t ssrc_changes;
+    int32_t pt_last;
+};
+
+struct rab_jitter {
+    double jlast;
+    double jmax;
+    double javg;
+};
+
+struct rab_addr {
+    uint8_t ip[16];
+    uint32_t port;
+};
+
+/* One record, gets transposed into columns according to the schema */
+struct rab_row {
+    uint64_t seuid;
+    const char *call_id;
+    const char *from_tag;
+    double init_ts;
+    double destroy_ts;
+    double rtp_first_o;
+    double rtp_last_o;
+    double rtp_first_a;
+    double rtp_last_a;
+    uint64_t rtp_npkts_a;
+    uint64_t rtp_npkts_o;
+    uint64_t rtp_nrelayed;
+    uint64_t rtp_ndropped;
+    uint64_t rtcp_npkts_a;
+    uint64_t rtcp_npkts_o;
+    uint64_t rtcp_nrelayed;
+    uint64_t rtcp_ndropped;
+    struct rab_rtpa rasto;
+    struct rab_rtpa rasta;
+    struct rab_jitter jrasto;
+    struct rab_jitter jrasta;
+    struct rab_addr rtp_o;
+    struct rab_addr rtp_a;
+    struct rab_addr rtcp_o;
+    struct rab_addr rtcp_a;
+    uint8_t hld_sts_o;
+    uint8_t hld_sts_a;
+    int32_t hld_cnt_o;
+    int32_t hld_cnt_a;
+    uint8_t sampled_o;
+    uint8_t sampled_a;
+};
+
+struct rab_col {
+    const char *name;
+    enum rab_type type;
+    size_t offset;
+};
+
+#define RAB_COL(n, t, f) {.name = (n), .type = (t), \
+  .offset = offsetof(struct rab_row, f)}
+
+static const struct rab_col rab_schema[] = {
+    RAB_COL("sess_uid", RAB_T_U64, seuid),
+    RAB_COL("call_id", RAB_T_STR, call_id),
+    RAB_COL("from_tag", RAB_T_STR, from_tag),
+    RAB_COL("setup_ts", RAB_T_F64, init_ts),
+    RAB_COL("teardown_ts", RAB_T_F64, destroy_ts),
+    RAB_COL("first_rtp_ts_ino", RAB_T_F64, rtp_first_o),
+    RAB_COL("last_rtp_ts_ino", RAB_T_F64, rtp_last_o),
+    RAB_COL("first_rtp_ts_ina", RAB_T_F64, rtp_first_a),
+    RAB_COL("last_rtp_ts_ina", RAB_T_F64, rtp_last_a),
+    RAB_COL("rtp_npkts_ina", RAB_T_U64, rtp_npkts_a),
+    RAB_COL("rtp_npkts_ino", RAB_T_U64, rtp_npkts_o),
+    RAB_COL("rtp_nrelayed", RAB_T_U64, rtp_nrelayed),
+    RAB_COL("rtp_ndropped", RAB_T_U64, rtp_ndropped),
+    RAB_COL("rtcp_npkts_ina", RAB_T_U64, rtcp_npkts_a),
+    RAB_COL("rtcp_npkts_ino", RAB_T_U64, rtcp_npkts_o),
+    RAB_COL("rtcp_nrelayed", RAB_T_U64, rtcp_nrelayed),
+    RAB_COL("rtcp_ndropped", RAB_T_U64, rtcp_ndropped),
+    RAB_COL("rtpa_nsent_ino", RAB_T_U64, rasto.psent),
+    RAB_COL("rtpa_nrcvd_ino", RAB_T_U64, rasto.precvd),
+    RAB_COL("rtpa_ndups_ino", RAB_T_U64, rasto.pdups),
+    RAB_COL("rtpa_nlost_ino", RAB_T_U64, rasto.plost),
+    RAB_COL("rtpa_perrs_ino", RAB_T_U64, rasto.pecount),
+    RAB_COL("rtpa_ssrc_last_ino", RAB_T_I64, rasto.ssrc_last),
+    RAB_COL("rtpa_ssrc_cnt_ino", RAB_T_U64, rasto.ssrc_changes),
+    RAB_COL("rtpa_pt_last_ino", RAB_T_I32, rasto.pt_last),
+    RAB_COL("rtpa_nsent_ina", RAB_T_U64, rasta.psent),
+    RAB_COL("rtpa_nrcvd_ina", RAB_T_U64, rasta.precvd),
+    RAB_COL("rtpa_ndups_ina", RAB_T_U64, rasta.pdups),
+    RAB_COL("rtpa_nlost_ina", RAB_T_U64, rasta.plost),
+    RAB_COL("rtpa_perrs_ina", RAB_T_U64, rasta.pecount),
+    RAB_COL("rtpa_ssrc_last_ina", RAB_T_I64, rasta.ssrc_last),
+    RAB_COL("rtpa_ssrc_cnt_ina", RAB_T_U64, rasta.ssrc_changes),
+    RAB_COL("rtpa_pt_last_ina", RAB_T_I32, rasta.pt_last),
+    RAB_COL("rtpa_jitter_last_ino", RAB_T_F64, jrasto.jlast),
+    RAB_COL("rtpa_jitter_max_ino", RAB_T_F64, jrasto.jmax),
+    RAB_COL("rtpa_jitter_avg_ino", RAB_T_F64, jrasto.javg),
+    RAB_COL("rtpa_jitter_last_ina", RAB_T_F64, jrasta.jlast),
+    RAB_COL("rtpa_jitter_max_ina", RAB_T_F64, jrasta.jmax),
+    RAB_COL("rtpa_jitter_avg_ina", RAB_T_F64, jrasta.javg),
+    RAB_COL("rtpp_rtp_rmt_ip_o", RAB_T_IP6, rtp_o.ip),
+    RAB_COL("rtpp_rtp_rmt_pt_o", RAB_T_U32, rtp_o.port),
+    RAB_COL("rtpp_rtp_rmt_ip_a", RAB_T_IP6, rtp_a.ip),
+    RAB_COL("rtpp_rtp_rmt_pt_a", RAB_T_U32, rtp_a.port),
+    RAB_COL("rtpp_rtcp_rmt_ip_o", RAB_T_IP6, rtcp_o.ip),
+    RAB_COL("rtpp_rtcp_rmt_pt_o", RAB_T_U32, rtcp_o.port),
+    RAB_COL("rtpp_rtcp_rmt_ip_a", RAB_T_IP6, rtcp_a.ip),
+    RAB_COL("rtpp_rtcp_rmt_pt_a", RAB_T_U32, rtcp_a.port),
+    RAB_COL("rtpp_hld_sts_o", RAB_T_U8, hld_sts_o),
+    RAB_COL("rtpp_hld_sts_a", RAB_T_U8, hld_sts_a),
+    RAB_COL("rtpp_hld_cnt_o", RAB_T_I32, hld_cnt_o),
+    RAB_COL("rtpp_hld_cnt_a", RAB_T_I32, hld_cnt_a),
+    RAB_COL("rtpa_sampled_ino", RAB_T_U8, sampled_o),
+    RAB_COL("rtpa_sampled_ina", RAB_T_U8, sampled_a),
+    {.name = NULL}
+};
+
+#define RAB_NCOLS (sizeof(rab_schema) / sizeof(rab_schema[0]) - 1)
+
+static const size_t rab_type_size[] = {
+    [RAB_T_U8] = 1, [RAB_T_I32] = 4, [RAB_T_U32] = 4, [RAB_T_I64] = 8,
+    [RAB_T_U64] = 8, [RAB_T_F64] = 8, [RAB_T_IP6] = 16, [RAB_T_STR] = 0
+};
+
+struct rtpp_module_priv {
+   int fd;
+   pid_t pid;
+   struct stat stt;
+   char fname[MAXPATHLEN + 1];
+   char node_id[_POSIX_HOST_NAME_MAX + 1];
+   size_t nid_len;
+   struct rtpp_log *log;
+};
+
+static struct rtpp_module_priv *rtpp_acct_bin_ctor(struct rtpp_cfg_stable *);
+static void rtpp_acct_bin_dtor(struct rtpp_module_priv *);
+static void rtpp_acct_bin_do(struct rtpp_module_priv *, struct rtpp_acct *);
+static void rtpp_acct_bin_do_batch(struct rtpp_module_priv *,
+  struct rtpp_acct * const *, int);
+static off_t rtpp_acct_bin_lockf(int);
+static void rtpp_acct_bin_unlockf(int, off_t);
+
+#define API_FUNC(fname, asize) {.func = (fname), .argsize = (asize)}
+
+struct rtpp_minfo rtpp_module = {
+    .name = "acct_bin",
+    .ver = MI_VER_INIT(),
+    .ctor = rtpp_acct_bin_ctor,
+    .dtor = rtpp_acct_bin_dtor,
+    .on_session_end = API_FUNC(rtpp_acct_bin_do, rtpp_acct_OSIZE()),
+    .on_session_end_batch = API_FUNC(rtpp_acct_bin_do_batch, rtpp_acct_OSIZE())
+};
+
+static int
+rtpp_acct_bin_open(struct rtpp_module_priv *pvt)
+{
+    struct rab_fhdr *fhp;
+    struct rab_coldesc *cdp;
+    char *buf;
+    size_t len, i;
+    ssize_t rval;
+    off_t pos;
+
+    if (pvt->fd != -1) {
+        close(pvt->fd);
+    }
+    pvt->fd = open(pvt->fname, O_WRONLY | O_APPEND | O_CREAT, DEFFILEMODE);
+    if (pvt->fd == -1) {
+        goto e0;
+    }
+    pos = rtpp_acct_bin_lockf(pvt->fd);
+    if (pos < 0) {
+        goto e1;
+    }
+    if (fstat(pvt->fd, &pvt->stt) < 0) {
+        goto e2;
+    }
+    if (pvt->stt.st_size == 0) {
+        len = sizeof(*fhp) + RAB_NCOLS * sizeof(*cdp);
+        buf = mod_zmalloc(len);
+        if (buf == NULL) {
+            goto e2;
+        }
+        fhp = (struct rab_fhdr *)buf;
+        memcpy(fhp->magic, RAB_FMAGIC, sizeof(RAB_FMAGIC));
+        fhp->bom = RAB_BOM;
+        fhp->version = RAB_VERSION;
+        fhp->hlen = len;
+        fhp->ncols = RAB_NCOLS;
+        cdp = (struct rab_coldesc *)(buf + sizeof(*fhp));
+        for (i = 0; i < RAB_NCOLS; i++) {
+            cdp[i].type = rab_schema[i].type;
+            strncpy(cdp[i].name, rab_schema[i].name, sizeof(cdp[i].name) - 1);
+        }
+        rval = write(pvt->fd, buf, len);
+        mod_free(buf);
+        if (rval < 0) {
+            RTPP_ELOG(pvt->log, RTPP_LOG_ERR, "can't write file header "
+              "into %s", pvt->fname);
+        } else if (rval != len) {
+            RTPP_LOG(pvt->log, RTPP_LOG_ERR, "short write of file header "
+              "into %s: %zd bytes out of %zu", pvt->fname, rval, len);
+        }
+        if (rval != len) {
+            /* Don't leave a partial header behind */
+            if (ftruncate(pvt->fd, 0) != 0) {
+                RTPP_ELOG(pvt->log, RTPP_LOG_ERR, "can't truncate %s, "
+                  "partial file header is left behind", pvt->fname);
+            }
+            goto e2;
+        }
+    }
+    rtpp_acct_bin_unlockf(pvt->fd, pos);
+    return (0);
+
+e2:
+    rtpp_acct_bin_unlockf(pvt->fd, pos);
+e1:
+    close(pvt->fd);
+    pvt->fd = -1;
+e0:
+    return (-1);
+}
+
+static struct rtpp_module_priv *
+rtpp_acct_bin_ctor(struct rtpp_cfg_stable *cfsp)
+{
+    struct rtpp_module_priv *pvt;
+
+    pvt = mod_zmalloc(sizeof(struct rtpp_module_priv));
+    if (pvt == NULL) {
+        goto e0;
+    }
+    pvt->pid = getpid();
+    pvt->log = cfsp->glog;
+    CALL_SMETHOD(pvt->log->rcnt, incref);
+    if (cfsp->cwd_orig == NULL) {
+        snprintf(pvt->fname, sizeof(pvt->fname), "%s", "rtpproxy_acct.bin");
+    } else {
+        snprintf(pvt->fname, sizeof(pvt->fname), "%s/%s", cfsp->cwd_orig,
+          "rtpproxy_acct.bin");
+    }
+    /* Unlike the CSV module, node id is only looked up once */
+    if (gethostname(pvt->node_id, sizeof(pvt->node_id)) != 0) {
+        strcpy(pvt->node_id, "UNKNOWN");
+    }
+    pvt->node_id[sizeof(pvt->node_id) - 1] = '\0';
+    pvt->nid_len = strlen(pvt->node_id);
+    pvt->fd = -1;
+    if (rtpp_acct_bin_open(pvt) == -1) {
+        goto e1;
+    }
+    return (pvt);
+
+e1:
+    CALL_SMETHOD(pvt->log->rcnt, decref);
+    mod_free(pvt);
+e0:
+    return (NULL);
+}
+
+static void
+rtpp_acct_bin_dtor(struct rtpp_module_priv *pvt)
+{
+
+    close(pvt->fd);
+    CALL_SMETHOD(pvt->log->rcnt, decref);
+    mod_free(pvt);
+    return;
+}
+
+#define ES_IF_NULL(s) ((s) == NULL ? "" : s)
+#define MT2RT_NZ(mt) ((mt) == 0.0 ? 0.0 : dtime2rtime(mt))
+
+static void
+fill_rtpa(const struct rtpa_stats *rsp, struct rab_rtpa *rrp)
+{
+
+    rrp->psent = rsp->psent;
+    rrp->precvd = rsp->precvd;
+    rrp->pdups = rsp->pdups;
+    rrp->plost = rsp->plost;
+    rrp->pecount = rsp->pecount;
+    rrp->ssrc_last = rsp->last_ssrc.inited ? (int64_t)rsp->last_ssrc.val : -1;
+    rrp->ssrc_changes = rsp->ssrc_changes;
+    rrp->pt_last = rsp->last_pt;
+}
+
+static void
+fill_jitter(const struct rtpa_stats_jitter *jsp, struct rab_jitter *rjp)
+{
+
+    rjp->jlast = jsp->jlast;
+    rjp->jmax = jsp->jmax;
+    rjp->javg = jsp->javg;
+}
+
+static void
+fill_addr(struct rtpp_netaddr *nap, struct rab_addr *rap)
+{
+    struct sockaddr_storage ss;
+    struct sockaddr_in *sinp;
+    struct sockaddr_in6 *sin6p;
+
+    memset(rap, '\0', sizeof(*rap));
+    if (nap == NULL || CALL_SMETHOD(nap, isempty)) {
+        return;
+    }
+    CALL_SMETHOD(nap, get, (struct sockaddr *)&ss, sizeof(ss));
+    switch (ss.ss_family) {
+    case AF_INET:
+        sinp = (struct sockaddr_in *)&ss;
+        /* IPv4-mapped, ::ffff:a.b.c.d */
+        rap->ip[10] = rap->ip[11] = 0xff;
+        memcpy(&rap->ip[12], &sinp->sin_addr, 4);
+        rap->port = ntohs(sinp->sin_port);
+        break;
+
+    case AF_INET6:
+        sin6p = (struct sockaddr_in6 *)&ss;
+        memcpy(rap->ip, &sin6p->sin6_addr, 16);
+        rap->port = ntohs(sin6p->sin6_port);
+        break;
+    }
+}
+
+static void
+fill_row(const struct rtpp_acct *acct, struct rab_row *rp)
+{
+
+    rp->seuid = acct->seuid;
+    rp->call_id = ES_IF_NULL(acct->call_id);
+    rp->from_tag = ES_IF_NULL(acct->from_tag);
+    rp->init_ts = MT2RT_NZ(acct->init_ts);
+    rp->destroy_ts = MT2RT_NZ(acct->destroy_ts);
+    rp->rtp_first_o = MT2RT_NZ(acct->rtp.o.ps->first_pkt_rcv);
+    rp->rtp_last_o = MT2RT_NZ(acct->rtp.o.ps->last_pkt_rcv);
+    rp->rtp_first_a = MT2RT_NZ(acct->rtp.a.ps->first_pkt_rcv);
+    rp->rtp_last_a = MT2RT_NZ(acct->rtp.a.ps->last_pkt_rcv);
+    rp->rtp_npkts_a = acct->rtp.a.ps->npkts_in;
+    rp->rtp_npkts_o = acct->rtp.o.ps->npkts_in;
+    rp->rtp_nrelayed = acct->rtp.pcnts->nrelayed;
+    rp->rtp_ndropped = acct->rtp.pcnts->ndropped;
+    rp->rtcp_npkts_a = acct->rtcp.a.ps->npkts_in;
+    rp->rtcp_npkts_o = acct->rtcp.o.ps->npkts_in;
+    rp->rtcp_nrelayed = acct->rtcp.pcnts->nrelayed;
+    rp->rtcp_ndropped = acct->rtcp.pcnts->ndropped;
+    fill_rtpa(acct->rasto, &rp->rasto);
+    fill_rtpa(acct->rasta, &rp->rasta);
+    fill_jitter(acct->jrasto, &rp->jrasto);
+    fill_jitter(acct->jrasta, &rp->jrasta);
+    fill_addr(acct->rtp.o.rem_addr, &rp->rtp_o);
+    fill_addr(acct->rtp.a.rem_addr, &rp->rtp_a);
+    fill_addr(acct->rtcp.o.rem_addr, &rp->rtcp_o);
+    fill_addr(acct->rtcp.a.rem_addr, &rp->rtcp_a);
+    rp->hld_sts_o = (acct->rtp.o.hld_stat.status != 0);
+    rp->hld_sts_a = (acct->rtp.a.hld_stat.status != 0);
+    rp->hld_cnt_o = acct->rtp.o.hld_stat.cnt;
+    rp->hld_cnt_a = acct->rtp.a.hld_stat.cnt;
+    rp->sampled_o = (acct->rasto->sampled != 0);
+    rp->sampled_a = (acct->rasta->sampled != 0);
+}
+
+#define ROW_FIELD(rp, cp) ((const char *)(rp) + (cp)->offset)
+#define ROW_STR(rp, cp) (*(const char * const *)ROW_FIELD(rp, cp))
+
+static size_t
+col_size(const struct rab_col *cp, const struct rab_row *rows, int nrows)
+{
+    size_t len;
+    int i;
+
+    if (cp->type != RAB_T_STR) {
+        return (RAB_ALIGN(rab_type_size[cp->type] * nrows));
+    }
+    len = sizeof(uint32_t) * (nrows + 1);
+    for (i = 0; i < nrows; i++) {
+        len += strlen(ROW_STR(&rows[i], cp));
+    }
+    return (RAB_ALIGN(len));
+}
+
+static void
+col_fill(const struct rab_col *cp, const struct rab_row *rows, int nrows,
+  char *dp)
+{
+    uint32_t *offs, off;
+    size_t width, slen;
+    int i;
+
+    if (cp->type != RAB_T_STR) {
+        width = rab_type_size[cp->type];
+        for (i = 0; i < nrows; i++) {
+            memcpy(dp, ROW_FIELD(&rows[i], cp), width);
+            dp += width;
+        }
+        return;
+    }
+    offs = (uint32_t *)dp;
+    dp += sizeof(uint32_t) * (nrows + 1);
+    off = 0;
+    for (i = 0; i < nrows; i++) {
+        offs[i] = off;
+        slen = strlen(ROW_STR(&rows[i], cp));
+        memcpy(dp + off, ROW_STR(&rows[i], cp), slen);
+        off += slen;
+    }
+    offs[nrows] = off;
+}
+
+static void
+rtpp_acct_bin_do_batch(struct rtpp_module_priv *pvt,
+  struct rtpp_acct * const *accts, int naccts)
+{
+    struct rab_row *rows;
+    struct rab_bhdr *bhp;
+    const struct rab_col *cp;
+    char *buf, *dp;
+    size_t len, nid_len;
+    ssize_t wlen;
+    off_t pos, eof;
+    int i, rval;
+    struct stat stt;
+
+    rval = stat(pvt->fname, &stt);
+    if (pvt->fd == -1) {
+        /* Previous attempt to (re-)open has failed, try again */
+        rtpp_acct_bin_open(pvt);
+    } else if (rval != -1) {
+        if (stt.st_dev != pvt->stt.st_dev || stt.st_ino != pvt->stt.st_ino) {
+            rtpp_acct_bin_open(pvt);
+        }
+    } else if (rval == -1 && errno == ENOENT) {
+        rtpp_acct_bin_open(pvt);
+    }
+
+    rows = mod_malloc(sizeof(rows[0]) * naccts);
+    if (rows == NULL) {
+        return;
+    }
+    for (i = 0; i < naccts; i++) {
+        fill_row(accts[i], &rows[i]);
+    }
+    nid_len = RAB_ALIGN(pvt->nid_len);
+    len = sizeof(*bhp) + nid_len;
+    for (cp = rab_schema; cp->name != NULL; cp++) {
+        len += col_size(cp, rows, naccts);
+    }
+    buf = mod_zmalloc(len);
+    if (buf == NULL) {
+        goto e0;
+    }
+    bhp = (struct rab_bhdr *)buf;
+    bhp->magic = RAB_BMAGIC;
+    bhp->blen = len;
+    bhp->nrecs = naccts;
+    bhp->pid = pvt->pid;
+    bhp->nid_len = pvt->nid_len;
+    dp = buf + sizeof(*bhp);
+    memcpy(dp, pvt->node_id, pvt->nid_len);
+    dp += nid_len;
+    for (cp = rab_schema; cp->name != NULL; cp++) {
+        col_fill(cp, rows, naccts, dp);
+        dp += col_size(cp, rows, naccts);
+    }
+
+    pos = rtpp_acct_bin_lockf(pvt->fd);
+    if (pos < 0) {
+        goto e1;
+    }
+    /*
+     * A partial block would make every block after it unreadable, so
+     * the file is cut back to where it was if the write comes out short.
+     */
+    eof = lseek(pvt->fd, 0, SEEK_END);
+    wlen = write(pvt->fd, buf, len);
+    if (wlen < 0) {
+        RTPP_ELOG(pvt->log, RTPP_LOG_ERR, "can't write %d records into %s",
+          naccts, pvt->fname);
+    } else if (wlen != len) {
+        RTPP_LOG(pvt->log, RTPP_LOG_ERR, "short write of %d records into "
+          "%s: %zd bytes out of %zu", naccts, pvt->fname, wlen, len);
+    }
+    if (wlen != len) {
+        if (eof < 0 || ftruncate(pvt->fd, eof) != 0) {
+            RTPP_ELOG(pvt->log, RTPP_LOG_ERR, "can't truncate %s, partial "
+              "block is left behind", pvt->fname);
+        }
+    }
+    rtpp_acct_bin_unlockf(pvt->fd, pos);
+e1:
+    mod_free(buf);
+e0:
+    mod_free(rows);
+}
+
+static void
+rtpp_acct_bin_do(struct rtpp_module_priv *pvt, struct rtpp_acct *acct)
+{
+
+    rtpp_acct_bin_do_batch(pvt, &acct, 1);
+}
+
+static off_t
+rtpp_acct_bin_lockf(int fd)
+{
+    struct flock l;
+    int rval;
+
+    memset(&l, '\0', sizeof(l));
+    l.l_whence = SEEK_CUR;
+    l.l_type = F_WRLCK;
+    do {
+        rval = fcntl(fd, F_SETLKW, &l);
+    } while (rval == -1 && errno == EINTR);
+    if (rval == -1) {
+        return (-1);
+    }
+    return lseek(fd, 0, SEEK_CUR);
+}
+
+static void
+rtpp_acct_bin_unlockf(int fd, off_t offset)
+{
+    struct flock l;
+    int rval;
+
+    memset(&l, '\0', sizeof(l));
+    l.l_whence = SEEK_SET;
+    l.l_start = offset;
+    l.l_type = F_UNLCK;
+    do {
+        rval = fcntl(fd, F_SETLKW, &l);
+    } while (rval == -1 && errno == EINTR);
+}
@@ -72,13 +72,15 @@ struct rtpp_module_priv {
 };
 
 /* Bump this when some changes are made */
-#define RTPP_METRICS_VERSION	"1.2"
+#define RTPP_METRICS_VERSION	"1.3"
 
 #define HNAME_REFRESH_IVAL	1.0
 
 static struct rtpp_module_priv *rtpp_acct_csv_ctor(struct rtpp_cfg_stable *);
 static void rtpp_acct_csv_dtor(struct rtpp_module_priv *);
 static void rtpp_acct_csv_do(struct rtpp_module_priv *, struct rtpp_acct *);
+static void rtpp_acct_csv_do_batch(struct rtpp_module_priv *,
+  struct rtpp_acct * const *, int);
 static off_t rtpp_acct_csv_lockf(int);
 static void rtpp_acct_csv_unlockf(int, off_t);
 
@@ -89,7 +91,8 @@ struct rtpp_minfo rtpp_module = {
     .ver = MI_VER_INIT(),
     .ctor = rtpp_acct_csv_ctor,
     .dtor = rtpp_acct_csv_dtor,
-    .on_session_end = API_FUNC(rtpp_acct_csv_do, rtpp_acct_OSIZE())
+    .on_session_end = API_FUNC(rtpp_acct_csv_do, rtpp_acct_OSIZE()),
+    .on_session_end_batch = API_FUNC(rtpp_acct_csv_do_batch, rtpp_acct_OSIZE())
 };
 
 #if 0
@@ -159,6 +162,10 @@ rtpp_acct_get_nid(struct rtpp_module_priv *pvt, struct rtpp_acct *ap)
 #define HLD_STS_NM_O PFX_GEN HLD_STS_NM SFX_O
 #define HLD_STS_NM_A PFX_GEN HLD_STS_NM SFX_A
 
+#define SMPL_NM      "rtpa_sampled"
+#define SMPL_NM_O    SMPL_NM SFX_INO
+#define SMPL_NM_A    SMPL_NM SFX_INA
+
 #define RVER_FMT    "%s"
 #define NID_FMT     "%s"
 #define PID_FMT     "%d"
@@ -170,6 +177,7 @@ rtpp_acct_get_nid(struct rtpp_module_priv *pvt, struct rtpp_acct *ap)
 #define SEP         ","
 #define HLD_STS_FMT "%s"
 #define HLD_CNT_FMT "%d"
+#define SMPL_FMT    "%s"
 
 static int
 rtpp_acct_csv_open(struct rtpp_module_priv *pvt)
@@ -207,7 +215,8 @@ rtpp_acct_csv_open(struct rtpp_module_priv *pvt)
           "rtpa_jitter_last_ina,rtpa_jitter_max_ina,rtpa_jitter_avg_ina" SEP
           R_RM_NM_O SEP R_RM_PT_NM_O SEP R_RM_NM_A SEP R_RM_PT_NM_A SEP
           C_RM_NM_O SEP C_RM_PT_NM_O SEP C_RM_NM_A SEP C_RM_PT_NM_A SEP
-          HLD_STS_NM_O SEP HLD_STS_NM_A SEP HLD_CNT_NM_O SEP HLD_CNT_NM_A "\n");
+          HLD_STS_NM_O SEP HLD_STS_NM_A SEP HLD_CNT_NM_O SEP HLD_CNT_NM_A SEP
+          SMPL_NM_O SEP SMPL_NM_A "\n");
         if (len <= 0) {
             if (len == 0 && buf != NULL) {
                 goto e3;
@@ -305,27 +314,14 @@ format_netaddr(struct rtpp_netaddr *nap_rtp, struct rtpp_netaddr *nap_rtcp,
 
 #define FMT_BOOL(x) ((x == 0) ? "f" : "t")
 
-static void
-rtpp_acct_csv_do(struct rtpp_module_priv *pvt, struct rtpp_acct *acct)
+static int
+rtpp_acct_csv_fmt(struct rtpp_module_priv *pvt, struct rtpp_acct *acct,
+  char **bufp)
 {
     char *buf;
-    int len, pos, rval;
-    struct stat stt;
+    int len;
 
     buf = NULL;
-    rval = stat(pvt->fname, &stt);
-    if (rval != -1) {
-        if (stt.st_dev != pvt->stt.st_dev || stt.st_ino != pvt->stt.st_ino) {
-            rtpp_acct_csv_open(pvt);
-        }
-    } else if (rval == -1 && errno == ENOENT) {
-        rtpp_acct_csv_open(pvt);
-    }
-    pos = rtpp_acct_csv_lockf(pvt->fd);
-    if (pos < 0) {
-        return;
-    }
-
     format_ssrc(&acct->rasta->last_ssrc, pvt->a.ssrc, sizeof(pvt->a.ssrc));
     format_ssrc(&acct->rasto->last_ssrc, pvt->o.ssrc, sizeof(pvt->o.ssrc));
     format_netaddr(acct->rtp.a.rem_addr, acct->rtcp.a.rem_addr, &pvt->a);
@@ -335,7 +331,8 @@ rtpp_acct_csv_do(struct rtpp_module_priv *pvt, struct rtpp_acct *acct)
       "%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu" SEP LSSRC_FMT SEP SNCHG_FMT SEP
       PT_FMT SEP "%lu,%lu,%lu,%lu,%lu" SEP LSSRC_FMT SEP SNCHG_FMT SEP PT_FMT SEP
       "%f,%f,%f,%f,%f,%f" SEP RM_FMT SEP RM_FMT SEP RM_FMT SEP RM_FMT SEP
-      HLD_STS_FMT SEP HLD_STS_FMT SEP HLD_CNT_FMT SEP HLD_CNT_FMT "\n",
+      HLD_STS_FMT SEP HLD_STS_FMT SEP HLD_CNT_FMT SEP HLD_CNT_FMT SEP
+      SMPL_FMT SEP SMPL_FMT "\n",
       RTPP_METRICS_VERSION, rtpp_acct_get_nid(pvt, acct),
       pvt->pid, acct->seuid, ES_IF_NULL(acct->call_id), ES_IF_NULL(acct->from_tag),
       MT2RT_NZ(acct->init_ts), MT2RT_NZ(acct->destroy_ts), MT2RT_NZ(acct->rtp.o.ps->first_pkt_rcv),
@@ -351,18 +348,83 @@ rtpp_acct_csv_do(struct rtpp_module_priv *pvt, struct rtpp_acct *acct)
       acct->jrasta->jlast, acct->jrasta->jmax, acct->jrasta->javg,
       pvt->o.rtp_adr, pvt->a.rtp_adr, pvt->o.rtcp_adr, pvt->a.rtcp_adr,
       FMT_BOOL(acct->rtp.o.hld_stat.status), FMT_BOOL(acct->rtp.a.hld_stat.status),
-      acct->rtp.o.hld_stat.cnt, acct->rtp.a.hld_stat.cnt);
+      acct->rtp.o.hld_stat.cnt, acct->rtp.a.hld_stat.cnt,
+      FMT_BOOL(acct->rasto->sampled), FMT_BOOL(acct->rasta->sampled));
     if (len <= 0) {
         if (len == 0 && buf != NULL) {
             mod_free(buf);
         }
+        return (-1);
+    }
+    *bufp = buf;
+    return (len);
+}
+
+static void
+rtpp_acct_csv_do_batch(struct rtpp_module_priv *pvt,
+  struct rtpp_acct * const *accts, int naccts)
+{
+    char *buf, *rbuf, *tp;
+    int i, len, rlen, pos, rval;
+    struct stat stt;
+
+    rval = stat(pvt->fname, &stt);
+    if (rval != -1) {
+        if (stt.st_dev != pvt->stt.st_dev || stt.st_ino != pvt->stt.st_ino) {
+            rtpp_acct_csv_open(pvt);
+        }
+    } else if (rval == -1 && errno == ENOENT) {
+        rtpp_acct_csv_open(pvt);
+    }
+
+    /*
+     * Format all records first and then append them in one go, so that
+     * the file is locked once per batch and other writers never see
+     * a batch half-written.
+     */
+    buf = NULL;
+    len = 0;
+    for (i = 0; i < naccts; i++) {
+        rlen = rtpp_acct_csv_fmt(pvt, accts[i], &rbuf);
+        if (rlen < 0) {
+            continue;
+        }
+        if (buf == NULL) {
+            buf = rbuf;
+            len = rlen;
+            continue;
+        }
+        tp = mod_realloc(buf, len + rlen);
+        if (tp == NULL) {
+            mod_free(rbuf);
+            continue;
+        }
+        buf = tp;
+        memcpy(buf + len, rbuf, rlen);
+        len += rlen;
+        mod_free(rbuf);
+    }
+    if (buf == NULL) {
         return;
     }
+
+    pos = rtpp_acct_csv_lockf(pvt->fd);
+    if (pos < 0) {
+        goto e0;
+    }
     write(pvt->fd, buf, len);
     rtpp_acct_csv_unlockf(pvt->fd, pos);
+e0:
     mod_free(buf);
 }
 
+static void
+rtpp_acct_csv_do(struct rtpp_module_priv *pvt, struct rtpp_acct *acct)
+{
+
+    rtpp_acct_csv_do_batch(pvt, &acct, 1);
+}
+
 static off_t
 rtpp_acct_csv_lockf(int fd)
 {
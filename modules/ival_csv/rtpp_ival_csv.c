@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2016 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Sample user of the on_session_interval hook: appends a line with the
+ * packet counters of every active session to the rtpproxy_ival.csv
+ * once every RTPP_IVAL_CSV_IVAL seconds.
+ */
+
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rtpp_ssrc.h"
+#include "rtpa_stats.h"
+#include "rtpp_monotime.h"
+#include "rtpp_types.h"
+#include "rtpp_pcount.h"
+#include "rtpp_pcnt_strm.h"
+#include "rtpp_sess_snap.h"
+#include "rtpp_module.h"
+#include "rtpp_cfg_stable.h"
+
+#define RTPP_IVAL_CSV_IVAL	1.0
+
+struct rtpp_module_priv {
+   int fd;
+   char fname[MAXPATHLEN + 1];
+};
+
+static struct rtpp_module_priv *rtpp_ival_csv_ctor(struct rtpp_cfg_stable *);
+static void rtpp_ival_csv_dtor(struct rtpp_module_priv *);
+static void rtpp_ival_csv_do(struct rtpp_module_priv *,
+  const struct rtpp_sess_snap *, int);
+
+struct rtpp_minfo rtpp_module = {
+    .name = "ival_csv",
+    .ver = MI_VER_INIT(),
+    .ctor = rtpp_ival_csv_ctor,
+    .dtor = rtpp_ival_csv_dtor,
+    .on_session_interval = {.func = rtpp_ival_csv_do,
+      .argsize = rtpp_sess_snap_OSIZE(), .interval = RTPP_IVAL_CSV_IVAL}
+};
+
+#define IVAL_CSV_HDR "sess_uid,snap_ts,rtp_npkts_ino,rtp_npkts_ina," \
+  "rtp_nrelayed,rtp_ndropped,rtcp_npkts_ino,rtcp_npkts_ina," \
+  "rtpa_nrcvd_ino,rtpa_nrcvd_ina,rtpa_nlost_ino,rtpa_nlost_ina\n"
+
+static struct rtpp_module_priv *
+rtpp_ival_csv_ctor(struct rtpp_cfg_stable *cfsp)
+{
+    struct rtpp_module_priv *pvt;
+    struct stat stt;
+
+    pvt = mod_zmalloc(sizeof(struct rtpp_module_priv));
+    if (pvt == NULL) {
+        goto e0;
+    }
+    if (cfsp->cwd_orig == NULL) {
+        snprintf(pvt->fname, sizeof(pvt->fname), "%s", "rtpproxy_ival.csv");
+    } else {
+        snprintf(pvt->fname, sizeof(pvt->fname), "%s/%s", cfsp->cwd_orig,
+          "rtpproxy_ival.csv");
+    }
+    pvt->fd = open(pvt->fname, O_WRONLY | O_APPEND | O_CREAT, DEFFILEMODE);
+    if (pvt->fd == -1) {
+        goto e1;
+    }
+    if (fstat(pvt->fd, &stt) < 0) {
+        goto e2;
+    }
+    if (stt.st_size == 0) {
+        if (write(pvt->fd, IVAL_CSV_HDR, strlen(IVAL_CSV_HDR)) < 0) {
+            goto e2;
+        }
+    }
+    return (pvt);
+
+e2:
+    close(pvt->fd);
+e1:
+    mod_free(pvt);
+e0:
+    return (NULL);
+}
+
+static void
+rtpp_ival_csv_dtor(struct rtpp_module_priv *pvt)
+{
+
+    close(pvt->fd);
+    mod_free(pvt);
+}
+
+static void
+rtpp_ival_csv_do(struct rtpp_module_priv *pvt,
+  const struct rtpp_sess_snap *snaps, int nsnaps)
+{
+    const struct rtpp_sess_snap *ssp;
+    char *buf;
+    int i, len;
+
+    for (i = 0; i < nsnaps; i++) {
+        ssp = &snaps[i];
+        buf = NULL;
+        len = mod_asprintf(&buf, "%" PRId64 ",%f,%lu,%lu,%lu,%lu,%lu,%lu,"
+          "%lu,%lu,%lu,%lu\n", ssp->seuid, dtime2rtime(ssp->snap_ts),
+          ssp->rtp.o.ps.npkts_in, ssp->rtp.a.ps.npkts_in,
+          ssp->rtp.pcnts.nrelayed, ssp->rtp.pcnts.ndropped,
+          ssp->rtcp.o.ps.npkts_in, ssp->rtcp.a.ps.npkts_in,
+          ssp->rasto.precvd, ssp->rasta.precvd, ssp->rasto.plost,
+          ssp->rasta.plost);
+        if (len <= 0) {
+            if (len == 0 && buf != NULL) {
+                mod_free(buf);
+            }
+            continue;
+        }
+        write(pvt->fd, buf, len);
+        mod_free(buf);
+    }
+}
@@ -0,0 +1,163 @@
+#!/usr/bin/env python2
+#
+# Copyright (c) 2016 Sippy Software, Inc. All rights reserved.
+#
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice, this
+# list of conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice,
+# this list of conditions and the following disclaimer in the documentation and/or
+# other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+# ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+# ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+# Reader for the files produced by the acct_bin module, see
+# modules/acct_bin/rtpp_acct_bin.c for the format description. Converts
+# them into CSV with the same column names as the acct_csv module uses,
+# or can be imported and read_blocks() used directly, which yields each
+# block as a dictionary of columns.
+
+import sys, getopt, struct, socket
+
+FMAGIC = b'RTPPACB\0'
+BMAGIC = 0x4B424152
+BOM = 0x01020304
+VERSION = 1
+
+# type: (struct code, size)
+T_STR = 8
+T_IP6 = 7
+TYPES = {1:('B', 1), 2:('i', 4), 3:('I', 4), 4:('q', 8), 5:('Q', 8), \
+  6:('d', 8), T_IP6:(None, 16), T_STR:(None, 0)}
+
+def align(l):
+    return (l + 7) & ~7
+
+def ip6_str(b):
+    if b == b'\0' * 16:
+        return ''
+    if b[:12] == b'\0' * 10 + b'\xff\xff':
+        return socket.inet_ntop(socket.AF_INET, b[12:])
+    return socket.inet_ntop(socket.AF_INET6, b)
+
+class acct_bin_file(object):
+    f = None
+    bo = None
+    schema = None
+
+    def __init__(self, f):
+        self.f = f
+        hdr = f.read(24)
+        if len(hdr) < 24 or hdr[:8] != FMAGIC:
+            raise ValueError('not an acct_bin file')
+        for bo in ('<', '>'):
+            bom, version, hlen, ncols = struct.unpack(bo + 'IIII', hdr[8:])
+            if bom == BOM:
+                break
+        else:
+            raise ValueError('unknown byte order')
+        if version != VERSION:
+            raise ValueError('unsupported version %d' % version)
+        self.bo = bo
+        self.schema = []
+        cdata = f.read(hlen - 24)
+        for i in range(ncols):
+            ctype, name = struct.unpack_from(bo + 'I28s', cdata, i * 32)
+            name = name.rstrip(b'\0').decode('ascii')
+            self.schema.append((name, ctype))
+
+    def read_blocks(self):
+        bo = self.bo
+        while True:
+            bhdr = self.f.read(24)
+            if len(bhdr) < 24:
+                return
+            magic, blen, nrecs, pid, nid_len, _ = struct.unpack(bo + 'IIIiII', \
+              bhdr)
+            if magic != BMAGIC:
+                raise ValueError('bad block magic')
+            data = self.f.read(blen - 24)
+            if len(data) < blen - 24:
+                return
+            cols = {}
+            cols['rtpp_node_id'] = [data[:nid_len].decode('ascii'),] * nrecs
+            cols['rtpp_pid'] = [pid,] * nrecs
+            off = align(nid_len)
+            for name, ctype in self.schema:
+                code, size = TYPES[ctype]
+                if ctype == T_STR:
+                    offs = struct.unpack_from('%s%dI' % (bo, nrecs + 1), data, \
+                      off)
+                    sbase = off + 4 * (nrecs + 1)
+                    cols[name] = [data[sbase + offs[i]:sbase + offs[i + 1]].decode('utf-8', 'replace') \
+                      for i in range(nrecs)]
+                    clen = 4 * (nrecs + 1) + offs[nrecs]
+                elif ctype == T_IP6:
+                    cols[name] = [ip6_str(data[off + i * 16:off + (i + 1) * 16]) \
+                      for i in range(nrecs)]
+                    clen = 16 * nrecs
+                else:
+                    cols[name] = struct.unpack_from('%s%d%s' % (bo, nrecs, code), \
+                      data, off)
+                    clen = size * nrecs
+                off += align(clen)
+            yield nrecs, cols
+
+    def colnames(self):
+        return ['rtpp_node_id', 'rtpp_pid'] + [x[0] for x in self.schema]
+
+def fmt_val(v):
+    if isinstance(v, float):
+        return '%f' % v
+    return str(v)
+
+def usage():
+    print('usage: rtpp_acct_bin_read.py [-c col1[,col2...]] [-n] file1 [file2]..[fileN]')
+    sys.exit(1)
+
+if __name__ == '__main__':
+    columns = None
+    header = True
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], 'c:n')
+    except getopt.GetoptError:
+        usage()
+
+    for o, a in opts:
+        if o == '-c':
+            columns = a.strip().split(',')
+            continue
+        if o == '-n':
+            header = False
+            continue
+
+    if len(args) == 0:
+        usage()
+
+    out = sys.stdout
+    for fname in args:
+        abf = acct_bin_file(open(fname, 'rb'))
+        cnames = columns
+        if cnames == None:
+            cnames = abf.colnames()
+        if header:
+            out.write(','.join(cnames) + '\n')
+            header = False
+        for nrecs, cols in abf.read_blocks():
+            cvals = [cols[x] for x in cnames]
+            for i in range(nrecs):
+                out.write(','.join([fmt_val(x[i]) for x in cvals]) + '\n')
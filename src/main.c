@@ -75,20 +75,27 @@
 #include "rtpp_hash_table.h"
 #include "rtpp_command.h"
 #include "rtpp_command_async.h"
+#include "rtpp_pcache.h"
 #include "rtpp_port_table.h"
 #include "rtpp_proc_async.h"
+#include "rtpp_proc_servers.h"
+#include "rtpp_record_writer.h"
 #include "rtpp_bindaddrs.h"
 #include "rtpp_network.h"
 #include "rtpp_notify.h"
 #include "rtpp_math.h"
 #include "rtpp_mallocs.h"
+#include "rtpp_analyzer.h"
 #if ENABLE_MODULE_IF
 #include "rtpp_module_if.h"
 #endif
 #include "rtpp_stats.h"
 #include "rtpp_sessinfo.h"
+#include "rtpp_socket.h"
+#include "rtpp_sockpool.h"
 #include "rtpp_list.h"
 #include "rtpp_time.h"
+#include "rtpp_ticker.h"
 #include "rtpp_timed.h"
 #include "rtpp_tnotify_set.h"
 #include "rtpp_weakref.h"
@@ -121,6 +128,7 @@ usage(void)
       "[-L nfiles] [-m port_min]\n\t  [-M port_max] [-u uname[:gname]] [-w sock_mode] "
       "[-n timeout_socket]\n\t  [-d log_level[:log_facility]] [-p pid_file]\n"
       "\t  [-c fifo|rr] [-A addr1[/addr2] [-N random/sched_offset] [-W setup_ttl]\n"
+      "\t  [--rcache_mem kbytes]\n"
       "\trtpproxy -V\n");
     exit(1);
 }
@@ -202,6 +210,14 @@ rtpp_rlim_max(struct cfg *cf)
 
 const static struct option longopts[] = {
     { "dso", required_argument, NULL, 0 },
+    { "rcache_mem", required_argument, NULL, 0 },
+    { "sockpool_depth", required_argument, NULL, 0 },
+    { "record_io", required_argument, NULL, 0 },
+    { "rtpa_policy", required_argument, NULL, 0 },
+    { "clock", required_argument, NULL, 0 },
+    { "busy_poll", required_argument, NULL, 0 },
+    { "busy_poll_cpu", required_argument, NULL, 0 },
+    { "rlat_sample", required_argument, NULL, 0 },
     { NULL,  0,                 NULL, 0 }
 };
 
@@ -210,11 +226,91 @@ handle_longopt(struct rtpp_cfg_stable *cfsp, const char *on, const char *optarg)
 {
 
     if (strcmp(on, "dso") == 0) {
-        if (cfsp->mpath != NULL) {
-             errx(1, "this version of the rtpproxy only supports loading a "
-               "single module");
+        if (cfsp->nmodules == RTPP_MODULES_MAX) {
+             errx(1, "this version of the rtpproxy only supports loading up "
+               "to %d modules", RTPP_MODULES_MAX);
+        }
+        cfsp->mpath[cfsp->nmodules] = strdup(optarg);
+        if (cfsp->mpath[cfsp->nmodules] == NULL) {
+             err(1, "strdup");
+        }
+        cfsp->nmodules++;
+        return;
+    }
+    if (strcmp(on, "rcache_mem") == 0) {
+        /* Size of the command reply cache, in KiB */
+        if (atoi(optarg) <= 0) {
+             errx(1, "%s: invalid reply cache size", optarg);
+        }
+        cfsp->rcache_mem = (size_t)atoi(optarg) * 1024;
+        return;
+    }
+    if (strcmp(on, "sockpool_depth") == 0) {
+        /* Number of pre-bound socket pairs to keep per listen address */
+        if (atoi(optarg) < 0) {
+             errx(1, "%s: invalid socket pool depth", optarg);
+        }
+        cfsp->sockpool_depth = atoi(optarg);
+        return;
+    }
+    if (strcmp(on, "record_io") == 0) {
+        /* I/O method for writing recordings, io_uring is used if available */
+        if (strcmp(optarg, "sync") == 0) {
+            cfsp->record_io_sync = 1;
+        } else if (strcmp(optarg, "uring") == 0) {
+            cfsp->record_io_sync = 0;
+        } else if (strcmp(optarg, "mmap") == 0) {
+            /* Local recordings only, the writer is kept as a fallback */
+            cfsp->record_io_mmap = 1;
+        } else {
+             errx(1, "%s: unknown recording I/O method", optarg);
+        }
+        return;
+    }
+    if (strcmp(on, "rtpa_policy") == 0) {
+        /* Which streams / parts of streams to run the RTP analyzer on */
+        if (cfsp->rtpa_policy != NULL) {
+            free(cfsp->rtpa_policy);
+        }
+        cfsp->rtpa_policy = rtpa_policy_parse(optarg);
+        if (cfsp->rtpa_policy == NULL) {
+             errx(1, "%s: invalid RTP analyzer policy", optarg);
+        }
+        return;
+    }
+    if (strcmp(on, "clock") == 0) {
+        /* How the main loop keeps time, "pfd" is the phase-locked usleep() */
+        if (strcmp(optarg, "pfd") == 0) {
+            cfsp->tickless = 0;
+        } else if (strcmp(optarg, "tickless") == 0) {
+            cfsp->tickless = 1;
+        } else {
+             errx(1, "%s: unknown clock mode", optarg);
         }
-        cfsp->mpath = strdup(optarg);
+        return;
+    }
+    if (strcmp(on, "busy_poll") == 0) {
+        /* Time to keep spinning on the RTP sockets after a tick, in usec */
+        if (atoi(optarg) < 0) {
+             errx(1, "%s: invalid busy poll budget", optarg);
+        }
+        cfsp->busy_poll = atoi(optarg);
+        return;
+    }
+    if (strcmp(on, "busy_poll_cpu") == 0) {
+        /* CPU to bind the packet processing thread to when spinning */
+        if (atoi(optarg) < 0) {
+             errx(1, "%s: invalid CPU number", optarg);
+        }
+        cfsp->busy_poll_cpu = atoi(optarg);
+        return;
+    }
+    if (strcmp(on, "rlat_sample") == 0) {
+        /* Record relay latency of one in that many packets, 0 - disable */
+        if (atoi(optarg) < 0) {
+             errx(1, "%s: invalid relay latency sampling rate", optarg);
+        }
+        cfsp->rlat_sample = atoi(optarg);
         return;
     }
     errx(1, "unknown option: --%s", on);
@@ -261,6 +357,8 @@ init_config(struct cfg *cf, int argc, char **argv)
 #endif
     cf->stable->slowshutdown = 0;
     cf->stable->fastshutdown = 0;
+    cf->stable->busy_poll_cpu = -1;
+    cf->stable->rlat_sample = 1;
 
     cf->stable->rtpp_tnset_cf = rtpp_tnotify_set_ctor();
     if (cf->stable->rtpp_tnset_cf == NULL) {
@@ -649,24 +747,139 @@ update_derived_stats(double dtime, void *argp)
     return (CB_MORE);
 }
 
-int
-main(int argc, char **argv)
+static void
+main_loop_pfd(struct cfg *cf)
 {
-    int i, len;
     double eval, clk;
     long long ncycles_ref, counter;
     double eptime;
     double add_delay;
-    struct cfg cf;
-    char buf[256];
     struct recfilter loop_error;
     struct PFD phase_detector;
     useconds_t usleep_time;
-    struct sched_param sparam;
 #if RTPP_DEBUG_timers
     double sleep_time, filter_lastval;
 #endif
 
+    counter = 0;
+    recfilter_init(&loop_error, 0.96, 0.0, 0);
+    PFD_init(&phase_detector, 0.0);
+
+    for (;;) {
+	eptime = getdtime();
+
+        clk = (eptime + cf->stable->sched_offset) * cf->stable->target_pfreq;
+
+        ncycles_ref = llrint(clk);
+
+        eval = PFD_get_error(&phase_detector, clk);
+
+#if RTPP_DEBUG_timers
+        filter_lastval = loop_error.lastval;
+#endif
+
+        if (eval != 0.0) {
+            recfilter_apply(&loop_error, sigmoid(eval));
+        }
+
+#if RTPP_DEBUG_timers
+        if (counter % (unsigned int)cf->stable->target_pfreq == 0 || counter < 1000) {
+          RTPP_LOG(cf->stable->glog, RTPP_LOG_DBUG, "run %lld ncycles %f raw error1 %f, filter lastval %f, filter nextval %f",
+            counter, clk, eval, filter_lastval, loop_error.lastval);
+        }
+#endif
+        add_delay = freqoff_to_period(cf->stable->target_pfreq, 1.0, loop_error.lastval);
+        usleep_time = add_delay * 1000000.0;
+#if RTPP_DEBUG_timers
+        if (counter % (unsigned int)cf->stable->target_pfreq == 0 || counter < 1000) {
+            RTPP_LOG(cf->stable->glog, RTPP_LOG_DBUG, "run %lld filter lastval %f, filter nextval %f, error %f",
+              counter, filter_lastval, loop_error.lastval, sigmoid(eval));
+            RTPP_LOG(cf->stable->glog, RTPP_LOG_DBUG, "run %lld extra sleeping time %llu", counter, usleep_time);
+        }
+        sleep_time = getdtime();
+#endif
+        CALL_METHOD(cf->stable->rtpp_proc_cf, wakeup, counter, ncycles_ref);
+        usleep(usleep_time);
+        CALL_METHOD(cf->stable->rtpp_timed_cf, wakeup, eptime + add_delay);
+#if RTPP_DEBUG_timers
+        sleep_time = getdtime() - sleep_time;
+        if (counter % (unsigned int)cf->stable->target_pfreq == 0 || counter < 1000 || sleep_time > add_delay * 2.0) {
+            RTPP_LOG(cf->stable->glog, RTPP_LOG_DBUG, "run %lld sleeping time required %llu sleeping time actual %f, CSV: %f,%f,%f", \
+              counter, usleep_time, sleep_time, (double)counter / cf->stable->target_pfreq, ((double)usleep_time) / 1000.0, sleep_time * 1000.0);
+        }
+#endif
+        counter += 1;
+        if (cf->stable->fastshutdown != 0) {
+            break;
+        }
+        if (cf->stable->slowshutdown != 0 &&
+          CALL_METHOD(cf->stable->sessions_wrt, get_length) == 0) {
+            RTPP_LOG(cf->stable->glog, RTPP_LOG_INFO,
+              "deorbiting-burn sequence completed, exiting");
+            break;
+        }
+    }
+}
+
+/*
+ * Tickless variant of the above: ticks are scheduled at absolute times
+ * on the monotonic clock, so there is no drift to correct for. With no
+ * sessions around the processing thread is not woken up at all and the
+ * loop only runs for the timed tasks, or when the command thread tells
+ * it that something may have changed.
+ */
+static void
+main_loop_tickless(struct cfg *cf)
+{
+    double clk, eptime, freq, offset;
+    long long ncycles_ref, counter;
+    int idle;
+
+    freq = cf->stable->target_pfreq;
+    offset = cf->stable->sched_offset;
+    counter = 0;
+    eptime = getdtime();
+    clk = floor((eptime + offset) * freq);
+    for (;;) {
+        idle = (CALL_METHOD(cf->stable->sessions_wrt, get_length) == 0);
+        if (idle) {
+            CALL_METHOD(cf->stable->ticker, wait_until,
+              eptime + TIMED_PERIOD);
+        } else {
+            CALL_METHOD(cf->stable->ticker, sleep_until,
+              (clk + 1.0) / freq - offset);
+        }
+        eptime = getdtime();
+        clk = (eptime + offset) * freq;
+        ncycles_ref = llrint(clk);
+        /* Next tick is the first grid point after now */
+        clk = floor(clk + 0.001);
+
+        if (!idle) {
+            CALL_METHOD(cf->stable->rtpp_proc_cf, wakeup, counter, ncycles_ref);
+        }
+        CALL_METHOD(cf->stable->rtpp_timed_cf, wakeup, eptime);
+        counter += 1;
+        if (cf->stable->fastshutdown != 0) {
+            break;
+        }
+        if (cf->stable->slowshutdown != 0 &&
+          CALL_METHOD(cf->stable->sessions_wrt, get_length) == 0) {
+            RTPP_LOG(cf->stable->glog, RTPP_LOG_INFO,
+              "deorbiting-burn sequence completed, exiting");
+            break;
+        }
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    int i, len;
+    struct cfg cf;
+    char buf[256];
+    struct sched_param sparam;
+
 #ifdef RTPP_CHECK_LEAKS
     RTPP_MEMDEB_INIT(rtpproxy);
 #endif
@@ -738,6 +951,12 @@ main(int argc, char **argv)
          /* NOTREACHED */
     }
 
+    cf.stable->pcache = rtpp_pcache_ctor();
+    if (cf.stable->pcache == NULL) {
+        err(1, "can't allocate memory for the prompt cache");
+         /* NOTREACHED */
+    }
+
     for (i = 0; i <= RTPP_PT_MAX; i++) {
         cf.stable->port_table[i] = rtpp_port_table_ctor(cf.stable->port_min,
           cf.stable->port_max, cf.stable->seq_ports, cf.stable->port_ctl);
@@ -758,16 +977,16 @@ main(int argc, char **argv)
             if (cf.stable->cwd_orig == NULL) {
                 err(1, "getcwd");
             }
-            if (cf.stable->mpath != NULL) {
+            for (i = 0; i < cf.stable->nmodules; i++) {
                 char *mpath_abs;
 
                 asprintf(&mpath_abs, "%s/%s", cf.stable->cwd_orig,
-                  cf.stable->mpath);
+                  cf.stable->mpath[i]);
                 if (mpath_abs == NULL) {
                     err(1, "asprintf");
                 }
-                free(cf.stable->mpath);
-                cf.stable->mpath = mpath_abs;
+                free(cf.stable->mpath[i]);
+                cf.stable->mpath[i] = mpath_abs;
             }
         }
 	if (rtpp_daemon(cf.stable->no_chdir, 0) == -1)
@@ -819,6 +1038,12 @@ main(int argc, char **argv)
     }
     set_rlimits(&cf);
 
+    cf.stable->proc_servers = rtpp_proc_servers_ctor(cf.stable);
+    if (cf.stable->proc_servers == NULL) {
+        err(1, "can't allocate memory for the players queue");
+         /* NOTREACHED */
+    }
+
     cf.stable->rtpp_proc_cf = rtpp_proc_async_ctor(&cf);
     if (cf.stable->rtpp_proc_cf == NULL) {
         RTPP_LOG(cf.stable->glog, RTPP_LOG_ERR,
@@ -826,11 +1051,15 @@ main(int argc, char **argv)
         exit(1);
     }
 
-    counter = 0;
-    recfilter_init(&loop_error, 0.96, 0.0, 0);
-    PFD_init(&phase_detector, 0.0);
+    if (cf.stable->tickless != 0) {
+        cf.stable->ticker = rtpp_ticker_ctor();
+        if (cf.stable->ticker == NULL) {
+            err(1, "can't allocate memory for the main loop ticker");
+             /* NOTREACHED */
+        }
+    }
 
-    cf.stable->rtpp_timed_cf = rtpp_timed_ctor(0.1);
+    cf.stable->rtpp_timed_cf = rtpp_timed_ctor(TIMED_PERIOD);
     if (cf.stable->rtpp_timed_cf == NULL) {
         RTPP_ELOG(cf.stable->glog, RTPP_LOG_ERR,
           "can't init scheduling subsystem");
@@ -850,18 +1079,44 @@ main(int argc, char **argv)
         exit(1);
     }
 
+    cf.stable->rtpp_recwr_cf = rtpp_record_writer_ctor(cf.stable->glog,
+      cf.stable->rtpp_stats, !cf.stable->record_io_sync);
+    if (cf.stable->rtpp_recwr_cf == NULL) {
+        RTPP_ELOG(cf.stable->glog, RTPP_LOG_ERR,
+          "can't init session recording subsystem");
+        exit(1);
+    }
+
 #if ENABLE_MODULE_IF
-    if (cf.stable->mpath != NULL) {
-        cf.stable->modules_cf = rtpp_module_if_ctor(cf.stable, cf.stable->glog,
-          cf.stable->mpath);
+    if (cf.stable->nmodules > 0) {
+        cf.stable->modules_cf = rtpp_module_if_ctor(cf.stable->glog,
+          cf.stable->rtpp_stats);
         if (cf.stable->modules_cf == NULL) {
             RTPP_LOG(cf.stable->glog, RTPP_LOG_ERR,
-              "%s: dymanic module load has failed", cf.stable->mpath);
+              "can't init dynamic modules subsystem");
             exit(1);
         }
+        for (i = 0; i < cf.stable->nmodules; i++) {
+            if (CALL_METHOD(cf.stable->modules_cf, load, cf.stable,
+              cf.stable->mpath[i]) != 0) {
+                RTPP_LOG(cf.stable->glog, RTPP_LOG_ERR,
+                  "%s: dymanic module load has failed", cf.stable->mpath[i]);
+                exit(1);
+            }
+        }
     }
 #endif
 
+    if (cf.stable->sockpool_depth > 0) {
+        cf.stable->rtpp_sockpool_cf = rtpp_sockpool_ctor(&cf,
+          cf.stable->sockpool_depth);
+        if (cf.stable->rtpp_sockpool_cf == NULL) {
+            RTPP_ELOG(cf.stable->glog, RTPP_LOG_ERR,
+              "can't init socket pre-binding subsystem");
+            exit(1);
+        }
+    }
+
     cf.stable->rtpp_cmd_cf = rtpp_command_async_ctor(&cf);
     if (cf.stable->rtpp_cmd_cf == NULL) {
         RTPP_ELOG(cf.stable->glog, RTPP_LOG_ERR,
@@ -897,62 +1152,16 @@ main(int argc, char **argv)
 #ifdef HAVE_SYSTEMD_DAEMON
     sd_notify(0, "READY=1");
 #endif
-    for (;;) {
-	eptime = getdtime();
-
-        clk = (eptime + cf.stable->sched_offset) * cf.stable->target_pfreq;
-
-        ncycles_ref = llrint(clk);
-
-        eval = PFD_get_error(&phase_detector, clk);
-
-#if RTPP_DEBUG_timers
-        filter_lastval = loop_error.lastval;
-#endif
-
-        if (eval != 0.0) {
-            recfilter_apply(&loop_error, sigmoid(eval));
-        }
-
-#if RTPP_DEBUG_timers
-        if (counter % (unsigned int)cf.stable->target_pfreq == 0 || counter < 1000) {
-          RTPP_LOG(cf.stable->glog, RTPP_LOG_DBUG, "run %lld ncycles %f raw error1 %f, filter lastval %f, filter nextval %f",
-            counter, clk, eval, filter_lastval, loop_error.lastval);
-        }
-#endif
-        add_delay = freqoff_to_period(cf.stable->target_pfreq, 1.0, loop_error.lastval);
-        usleep_time = add_delay * 1000000.0;
-#if RTPP_DEBUG_timers
-        if (counter % (unsigned int)cf.stable->target_pfreq == 0 || counter < 1000) {
-            RTPP_LOG(cf.stable->glog, RTPP_LOG_DBUG, "run %lld filter lastval %f, filter nextval %f, error %f",
-              counter, filter_lastval, loop_error.lastval, sigmoid(eval));
-            RTPP_LOG(cf.stable->glog, RTPP_LOG_DBUG, "run %lld extra sleeping time %llu", counter, usleep_time);
-        }
-        sleep_time = getdtime();
-#endif
-        CALL_METHOD(cf.stable->rtpp_proc_cf, wakeup, counter, ncycles_ref);
-        usleep(usleep_time);
-        CALL_METHOD(cf.stable->rtpp_timed_cf, wakeup, eptime + add_delay);
-#if RTPP_DEBUG_timers
-        sleep_time = getdtime() - sleep_time;
-        if (counter % (unsigned int)cf.stable->target_pfreq == 0 || counter < 1000 || sleep_time > add_delay * 2.0) {
-            RTPP_LOG(cf.stable->glog, RTPP_LOG_DBUG, "run %lld sleeping time required %llu sleeping time actual %f, CSV: %f,%f,%f", \
-              counter, usleep_time, sleep_time, (double)counter / cf.stable->target_pfreq, ((double)usleep_time) / 1000.0, sleep_time * 1000.0);
-        }
-#endif
-        counter += 1;
-        if (cf.stable->fastshutdown != 0) {
-            break;
-        }
-        if (cf.stable->slowshutdown != 0 &&
-          CALL_METHOD(cf.stable->sessions_wrt, get_length) == 0) {
-            RTPP_LOG(cf.stable->glog, RTPP_LOG_INFO,
-              "deorbiting-burn sequence completed, exiting");
-            break;
-        }
+    if (cf.stable->tickless != 0) {
+        main_loop_tickless(&cf);
+    } else {
+        main_loop_pfd(&cf);
     }
 
     CALL_METHOD(cf.stable->rtpp_cmd_cf, dtor);
+    if (cf.stable->rtpp_sockpool_cf != NULL) {
+        CALL_SMETHOD(cf.stable->rtpp_sockpool_cf->rcnt, decref);
+    }
 #if ENABLE_MODULE_IF
     if (cf.stable->modules_cf != NULL) {
         CALL_SMETHOD(cf.stable->modules_cf->rcnt, decref);
@@ -962,6 +1171,18 @@ main(int argc, char **argv)
     CALL_METHOD(cf.stable->rtpp_tnset_cf, dtor);
     CALL_SMETHOD(cf.stable->rtpp_timed_cf->rcnt, decref);
     CALL_METHOD(cf.stable->rtpp_proc_cf, dtor);
+    CALL_SMETHOD(cf.stable->proc_servers->rcnt, decref);
+    if (cf.stable->ticker != NULL) {
+        CALL_SMETHOD(cf.stable->ticker->rcnt, decref);
+    }
+    CALL_METHOD(cf.stable->rtpp_recwr_cf, dtor);
+    if (cf.stable->rrec_agg_sock != NULL) {
+        CALL_SMETHOD(cf.stable->rrec_agg_sock->rcnt, decref);
+    }
+    if (cf.stable->rtpa_policy != NULL) {
+        free(cf.stable->rtpa_policy);
+    }
+    CALL_SMETHOD(cf.stable->pcache->rcnt, decref);
     CALL_SMETHOD(cf.stable->sessinfo->rcnt, decref);
     for (i = 0; i <= RTPP_PT_MAX; i++) {
         CALL_SMETHOD(cf.stable->port_table[i]->rcnt, decref);
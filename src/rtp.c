@@ -132,8 +132,15 @@ rtp_calc_samples(int codec_id, size_t nbytes, const unsigned char *data)
 	    return g723_samples(data, nbytes);
 
 	case RTP_G722:
+	    /* 16kHz audio, but the RTP clock runs at 8kHz, RFC3551 4.5.2 */
 	    return nbytes;
 
+	case RTP_L16_MONO:
+	    return nbytes / 2;
+
+	case RTP_L16_STEREO:
+	    return nbytes / 4;
+
 	default:
 	    return RTP_NSAMPLES_UNKNOWN;
     }
@@ -209,8 +216,18 @@ rtp_packet_chunk_find_g723(struct rtp_packet *pkt, struct rtp_packet_chunk *ret,
 static void
 rtp_packet_chunk_find_g722(struct rtp_packet *pkt, struct rtp_packet_chunk *ret, int min_nsamples)
 {
+
+    /* Each octet carries two 16kHz samples, i.e. one tick of the 8kHz clock */
     ret->nsamples = min_nsamples;
-    ret->bytes = min_nsamples / 2;
+    ret->bytes = min_nsamples;
+}
+
+static void
+rtp_packet_chunk_find_l16(struct rtp_packet *pkt, struct rtp_packet_chunk *ret, int min_nsamples)
+{
+
+    ret->nsamples = min_nsamples;
+    ret->bytes = min_nsamples * 2 * pkt->parsed->rtp_profile->nchannels;
 }
 
 
@@ -249,6 +266,11 @@ rtp_packet_first_chunk_find(struct rtp_packet *pkt, struct rtp_packet_chunk *ret
 	rtp_packet_chunk_find_g722(pkt, ret, min_nsamples);
 	break;
 
+    case RTP_L16_MONO:
+    case RTP_L16_STEREO:
+	rtp_packet_chunk_find_l16(pkt, ret, min_nsamples);
+	break;
+
     default:
 	ret->whole_packet_matched = 1;
 	break;
@@ -291,8 +313,13 @@ rtp_packet_parse_errstr(rtp_parser_err_t ecode)
     return NULL;
 }
 
-rtp_parser_err_t
-rtp_packet_parse_raw(unsigned char *buf, size_t size, struct rtp_info *rinfo)
+/*
+ * Header-only part of the parser: validates the packet and fills in
+ * everything but the nsamples, which requires looking into the payload
+ * and is only needed when the packet is going to be re-packetized.
+ */
+static rtp_parser_err_t
+rtp_packet_parse_hdr(unsigned char *buf, size_t size, struct rtp_info *rinfo)
 {
     int padding_size;
     rtp_hdr_ext_t *hdr_ext_ptr;
@@ -343,8 +370,19 @@ rtp_packet_parse_raw(unsigned char *buf, size_t size, struct rtp_info *rinfo)
     rinfo->ssrc = ntohl(header->ssrc);
     rinfo->rtp_profile = &rtp_profiles[header->pt];
 
+    return RTP_PARSER_OK;
+}
+
+static void
+rtp_packet_parse_samples_raw(unsigned char *buf, struct rtp_info *rinfo)
+{
+    rtp_hdr_t *header;
+
+    header = (rtp_hdr_t *)buf;
+
+    rinfo->nsamples = RTP_NSAMPLES_UNKNOWN;
     if (rinfo->data_size == 0)
-        return RTP_PARSER_OK;
+        return;
 
     rinfo->nsamples = rtp_calc_samples(header->pt, rinfo->data_size,
       &buf[rinfo->data_offset]);
@@ -354,7 +392,18 @@ rtp_packet_parse_raw(unsigned char *buf, size_t size, struct rtp_info *rinfo)
      */
     if (header->pt == RTP_G729 && (rinfo->data_size % 10) != 0)
         rinfo->appendable = 0;
-    return RTP_PARSER_OK;
+}
+
+rtp_parser_err_t
+rtp_packet_parse_raw(unsigned char *buf, size_t size, struct rtp_info *rinfo)
+{
+    rtp_parser_err_t rval;
+
+    rval = rtp_packet_parse_hdr(buf, size, rinfo);
+    if (rval != RTP_PARSER_OK)
+        return (rval);
+    rtp_packet_parse_samples_raw(buf, rinfo);
+    return (RTP_PARSER_OK);
 }
 
 rtp_parser_err_t
@@ -369,13 +418,30 @@ rtp_packet_parse(struct rtp_packet *pkt)
     assert(pkt->parsed == NULL);
     pkt_full = (void *)pkt;
     rinfo = &(pkt_full->pvt.rinfo);
-    pkt->parse_result = rtp_packet_parse_raw(pkt->data.buf, pkt->size, rinfo);
+    pkt->parse_result = rtp_packet_parse_hdr(pkt->data.buf, pkt->size, rinfo);
     if (pkt->parse_result == RTP_PARSER_OK) {
+        rinfo->nsamples = RTP_NSAMPLES_NOTCALC;
         pkt->parsed = rinfo;
     }
     return (pkt->parse_result);
 }
 
+/*
+ * Same as the rtp_packet_parse(), but also makes sure that the number of
+ * samples in the payload has been calculated. Results are cached in the
+ * packet, so it's cheap to call it more than once.
+ */
+rtp_parser_err_t
+rtp_packet_parse_samples(struct rtp_packet *pkt)
+{
+
+    if (rtp_packet_parse(pkt) != RTP_PARSER_OK)
+        return (pkt->parse_result);
+    if (pkt->parsed->nsamples == RTP_NSAMPLES_NOTCALC)
+        rtp_packet_parse_samples_raw(pkt->data.buf, pkt->parsed);
+    return (RTP_PARSER_OK);
+}
+
 void
 rtp_packet_dup(struct rtp_packet *dpkt, struct rtp_packet *spkt, int flags)
 {
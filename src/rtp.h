@@ -69,6 +69,7 @@ extern const struct rtp_profile rtp_profiles[];
 typedef enum rtp_type rtp_type_t;
 
 #define RTP_NSAMPLES_UNKNOWN  (-1)
+#define RTP_NSAMPLES_NOTCALC  (-2)	/* Only the header has been parsed */
 
 #if !defined(BYTE_ORDER)
 # error "BYTE_ORDER needs to be defined"
@@ -135,6 +136,7 @@ struct rtp_packet_chunk {
 const char *rtp_packet_parse_errstr(rtp_parser_err_t);
 rtp_parser_err_t rtp_packet_parse_raw(unsigned char *, size_t, struct rtp_info *);
 rtp_parser_err_t rtp_packet_parse(struct rtp_packet *);
+rtp_parser_err_t rtp_packet_parse_samples(struct rtp_packet *);
 
 void rtp_packet_first_chunk_find(struct rtp_packet *, struct rtp_packet_chunk *, int min_nsamples);
 
@@ -30,6 +30,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "rtpp_ssrc.h"
 #include "rtpa_stats.h"
@@ -42,42 +46,103 @@
 #include "rtp.h"
 #include "rtp_analyze.h"
 #include "rtpp_math.h"
-#include "rtpp_refcnt.h"
-#include "rtpp_ringbuf.h"
 
-struct rtp_analyze_jdata;
+#define RTPC_JDATA_MAX 10
+#define RTPC_TS_DEDUP_LEN 10
 
-struct rtp_analyze_jitter {
-    int jdlen;
-    double jmax_acum;
-    double jtotal_acum;
-    long long jvcount_acum;
-    long long pcount_acum;
-    struct rtp_analyze_jdata *first;
-};
+/*
+ * Arrays searched with u32_match() are padded to the multiple of the
+ * vector size, so that it never has to deal with the tail separately.
+ */
+#define RTPC_VPAD(n)   (((n) + 3) & ~3)
 
 struct rtp_analyze_jdata_ssrc {
     uint64_t prev_rtime_ts;
     uint32_t prev_ts;
+    double jlast;
+    double jmax;
+    double jtotal;
+    long long pcount;
 #if 0
     long long ts_rcount;
     long long ts_jcount;
 #endif
     long long ts_dcount;
     long long seq_rcount;
-    double jlast;
-    double jmax;
-    double jtotal;
-    long long pcount;
 };
 
+/*
+ * Per-SSRC state. Everything that is touched for every packet, i.e. the
+ * last few timestamps seen and the running jitter figures, is kept
+ * together in one array slot to avoid chasing pointers.
+ */
 struct rtp_analyze_jdata {
+    int ts_dedup_len;		/* Number of valid entries in the ts_dedup */
+    int ts_dedup_pos;		/* Next entry in the ts_dedup to overwrite */
+    uint32_t ts_dedup[RTPC_VPAD(RTPC_TS_DEDUP_LEN)];
     struct rtp_analyze_jdata_ssrc jss;
-    struct rtpp_ringbuf *ts_dedup;
-    struct rtpp_ssrc ssrc;
-    struct rtp_analyze_jdata *next;
 };
 
+struct rtp_analyze_jitter {
+    int jdlen;
+    int jdlast;			/* Slot of the most recently added SSRC */
+    uint32_t ssrcs[RTPC_VPAD(RTPC_JDATA_MAX)];
+    struct rtp_analyze_jdata jdata[RTPC_JDATA_MAX];
+    double jmax_acum;
+    double jtotal_acum;
+    long long jvcount_acum;
+    long long pcount_acum;
+};
+
+/*
+ * Returns bitmask of the first n elements of the arr[] that are equal to
+ * the val, arr[] has to be padded with RTPC_VPAD().
+ */
+static inline unsigned int
+u32_match(const uint32_t *arr, int n, uint32_t val)
+{
+    unsigned int mask;
+    int i;
+#if defined(__SSE2__)
+    __m128i vval, varr;
+
+    vval = _mm_set1_epi32(val);
+    mask = 0;
+    for (i = 0; i < n; i += 4) {
+        varr = _mm_loadu_si128((const __m128i *)&arr[i]);
+        mask |= (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(
+          _mm_cmpeq_epi32(varr, vval))) << i;
+    }
+#else
+    mask = 0;
+    for (i = 0; i < n; i++) {
+        mask |= (unsigned int)(arr[i] == val) << i;
+    }
+#endif
+    return (mask & ((1U << n) - 1));
+}
+
+static int
+ts_dedup_locate(struct rtp_analyze_jdata *jdp, uint32_t ts)
+{
+
+    return (ffs(u32_match(jdp->ts_dedup, jdp->ts_dedup_len, ts)) - 1);
+}
+
+static void
+ts_dedup_push(struct rtp_analyze_jdata *jdp, uint32_t ts)
+{
+
+    jdp->ts_dedup[jdp->ts_dedup_pos] = ts;
+    jdp->ts_dedup_pos++;
+    if (jdp->ts_dedup_pos == RTPC_TS_DEDUP_LEN) {
+        jdp->ts_dedup_pos = 0;
+    }
+    if (jdp->ts_dedup_len < RTPC_TS_DEDUP_LEN) {
+        jdp->ts_dedup_len++;
+    }
+}
+
 static double
 rtp_ts2dtime(int ts_rate, uint32_t ts)
 {
@@ -106,8 +171,6 @@ rtp_dtime2time_ts64(int ts_rate, double dtime)
 #define RTP_SEQ_RESET  1
 #define RTP_SSRC_RESET 2
 
-#define RTPC_JDATA_MAX 10
-
 static void
 update_jitter_stats(struct rtp_analyze_jdata *jdp,
   struct rtp_info *rinfo, double rtime, int hint)
@@ -120,7 +183,7 @@ update_jitter_stats(struct rtp_analyze_jdata *jdp,
 
     rtime_ts = rtp_dtime2time_ts64(rinfo->rtp_profile->ts_rate, rtime);
     if (rinfo->rtp_profile->pt_kind == RTP_PTK_AUDIO &&
-      CALL_METHOD(jdp->ts_dedup, locate, &rinfo->ts) >= 0) {
+      ts_dedup_locate(jdp, rinfo->ts) >= 0) {
         jdp->jss.ts_dcount++;
         if (jdp->jss.pcount == 1) {
             jdp->jss.prev_rtime_ts = rtime_ts;
@@ -176,7 +239,7 @@ update_jitter_stats(struct rtp_analyze_jdata *jdp,
     jdp->jss.pcount++;
 saveandexit:
     if (rinfo->rtp_profile->pt_kind == RTP_PTK_AUDIO) {
-        CALL_METHOD(jdp->ts_dedup, push, &rinfo->ts);
+        ts_dedup_push(jdp, rinfo->ts);
     }
     jdp->jss.prev_rtime_ts = rtime_ts;
     jdp->jss.prev_ts = rinfo->ts;
@@ -197,27 +260,6 @@ rtpp_stats_init(struct rtpp_session_stat *stat)
     return (0);
 }
 
-static struct rtp_analyze_jdata *
-rtp_analyze_jdata_ctor()
-{
-    struct rtp_analyze_jdata *jdp;
-
-    jdp = rtpp_zmalloc(sizeof(*jdp));
-    if (jdp == NULL) {
-        goto e0;
-    }
-    jdp->ts_dedup = rtpp_ringbuf_ctor(sizeof(jdp->jss.prev_ts), 10);
-    if (jdp->ts_dedup == NULL) {
-        goto e1;
-    }
-    return (jdp);
-
-e1:
-    free(jdp);
-e0:
-    return (NULL);
-}
-
 static struct rtp_analyze_jitter *
 rtp_analyze_jt_ctor()
 {
@@ -225,76 +267,39 @@ rtp_analyze_jt_ctor()
 
     jp = rtpp_zmalloc(sizeof(*jp));
     if (jp == NULL) {
-        goto e0;
+        return (NULL);
     }
-    jp->first = rtp_analyze_jdata_ctor();
-    if (jp->first == NULL) {
-        goto e1;
-    }
-    jp->jdlen = 1;
+    jp->jdlast = RTPC_JDATA_MAX - 1;
     return (jp);
-
-e1:
-    free(jp);
-e0:
-    return (NULL);
 }
 
-
-static void rtp_analyze_jt_destroy(struct rtp_analyze_jitter *);
-
 void
 rtpp_stats_destroy(struct rtpp_session_stat *stat)
 {
 
-    rtp_analyze_jt_destroy(stat->jdata);
-}
-
-static void
-rtp_analyze_jt_destroy(struct rtp_analyze_jitter *jp)
-{
-    struct rtp_analyze_jdata *jdp, *jdp_next;
-
-    for (jdp = jp->first; jdp != NULL; jdp = jdp_next) {
-        jdp_next = jdp->next;
-        CALL_SMETHOD(jdp->ts_dedup->rcnt, decref);
-        free(jdp);
-        jp->jdlen -= 1;
-    }
-    RTPP_DBG_ASSERT(jp->jdlen == 0);
-    free(jp);
+    free(stat->jdata);
 }
 
+/*
+ * SSRCs are kept in the ring, ordered by the time they have been first
+ * seen. Once the ring is full, the oldest one is evicted and its stats
+ * are folded into the totals.
+ */
 static struct rtp_analyze_jdata *
 jdata_by_ssrc(struct rtp_analyze_jitter *jp, uint32_t ssrc)
 {
-    struct rtp_analyze_jdata *rjdp, *jdp_last, *jdp_prelast;
-
-    if (jp->first->ssrc.inited == 0) {
-        jp->first->ssrc.val = ssrc;
-        jp->first->ssrc.inited = 1;
-        return (jp->first);
-    }
+    struct rtp_analyze_jdata *rjdp;
+    int i;
 
-    jdp_last = jdp_prelast = NULL;
-    for (rjdp = jp->first; rjdp != NULL; rjdp = rjdp->next) {
-        if (rjdp->ssrc.val == ssrc) {
-            return (rjdp);
-        }
-        jdp_prelast = jdp_last;
-        jdp_last = rjdp;
+    i = ffs(u32_match(jp->ssrcs, jp->jdlen, ssrc)) - 1;
+    if (i >= 0) {
+        return (&jp->jdata[i]);
     }
 
+    i = (jp->jdlast + 1) % RTPC_JDATA_MAX;
+    rjdp = &jp->jdata[i];
     if (jp->jdlen == RTPC_JDATA_MAX) {
-        /* Re-use the last per-ssrc data */
-        rjdp = jdp_last;
-        if (jdp_prelast != NULL) {
-            RTPP_DBG_ASSERT(jdp_prelast->next == jdp_last);
-            jdp_prelast->next = NULL;
-        } else {
-            jp->first = NULL;
-        }
-        CALL_METHOD(rjdp->ts_dedup, flush);
+        /* Re-use the oldest per-ssrc data */
         if (rjdp->jss.pcount >= 2) {
             if (jp->jmax_acum < rjdp->jss.jmax) {
                 jp->jmax_acum = rjdp->jss.jmax;
@@ -303,20 +308,12 @@ jdata_by_ssrc(struct rtp_analyze_jitter *jp, uint32_t ssrc)
             jp->jvcount_acum += rjdp->jss.pcount - 1;
             jp->pcount_acum += rjdp->jss.pcount;
         }
-        memset(&rjdp->jss, '\0', sizeof(rjdp->jss));
-        RTPP_DBG_ASSERT(rjdp->ssrc.inited == 1);
+        memset(rjdp, '\0', sizeof(*rjdp));
     } else {
-        /* Allocate per-ssrc data */
-        rjdp = rtp_analyze_jdata_ctor();
-        if (rjdp == NULL) {
-            return (NULL);
-        }
-        rjdp->ssrc.inited = 1;
         jp->jdlen += 1;
     }
-    rjdp->ssrc.val = ssrc;
-    rjdp->next = jp->first;
-    jp->first = rjdp;
+    jp->ssrcs[i] = ssrc;
+    jp->jdlast = i;
     return (rjdp);
 }
 
@@ -377,6 +374,21 @@ update_rtpp_stats(struct rtpp_log *rlog, struct rtpp_session_stat *stat, rtp_hdr
         }
         return (UPDATE_SSRC_CHG);
     }
+    if (stat->last.pcount == 0) {
+        /* SEQ tracking has been restarted, see rtpp_stats_restart() */
+        stat->last.seq_offset = 0;
+        stat->last.max_seq = stat->last.min_seq = rinfo->seq;
+        stat->last.base_ts = rinfo->ts;
+        stat->last.base_rtime = rtime;
+        stat->last.pcount = 1;
+        idx = (rinfo->seq % 131072) >> 5;
+        stat->last.seen[idx] |= 1 << (rinfo->seq & 31);
+        stat->last.seq = rinfo->seq;
+        if (rpp->ts_rate > 0 && jdp != NULL) {
+            update_jitter_stats(jdp, rinfo, rtime, RTP_SEQ_RESET);
+        }
+        return (UPDATE_OK);
+    }
     seq = rinfo->seq + stat->last.seq_offset;
     if (header->mbt && (seq < stat->last.max_seq && (stat->last.max_seq & 0xffff) != 65535)) {
         LOGD_IF_NOT_NULL(rlog, SSRC_FMT "/%d: seq reset last->max_seq=%u, seq=%u, m=%u\n",
@@ -480,6 +492,21 @@ update_rtpp_stats(struct rtpp_log *rlog, struct rtpp_session_stat *stat, rtp_hdr
     return (UPDATE_ERR);
 }
 
+/*
+ * Folds the current SEQ tracking state into the totals and makes the next
+ * packet start it over, so that packets that have not been seen by the
+ * analyzer on purpose are not counted as lost.
+ */
+void
+rtpp_stats_restart(struct rtpp_session_stat *stat)
+{
+
+    update_rtpp_totals(stat, stat);
+    stat->last.duplicates = 0;
+    stat->last.pcount = 0;
+    memset(stat->last.seen, '\0', sizeof(stat->last.seen));
+}
+
 void
 update_rtpp_totals(struct rtpp_session_stat *wstat, struct rtpp_session_stat *ostat)
 {
@@ -499,12 +526,14 @@ update_rtpp_totals(struct rtpp_session_stat *wstat, struct rtpp_session_stat *os
 int
 get_jitter_stats(struct rtp_analyze_jitter *jp, struct rtpa_stats_jitter *jst)
 {
-    int i;
+    int i, j;
     struct rtp_analyze_jdata *rjdp;
     double jtotal;
 
     i = 0;
-    for (rjdp = jp->first; rjdp != NULL && rjdp->ssrc.inited == 1; rjdp = rjdp->next) {
+    /* Most recent SSRC first */
+    for (j = 0; j < jp->jdlen; j++) {
+        rjdp = &jp->jdata[(jp->jdlast + RTPC_JDATA_MAX - j) % RTPC_JDATA_MAX];
         if (rjdp->jss.pcount < 2) {
             continue;
         }
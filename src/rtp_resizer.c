@@ -41,6 +41,18 @@
 #include "rtpp_mallocs.h"
 #include "rtpp_ssrc.h"
 
+/*
+ * Packets waiting to be re-packetized are kept in a ring of slots indexed
+ * by the RTP sequence number, so that out-of-order packets are put into
+ * place in O(1). Only the first packet in the ring can be split, when a
+ * chunk is taken off it just the data_offset of the remaining payload is
+ * advanced, the data itself stays where it is until it goes out. This
+ * way the payload as seen through the parsed info is always the part
+ * that has not been consumed yet.
+ */
+#define	RTP_RESIZER_NSLOTS	256	/* Must be a power of 2 */
+#define	RTP_RESIZER_SLOT(seq)	((seq) & (RTP_RESIZER_NSLOTS - 1))
+
 struct rtp_resizer {
     int         nsamples_total;
 
@@ -55,17 +67,26 @@ struct rtp_resizer {
     int         tsdelta_inited;
     uint32_t    tsdelta;
 
+    int         output_ptime;
+    int         ts_rate;
     int         output_nsamples;
     int         max_buf_nsamples;
 
     struct {
-        struct rtp_packet *first;
-        struct rtp_packet *last;
-    } queue;
+        uint16_t    head;	/* SEQ of the first slot in use */
+        int         span;	/* Number of slots from the head to the last packet */
+        int         npkts;
+        int         first_off;	/* Bytes consumed from the first packet */
+        struct rtp_packet *slots[RTP_RESIZER_NSLOTS];
+    } ring;
 };
 
+/*
+ * Smallest unit (in the RTP clock ticks) the output packet size is to be
+ * a multiple of, so that the codec frames are never cut in the middle.
+ */
 static int
-min_nsamples(int codec_id)
+min_nsamples(int codec_id, int ts_rate)
 {
 
     switch (codec_id)
@@ -75,7 +96,24 @@ min_nsamples(int codec_id)
     case RTP_G723:
         return 240; /* 30ms */
     default:
-        return 80; /* 10ms */
+        return ts_rate / 100; /* 10ms */
+    }
+}
+
+/*
+ * All the timing parameters are kept in the units of the RTP clock of the
+ * stream being resized, so they have to be re-calculated every time the
+ * clock rate changes.
+ */
+static void
+rtp_resizer_set_rate(struct rtp_resizer *this, int ts_rate)
+{
+
+    this->ts_rate = ts_rate;
+    this->output_nsamples = this->output_ptime * ts_rate / 1000;
+    this->max_buf_nsamples = this->output_nsamples * 2;
+    if (this->max_buf_nsamples < ts_rate / 25) {
+        this->max_buf_nsamples = ts_rate / 25; /* 40ms */
     }
 }
 
@@ -94,17 +132,14 @@ rtp_resizer_new(int output_ptime)
 void 
 rtp_resizer_free(struct rtpp_stats *rtpp_stats, struct rtp_resizer *this)
 {
-    struct rtp_packet *p;
-    struct rtp_packet *p1;
-    int nfree;
+    int i, nfree;
 
     nfree = 0;
-    p = this->queue.first;
-    while (p != NULL) {
-        p1 = p;
-        p = p->next;
-        rtp_packet_free(p1);
-        nfree++;
+    for (i = 0; i < RTP_RESIZER_NSLOTS; i++) {
+        if (this->ring.slots[i] != NULL) {
+            rtp_packet_free(this->ring.slots[i]);
+            nfree++;
+        }
     }
     free(this);
     if (nfree > 0) {
@@ -116,7 +151,7 @@ int
 rtp_resizer_get_ptime(struct rtp_resizer *this)
 {
 
-    return(this->output_nsamples / 8);
+    return(this->output_ptime);
 }
 
 int
@@ -125,11 +160,8 @@ rtp_resizer_set_ptime(struct rtp_resizer *this, int ptime_new)
     int ptime_old;
 
     ptime_old = rtp_resizer_get_ptime(this);
-    this->output_nsamples = ptime_new * 8;
-    this->max_buf_nsamples = this->output_nsamples * 2;
-    if (this->max_buf_nsamples < 320) {
-        this->max_buf_nsamples = 320;
-    }
+    this->output_ptime = ptime_new;
+    rtp_resizer_set_rate(this, this->ts_rate > 0 ? this->ts_rate : 8000);
     return (ptime_old);
 }
 
@@ -137,17 +169,25 @@ void
 rtp_resizer_enqueue(struct rtp_resizer *this, struct rtp_packet **pkt,
   struct rtpp_proc_rstats *rsp)
 {
-    struct rtp_packet   *p;
+    struct rtp_packet   *p, **sp;
     uint32_t            ref_ts, internal_ts;
     int                 delta;
+    uint16_t            sdelta;
 
     p = *pkt;
-    if (rtp_packet_parse(p) != RTP_PARSER_OK)
+    if (rtp_packet_parse_samples(p) != RTP_PARSER_OK)
         return;
 
     if ((*pkt)->parsed->nsamples == RTP_NSAMPLES_UNKNOWN)
         return;
 
+    if (p->parsed->rtp_profile->ts_rate != this->ts_rate) {
+        /* Clock rate has been changed, TS is no longer comparable */
+        rtp_resizer_set_rate(this, p->parsed->rtp_profile->ts_rate);
+        this->last_sent_ts_inited = 0;
+        this->tsdelta_inited = 0;
+    }
+
     if (!this->ssrc.inited) {
         this->ssrc.val = p->parsed->ssrc;
         this->ssrc.inited = 1;
@@ -166,68 +206,131 @@ rtp_resizer_enqueue(struct rtp_resizer *this, struct rtp_packet **pkt,
         rsp->npkts_resizer_discard.cnt++;
         return;
     }
-    internal_ts = (*pkt)->rtime * 8000.0;
+    internal_ts = (uint64_t)((*pkt)->rtime * this->ts_rate);
     if (!this->tsdelta_inited) {
-        this->tsdelta = (*pkt)->parsed->ts - internal_ts + 40;
+        this->tsdelta = (*pkt)->parsed->ts - internal_ts + this->ts_rate / 200;
         this->tsdelta_inited = 1;
     }
     else {
         ref_ts = internal_ts + this->tsdelta;
         if (ts_less(ref_ts, (*pkt)->parsed->ts)) {
-            this->tsdelta = (*pkt)->parsed->ts - internal_ts + 40;
+            this->tsdelta = (*pkt)->parsed->ts - internal_ts + this->ts_rate / 200;
 /*            printf("Sync forward\n"); */
         }
-        else if (ts_less((*pkt)->parsed->ts + this->output_nsamples + 160, ref_ts)) 
+        else if (ts_less((*pkt)->parsed->ts + this->output_nsamples + this->ts_rate / 50, ref_ts)) 
         {
-            delta = (ref_ts - ((*pkt)->parsed->ts + this->output_nsamples + 160)) / 2;
+            delta = (ref_ts - ((*pkt)->parsed->ts + this->output_nsamples + this->ts_rate / 50)) / 2;
             this->tsdelta -= delta;
 /*            printf("Sync backward\n"); */
         }
     }
-    if (this->queue.last != NULL) 
-    {
-        p = this->queue.last; 
-        while (p != NULL && ts_less((*pkt)->parsed->ts, p->parsed->ts))
-             p = p->prev;
-
-        if (p == NULL) /* head reached */
-        {
-            (*pkt)->next = this->queue.first;
-            (*pkt)->prev = NULL;
-            this->queue.first->prev = *pkt;
-            this->queue.first = *pkt;
-        }
-        else if (p == this->queue.last) /* tail of the queue */
-        {
-            (*pkt)->prev = this->queue.last;
-            (*pkt)->next = NULL;
-            this->queue.last->next = *pkt;
-            this->queue.last = *pkt;
+    if (this->ring.npkts == 0) {
+        this->ring.head = p->parsed->seq;
+        this->ring.span = 0;
+    }
+    sdelta = p->parsed->seq - this->ring.head;
+    if (sdelta >= RTP_RESIZER_NSLOTS) {
+        /* Could be slightly behind the head, see if the ring can be extended */
+        sdelta = this->ring.head - p->parsed->seq;
+        if (sdelta + this->ring.span > RTP_RESIZER_NSLOTS) {
+            /*
+             * Discontinuity in SEQ, pass the packet as is, the ring will be
+             * re-based once the packets already queued are out.
+             */
+            return;
         }
-        else { /* middle of the queue */
-            (*pkt)->next = p->next;
-            (*pkt)->prev = p;
-            (*pkt)->next->prev = (*pkt)->prev->next = *pkt;
+        if (this->ring.first_off > 0) {
+            /*
+             * Part of the first packet has already gone out, so nothing
+             * can be put in front of it anymore.
+             */
+            rtp_packet_free(*pkt);
+            *pkt = NULL;
+            rsp->npkts_resizer_discard.cnt++;
+            return;
         }
+        this->ring.head = p->parsed->seq;
+        this->ring.span += sdelta;
+        sdelta = 0;
     }
-    else {
-        this->queue.first = this->queue.last = *pkt;
-        (*pkt)->prev = NULL;
-	(*pkt)->next = NULL;
+    sp = &this->ring.slots[RTP_RESIZER_SLOT(p->parsed->seq)];
+    if (*sp != NULL) {
+        /* Duplicate packet */
+        rtp_packet_free(*pkt);
+        *pkt = NULL;
+        rsp->npkts_resizer_discard.cnt++;
+        return;
     }
+    *sp = p;
+    this->ring.npkts++;
+    if (sdelta >= this->ring.span)
+        this->ring.span = sdelta + 1;
     this->nsamples_total += (*pkt)->parsed->nsamples;
     *pkt = NULL; /* take control over the packet */
 }
 
+static struct rtp_packet *
+ring_first(struct rtp_resizer *this)
+{
+    struct rtp_packet *p;
+    int i;
+
+    if (this->ring.npkts == 0)
+        return (NULL);
+    for (i = 0; i < this->ring.span; i++) {
+        p = this->ring.slots[RTP_RESIZER_SLOT((uint16_t)(this->ring.head + i))];
+        if (p != NULL)
+            return (p);
+    }
+    /* Not reached */
+    abort();
+}
+
 static void
-detach_queue_head(struct rtp_resizer *this)
+ring_detach(struct rtp_resizer *this, struct rtp_packet *p)
 {
+    uint16_t sdelta;
+
+    sdelta = p->parsed->seq - this->ring.head;
+    this->ring.head += sdelta + 1;
+    this->ring.span -= sdelta + 1;
+    this->ring.npkts--;
+    this->ring.first_off = 0;
+    this->ring.slots[RTP_RESIZER_SLOT(p->parsed->seq)] = NULL;
+}
 
-    this->queue.first = this->queue.first->next;
-    if (this->queue.first == NULL)
-	this->queue.last = NULL;
-    else
-	this->queue.first->prev = NULL;
+/*
+ * Account for a chunk taken off the first packet. The head is moved up to
+ * that packet, so that a late one cannot be slotted in front of it and
+ * inherit its consumed offset.
+ */
+static void
+ring_consume(struct rtp_resizer *this, struct rtp_packet *p, int nbytes)
+{
+    uint16_t sdelta;
+
+    sdelta = p->parsed->seq - this->ring.head;
+    this->ring.head += sdelta;
+    this->ring.span -= sdelta;
+    this->ring.first_off += nbytes;
+}
+
+/*
+ * Make the first packet suitable to be used as a container for the output,
+ * i.e. move whatever has been left of its payload right behind the header.
+ */
+static struct rtp_packet *
+ring_take_first(struct rtp_resizer *this, struct rtp_packet *p)
+{
+
+    if (this->ring.first_off > 0) {
+        p->parsed->data_offset -= this->ring.first_off;
+        memmove(&p->data.buf[p->parsed->data_offset],
+          &p->data.buf[p->parsed->data_offset + this->ring.first_off],
+          p->parsed->data_size);
+    }
+    ring_detach(this, p);
+    return (p);
 }
 
 static void
@@ -243,7 +346,8 @@ append_packet(struct rtp_packet *dst, struct rtp_packet *src)
 }
 
 static void 
-append_chunk(struct rtp_packet *dst, struct rtp_packet *src, const struct rtp_packet_chunk *chunk)
+append_chunk(struct rtp_resizer *this, struct rtp_packet *dst,
+  struct rtp_packet *src, const struct rtp_packet_chunk *chunk)
 {
 
     /* Copy chunk */
@@ -253,17 +357,18 @@ append_chunk(struct rtp_packet *dst, struct rtp_packet *src, const struct rtp_pa
     dst->parsed->data_size += chunk->bytes;
     dst->size += chunk->bytes;
 
-    /* Truncate the source packet */
+    /* Truncate the source packet, the payload is not moved */
     src->parsed->nsamples -= chunk->nsamples;
     rtp_packet_set_ts(src, src->parsed->ts + chunk->nsamples);
     src->parsed->data_size -= chunk->bytes;
+    src->parsed->data_offset += chunk->bytes;
     src->size -= chunk->bytes;
-    memmove(&src->data.buf[src->parsed->data_offset],
-      &src->data.buf[src->parsed->data_offset + chunk->bytes], src->parsed->data_size);
+    ring_consume(this, src, chunk->bytes);
 }
 
 static void 
-move_chunk(struct rtp_packet *dst, struct rtp_packet *src, const struct rtp_packet_chunk *chunk)
+move_chunk(struct rtp_resizer *this, struct rtp_packet *dst,
+  struct rtp_packet *src, const struct rtp_packet_chunk *chunk)
 {
     /* Copy chunk */
     memcpy(&dst->data.buf[dst->parsed->data_offset],
@@ -272,13 +377,13 @@ move_chunk(struct rtp_packet *dst, struct rtp_packet *src, const struct rtp_pack
     dst->parsed->data_size = chunk->bytes;
     dst->size = dst->parsed->data_size + dst->parsed->data_offset;
 
-    /* Truncate the source packet */
+    /* Truncate the source packet, the payload is not moved */
     src->parsed->nsamples -= chunk->nsamples;
     rtp_packet_set_ts(src, src->parsed->ts + chunk->nsamples);
     src->parsed->data_size -= chunk->bytes;
+    src->parsed->data_offset += chunk->bytes;
     src->size -= chunk->bytes;
-    memmove(&src->data.buf[src->parsed->data_offset],
-      &src->data.buf[src->parsed->data_offset + chunk->bytes], src->parsed->data_size);
+    ring_consume(this, src, chunk->bytes);
 }
 
 struct rtp_packet *
@@ -294,20 +399,21 @@ rtp_resizer_get(struct rtp_resizer *this, double dtime)
     int         min;
     struct      rtp_packet_chunk chunk;
 
-    if (this->queue.first == NULL)
+    p = ring_first(this);
+    if (p == NULL)
         return NULL;
 
-    ref_ts = (dtime * 8000.0) + this->tsdelta;
+    ref_ts = (uint64_t)(dtime * this->ts_rate) + this->tsdelta;
 
     /* Wait untill enough data has arrived or timeout occured */
     if (this->nsamples_total < this->output_nsamples &&
-        ts_less(ref_ts, this->queue.first->parsed->ts + this->max_buf_nsamples))
+        ts_less(ref_ts, p->parsed->ts + this->max_buf_nsamples))
     {
         return NULL;
     }
 
     output_nsamples = this->output_nsamples;
-    min = min_nsamples(this->queue.first->data.header.pt);
+    min = min_nsamples(p->data.header.pt, this->ts_rate);
     if (output_nsamples < min) {
         output_nsamples = min;
     } else if (output_nsamples % min != 0) {
@@ -315,23 +421,23 @@ rtp_resizer_get(struct rtp_resizer *this, double dtime)
     }
 
     /* Aggregate the output packet */
-    while ((ret == NULL || ret->parsed->nsamples < output_nsamples) && this->queue.first != NULL)
+    while ((ret == NULL || ret->parsed->nsamples < output_nsamples) &&
+      (p = ring_first(this)) != NULL)
     {
-        p = this->queue.first;
         if (ret == NULL) 
         {
             /* Look if the first packet is to be split */
             if (p->parsed->nsamples > output_nsamples) {
 		rtp_packet_first_chunk_find(p, &chunk, output_nsamples);
 		if (chunk.whole_packet_matched) {
-		    ret = p;
-		    detach_queue_head(this);
+		    ret = ring_take_first(this, p);
 		} else {
 		    ret = rtp_packet_alloc();
 		    if (ret == NULL)
 			break;
 		    rtp_packet_dup(ret, p, RTPP_DUP_HDRONLY);
-		    move_chunk(ret, p, &chunk);
+		    ret->parsed->data_offset -= this->ring.first_off;
+		    move_chunk(this, ret, p, &chunk);
 		    ++split;
 		}
 		if (!this->seq_initialized) {
@@ -361,7 +467,7 @@ rtp_resizer_get(struct rtp_resizer *this, double dtime)
 		    if ((ret->size + p->parsed->data_size) > sizeof(ret->data.buf))
 			break;
 		    append_packet(ret, p);
-		    detach_queue_head(this);
+		    ring_detach(this, p);
 		    rtp_packet_free(p);
 		}
 		else {
@@ -369,7 +475,7 @@ rtp_resizer_get(struct rtp_resizer *this, double dtime)
 		    if ((ret->size + chunk.bytes) > sizeof(ret->data.buf))
 			break;
 		    /* Append chunk to output */
-		    append_chunk(ret, p, &chunk);
+		    append_chunk(this, ret, p, &chunk);
 		    ++split;
 		}
 		++count;
@@ -384,14 +490,12 @@ rtp_resizer_get(struct rtp_resizer *this, double dtime)
         if (ret != NULL && (ret->size + p->parsed->data_size) > sizeof(ret->data.buf))
             break;
 
-        /* Detach head packet from the queue */
-	detach_queue_head(this);
-
         /*
-         * Add the packet to the output
+         * Add the packet to the output and detach it from the ring
          */
         if (ret == NULL) {
-            ret = p; /* use the first packet as the result container */
+            /* use the first packet as the result container */
+            ret = ring_take_first(this, p);
             if (!this->seq_initialized) {
                 this->seq = p->parsed->seq;
                 this->seq_initialized = 1;
@@ -399,6 +503,7 @@ rtp_resizer_get(struct rtp_resizer *this, double dtime)
         }
         else {
 	    append_packet(ret, p);
+            ring_detach(this, p);
             rtp_packet_free(p);
         }
 	/* Send non-appendable packet immediately */
@@ -412,7 +517,7 @@ rtp_resizer_get(struct rtp_resizer *this, double dtime)
 	this->last_sent_ts_inited = 1;
 	this->last_sent_ts = ret->parsed->ts + ret->parsed->nsamples;
 /*
-	printf("Payload %d, %d packets aggregated, %d splits done, final size %dms\n", ret->data.header.pt, count, split, ret->parsed->nsamples / 8);
+	printf("Payload %d, %d packets aggregated, %d splits done, final size %dms\n", ret->data.header.pt, count, split, ret->parsed->nsamples * 1000 / this->ts_rate);
 */
     }
     return ret;
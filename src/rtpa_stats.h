@@ -35,6 +35,8 @@ struct rtpa_stats {
     unsigned long aecount;
     struct rtpp_ssrc last_ssrc;
     int8_t last_pt;
+    /* Not every packet has been analyzed, see struct rtpa_policy */
+    int sampled;
 };
 
 struct rtpa_stats_jitter {
@@ -27,7 +27,10 @@
 
 #include <sys/types.h>
 #include <netinet/in.h>
+#include <errno.h>
+#include <limits.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -37,6 +40,7 @@
 #include "rtpp_refcnt.h"
 #include "rtpp_log_obj.h"
 #include "rtp.h"
+#include "rtp_info.h"
 #include "rtp_packet.h"
 #include "rtp_analyze.h"
 #include "rtpp_analyzer.h"
@@ -48,6 +52,14 @@ struct rtpp_analyzer_priv {
     uint32_t pecount;
     uint32_t aecount;
     struct rtpp_log *log;
+    const struct rtpa_policy *policy;
+    int active;
+    int restart;
+    unsigned long nskipped;
+    /* SSRC of the last packet, whether it has been analyzed or not */
+    struct rtpp_ssrc last_ssrc;
+    double wend;
+    double wnext;
 };
 
 static enum update_rtpp_stats_rval rtpp_analyzer_update(struct rtpp_analyzer *,
@@ -56,13 +68,64 @@ static void rtpp_analyzer_get_stats(struct rtpp_analyzer *,
   struct rtpa_stats *);
 static int rtpp_analyzer_get_jstats(struct rtpp_analyzer *,
   struct rtpa_stats_jitter *);
+static void rtpp_analyzer_activate(struct rtpp_analyzer *);
 static void rtpp_analyzer_dtor(struct rtpp_analyzer_priv *);
 
 #define PUB2PVT(pubp) \
   ((struct rtpp_analyzer_priv *)((char *)(pubp) - offsetof(struct rtpp_analyzer_priv, pub)))
 
+/*
+ * Parses the analysis policy specification, which is one of:
+ *
+ * all - analyze every packet of every stream (default);
+ * nth:N - analyze randomly picked one out of every N streams;
+ * window:X:P:W - analyze first X seconds of each stream, then last W
+ *   seconds out of every P seconds;
+ * ondemand - start analyzing the stream once Q command asks for any of
+ *   the rtpa_* counters.
+ */
+struct rtpa_policy *
+rtpa_policy_parse(const char *spec)
+{
+    struct rtpa_policy *rpp;
+    char tail, *ep;
+    long nth;
+
+    rpp = rtpp_zmalloc(sizeof(*rpp));
+    if (rpp == NULL) {
+        return (NULL);
+    }
+    if (strcmp(spec, "all") == 0) {
+        rpp->mode = RTPA_ALL;
+    } else if (strcmp(spec, "ondemand") == 0) {
+        rpp->mode = RTPA_ONDEMAND;
+    } else if (strncmp(spec, "nth:", 4) == 0) {
+        errno = 0;
+        nth = strtol(spec + 4, &ep, 10);
+        if (ep == spec + 4 || *ep != '\0' || errno != 0 || nth < 1 ||
+          nth > UINT_MAX) {
+            goto e0;
+        }
+        rpp->nth = nth;
+        rpp->mode = RTPA_NTH;
+    } else if (sscanf(spec, "window:%lf:%lf:%lf%c", &rpp->first,
+      &rpp->period, &rpp->window, &tail) == 3) {
+        if (rpp->first < 0.0 || rpp->period <= 0.0 || rpp->window < 0.0 ||
+          rpp->window > rpp->period) {
+            goto e0;
+        }
+        rpp->mode = RTPA_WINDOW;
+    } else {
+        goto e0;
+    }
+    return (rpp);
+e0:
+    free(rpp);
+    return (NULL);
+}
+
 struct rtpp_analyzer *
-rtpp_analyzer_ctor(struct rtpp_log *log)
+rtpp_analyzer_ctor(struct rtpp_log *log, struct rtpa_policy *policy)
 {
     struct rtpp_analyzer_priv *pvt;
     struct rtpp_analyzer *rap;
@@ -78,9 +141,33 @@ rtpp_analyzer_ctor(struct rtpp_log *log)
         goto e0;
     }
     pvt->log = log;
+    pvt->policy = policy;
+    if (policy == NULL) {
+        pvt->active = 1;
+    } else {
+        switch (policy->mode) {
+        case RTPA_ALL:
+            pvt->active = 1;
+            break;
+
+        case RTPA_NTH:
+            pvt->active = (random() % policy->nth) == 0;
+            break;
+
+        case RTPA_WINDOW:
+            /* Decided when the first packet arrives */
+            pvt->active = 1;
+            break;
+
+        case RTPA_ONDEMAND:
+            pvt->active = 0;
+            break;
+        }
+    }
     rap->update = &rtpp_analyzer_update;
     rap->get_stats = &rtpp_analyzer_get_stats;
     rap->get_jstats = &rtpp_analyzer_get_jstats;
+    rap->activate = &rtpp_analyzer_activate;
     CALL_SMETHOD(log->rcnt, incref);
     CALL_SMETHOD(pvt->pub.rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_analyzer_dtor,
       pvt);
@@ -91,23 +178,74 @@ e0:
     return (NULL);
 }
 
+static int
+rtpp_analyzer_inwindow(struct rtpp_analyzer_priv *pvt, double rtime)
+{
+    const struct rtpa_policy *rpp;
+
+    rpp = pvt->policy;
+    if (pvt->wnext == 0.0) {
+        pvt->wend = rtime + rpp->first;
+        pvt->wnext = pvt->wend + rpp->period - rpp->window;
+    }
+    while (rtime >= pvt->wnext) {
+        pvt->wend = pvt->wnext + rpp->window;
+        pvt->wnext += rpp->period;
+    }
+    return (rtime < pvt->wend);
+}
+
 static enum update_rtpp_stats_rval
 rtpp_analyzer_update(struct rtpp_analyzer *rap, struct rtp_packet *pkt)
 {
     struct rtpp_analyzer_priv *pvt;
     enum update_rtpp_stats_rval rval;
+    int ssrc_chg;
 
     pvt = PUB2PVT(rap);
     if (rtp_packet_parse(pkt) != RTP_PARSER_OK) {
         pvt->pecount++;
         return (UPDATE_ERR);
     }
+    /*
+     * SSRC changes are reported to the caller regardless of the policy,
+     * since the stream latching depends on it.
+     */
+    ssrc_chg = (pvt->last_ssrc.inited && pvt->last_ssrc.val != pkt->parsed->ssrc);
+    pvt->last_ssrc.val = pkt->parsed->ssrc;
+    pvt->last_ssrc.inited = 1;
+    pvt->rstat.last.pt = pkt->data.header.pt;
+    if (pvt->policy != NULL && pvt->policy->mode == RTPA_WINDOW) {
+        __atomic_store_n(&pvt->active, rtpp_analyzer_inwindow(pvt,
+          pkt->rtime), __ATOMIC_RELAXED);
+    }
+    /* Can be flipped by the command thread, see rtpp_analyzer_activate() */
+    if (!__atomic_load_n(&pvt->active, __ATOMIC_RELAXED)) {
+        pvt->nskipped++;
+        pvt->restart = 1;
+        return (ssrc_chg ? UPDATE_SSRC_CHG : UPDATE_OK);
+    }
+    if (pvt->restart) {
+        rtpp_stats_restart(&pvt->rstat);
+        pvt->restart = 0;
+    }
     rval = update_rtpp_stats(pvt->log, &(pvt->rstat), &(pkt->data.header), pkt->parsed, pkt->rtime);
     if (rval == UPDATE_ERR) {
         pvt->aecount++;
+        return (rval);
+    }
+    return (ssrc_chg ? UPDATE_SSRC_CHG : UPDATE_OK);
+}
+
+static void
+rtpp_analyzer_activate(struct rtpp_analyzer *rap)
+{
+    struct rtpp_analyzer_priv *pvt;
+
+    pvt = PUB2PVT(rap);
+    if (pvt->policy != NULL && pvt->policy->mode == RTPA_ONDEMAND) {
+        __atomic_store_n(&pvt->active, 1, __ATOMIC_RELAXED);
     }
-    pvt->rstat.last.pt = pkt->data.header.pt;
-    return (rval);
 }
 
 static void
@@ -125,6 +263,7 @@ rtpp_analyzer_get_stats(struct rtpp_analyzer *rap, struct rtpa_stats *rsp)
     rsp->precvd = ostat.precvd;
     rsp->pdups = ostat.duplicates;
     rsp->ssrc_changes = pvt->rstat.ssrc_changes;
+    rsp->sampled = (pvt->nskipped > 0);
     rsp->last_ssrc = pvt->rstat.last.ssrc;
     rsp->plost = ostat.psent - ostat.precvd;
     if (pvt->rstat.last.pt != PT_UNKN) {
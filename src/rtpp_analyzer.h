@@ -37,20 +37,39 @@ struct rtpa_stats_jitter;
 struct rtpp_log;
 struct rtp_packet;
 
+/*
+ * Analysis policy, controls which streams and which parts of each stream
+ * are fed into the analyzer. Stats collected under anything but the
+ * RTPA_ALL are marked as sampled.
+ */
+enum rtpa_pmode {RTPA_ALL = 0, RTPA_NTH, RTPA_WINDOW, RTPA_ONDEMAND};
+
+struct rtpa_policy {
+    enum rtpa_pmode mode;
+    unsigned int nth;		/* RTPA_NTH: analyze random one in nth streams */
+    double first;		/* RTPA_WINDOW: analyze first seconds, */
+    double period;		/* then last window seconds of every */
+    double window;		/* period */
+};
+
 DEFINE_METHOD(rtpp_analyzer, rtpp_analyzer_update, enum update_rtpp_stats_rval,
   struct rtp_packet *);
 DEFINE_METHOD(rtpp_analyzer, rtpp_analyzer_get_stats, void,
   struct rtpa_stats *);
 DEFINE_METHOD(rtpp_analyzer, rtpp_analyzer_get_jstats, int,
   struct rtpa_stats_jitter *);
+DEFINE_METHOD(rtpp_analyzer, rtpp_analyzer_activate, void);
 
 struct rtpp_analyzer {
     METHOD_ENTRY(rtpp_analyzer_update, update);
     METHOD_ENTRY(rtpp_analyzer_get_stats, get_stats);
     METHOD_ENTRY(rtpp_analyzer_get_jstats, get_jstats);
+    METHOD_ENTRY(rtpp_analyzer_activate, activate);
     struct rtpp_refcnt *rcnt;
 };
 
-struct rtpp_analyzer * rtpp_analyzer_ctor(struct rtpp_log *);
+struct rtpp_analyzer * rtpp_analyzer_ctor(struct rtpp_log *,
+  struct rtpa_policy *);
+struct rtpa_policy *rtpa_policy_parse(const char *);
 
 #endif
@@ -45,6 +45,10 @@ struct rtpp_timed;
 struct rtpp_sessinfo;
 struct rtpp_log;
 struct rtpp_module_if;
+struct rtpa_policy;
+struct rtpp_pcache;
+struct rtpp_proc_servers;
+struct rtpp_ticker;
 
 #define RTPP_PT_INET	0
 #define	RTPP_PT_INET6	1
@@ -53,6 +57,8 @@ struct rtpp_module_if;
 #define	RTPP_PT_SELECT(cp, af) (((af) == AF_INET) ? \
   (cp)->port_table[RTPP_PT_INET] : (cp)->port_table[RTPP_PT_INET6])
 
+#define	RTPP_MODULES_MAX	8
+
 struct rtpp_cfg_stable {
     const char *pid_file;
 
@@ -109,15 +115,27 @@ struct rtpp_cfg_stable {
     int sched_policy;
     int sched_hz;
     double target_pfreq;
+    int tickless;                   /* Main loop sleeps to absolute deadlines, idles */
+    int busy_poll;                  /* Spin for that many usec between ticks */
+    int busy_poll_cpu;              /* Core to pin the spinning thread to */
+    int rlat_sample;                /* Measure relay latency of every Nth packet */
     struct rtpp_cmd_async *rtpp_cmd_cf;
     struct rtpp_proc_async *rtpp_proc_cf;
     struct rtpp_anetio_cf *rtpp_netio_cf;
     struct rtpp_tnotify_set *rtpp_tnset_cf;
     struct rtpp_notify *rtpp_notify_cf;
+    struct rtpp_record_writer *rtpp_recwr_cf;
+    int record_io_sync;
+    int record_io_mmap;
+    struct rtpp_socket *rrec_agg_sock;
     int slowshutdown;
     int fastshutdown;
 
     struct rtpp_stats *rtpp_stats;
+    struct rtpa_policy *rtpa_policy;
+    struct rtpp_pcache *pcache;
+    struct rtpp_proc_servers *proc_servers;
+    struct rtpp_ticker *ticker;
 
     struct rtpp_list *ctrl_socks;
 
@@ -127,7 +145,13 @@ struct rtpp_cfg_stable {
 
     const char *cwd_orig;
 
-    char *mpath;
+    size_t rcache_mem;
+
+    int sockpool_depth;
+    struct rtpp_sockpool *rtpp_sockpool_cf;
+
+    char *mpath[RTPP_MODULES_MAX];
+    int nmodules;
     struct rtpp_module_if *modules_cf;
 };
 
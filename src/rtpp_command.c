@@ -65,9 +65,11 @@
 #include "rtpp_tnotify_set.h"
 #include "rtpp_pipe.h"
 #include "rtpp_port_table.h"
+#include "rtpp_proc_servers.h"
 #include "rtpp_stream.h"
 #include "rtpp_session.h"
 #include "rtpp_socket.h"
+#include "rtpp_sockpool.h"
 #include "rtpp_util.h"
 #include "rtpp_stats.h"
 #include "rtpp_weakref.h"
@@ -92,6 +94,9 @@ struct proto_cap proto_caps[] = {
     { "20150330", "Support for allocating a new port (\"Un\"/\"Ln\" commands)" },
     { "20150420", "Support for SEQ tracking and new rtpa_ counters; Q command extended" },
     { "20150617", "Support for the wildcard %%CC_SELF%% as a disconnect notify target" },
+    { "20161101", "Support for pipelining multiple cookie-tagged commands in a single datagram" },
+    { "20161102", "Support for the binary length-prefixed control protocol" },
+    { "20161103", "Support for the QB (bulk query) command" },
     { NULL, NULL }
 };
 
@@ -103,6 +108,7 @@ struct rtpp_command_priv {
     int umode;
     char buf_r[256];
     struct rtpp_cmd_rcache *rcache_obj;
+    struct rtpc_reply *reply;
 };
 
 #define PUB2PVT(pubp) \
@@ -111,6 +117,8 @@ struct rtpp_command_priv {
 struct d_opts;
 
 static int create_twinlistener(uint16_t, void *);
+static struct rtpp_command *rtpc_parse_cmd(struct cfg *, struct rtpp_command *,
+  int, int *, struct rtpp_cmd_rcache *);
 static void handle_info(struct cfg *, struct rtpp_command *,
   const char *);
 static void handle_ver_feature(struct cfg *cf, struct rtpp_command *cmd);
@@ -161,6 +169,10 @@ create_twinlistener(uint16_t port, void *ap)
 	    RTPP_ELOG(ctap->cfs->glog, RTPP_LOG_ERR, "unable to set 256K receive buffer size");
         CALL_METHOD(ctap->fds[i], setnonblock);
         CALL_METHOD(ctap->fds[i], settimestamp);
+	if (ctap->cfs->busy_poll > 0 &&
+	  CALL_METHOD(ctap->fds[i], setbusypoll, ctap->cfs->busy_poll) == -1)
+	    RTPP_ELOG(ctap->cfs->glog, RTPP_LOG_ERR, "unable to set busy poll to %d usec",
+	      ctap->cfs->busy_poll);
     }
     *ctap->port = port - 2;
     return RTPP_PTU_OK;
@@ -175,7 +187,7 @@ failure:
 }
 
 int
-rtpp_create_listener(struct cfg *cf, struct sockaddr *ia, int *port,
+rtpp_create_listener_sync(struct cfg *cf, struct sockaddr *ia, int *port,
   struct rtpp_socket **fds)
 {
     struct create_twinlistener_args cta;
@@ -196,8 +208,93 @@ rtpp_create_listener(struct cfg *cf, struct sockaddr *ia, int *port,
       &cta));
 }
 
+int
+rtpp_create_listener(struct cfg *cf, struct sockaddr *ia, int *port,
+  struct rtpp_socket **fds)
+{
+
+    if (cf->stable->rtpp_sockpool_cf != NULL &&
+      CALL_METHOD(cf->stable->rtpp_sockpool_cf, get, ia, port, fds) == 0)
+        return (0);
+    return (rtpp_create_listener_sync(cf, ia, port, fds));
+}
+
 void
-rtpc_doreply(struct rtpp_command *cmd, char *buf, int len, int errd)
+rtpc_reply_init(struct rtpc_reply *rrp, int fd, int umode,
+  const struct sockaddr *raddr, socklen_t rlen)
+{
+
+    rrp->fd = fd;
+    rrp->umode = umode;
+    rrp->rlen = rlen;
+    if (rlen > 0) {
+        memcpy(&rrp->raddr, raddr, rlen);
+    }
+    rrp->len = 0;
+}
+
+static void
+rtpc_reply_write(struct rtpc_reply *rrp, struct rtpp_cfg_stable *cfs,
+  const char *buf, int len)
+{
+
+    if (rrp->umode == 0) {
+        write(rrp->fd, buf, len);
+    } else {
+        rtpp_anetio_sendto(cfs->rtpp_netio_cf, rrp->fd, buf, len, 0,
+          sstosa(&rrp->raddr), rrp->rlen);
+    }
+}
+
+void
+rtpc_reply_flush(struct rtpc_reply *rrp, struct rtpp_cfg_stable *cfs)
+{
+
+    if (rrp->len == 0)
+        return;
+    rtpc_reply_write(rrp, cfs, rrp->buf, rrp->len);
+    rrp->len = 0;
+}
+
+static void
+rtpc_reply_append(struct rtpc_reply *rrp, struct rtpp_cfg_stable *cfs,
+  const char *buf, int len)
+{
+
+    if (rrp->len + len > sizeof(rrp->buf)) {
+        /*
+         * Does not fit, push out what we have so far. Each reply line
+         * carries its own cookie, so the client does not care if a batch
+         * reply spans several datagrams.
+         */
+        rtpc_reply_flush(rrp, cfs);
+        if (len > sizeof(rrp->buf)) {
+            rtpc_reply_write(rrp, cfs, buf, len);
+            return;
+        }
+    }
+    memcpy(rrp->buf + rrp->len, buf, len);
+    rrp->len += len;
+}
+
+static void
+rtpc_reply_send(struct rtpp_command_priv *pvt, const char *buf, int len)
+{
+
+    if (pvt->reply != NULL) {
+        rtpc_reply_append(pvt->reply, pvt->cfs, buf, len);
+        return;
+    }
+    if (pvt->umode == 0) {
+	write(pvt->controlfd, buf, len);
+    } else {
+        rtpp_anetio_sendto(pvt->cfs->rtpp_netio_cf, pvt->controlfd, buf, len, 0,
+          sstosa(&pvt->pub.raddr), pvt->pub.rlen);
+    }
+}
+
+static void
+rtpc_doreply_send(struct rtpp_command *cmd, char *buf, int len)
 {
     struct rtpp_command_priv *pvt;
 
@@ -210,18 +307,43 @@ rtpc_doreply(struct rtpp_command *cmd, char *buf, int len, int errd)
     } else {
         RTPP_LOG(pvt->cfs->glog, RTPP_LOG_DBUG, "sending reply \"%s\"", buf);
     }
-    if (pvt->umode == 0) {
-	write(pvt->controlfd, buf, len);
-    } else {
-        if (pvt->cookie != NULL) {
-            len = snprintf(pvt->buf_r, sizeof(pvt->buf_r), "%s %s", pvt->cookie,
-              buf);
-            buf = pvt->buf_r;
-            CALL_METHOD(pvt->rcache_obj, insert, pvt->cookie, pvt->buf_r, cmd->dtime);
+    if (pvt->umode != 0 && pvt->cookie != NULL) {
+        len = snprintf(pvt->buf_r, sizeof(pvt->buf_r), "%s %s", pvt->cookie,
+          buf);
+        if (len >= sizeof(pvt->buf_r)) {
+            len = sizeof(pvt->buf_r) - 1;
         }
-        rtpp_anetio_sendto(pvt->cfs->rtpp_netio_cf, pvt->controlfd, buf, len, 0,
-          sstosa(&cmd->raddr), cmd->rlen);
+        buf = pvt->buf_r;
+        CALL_METHOD(pvt->rcache_obj, insert, pvt->cookie, pvt->buf_r, cmd->dtime);
+    }
+    if (cmd->bmode != 0) {
+        uint32_t hdr;
+
+        /* Binary protocol: 32-bit length prefix, no line terminator */
+        if (len > 0 && buf[len - 1] == '\n')
+            len--;
+        hdr = htonl(len);
+        rtpc_reply_send(pvt, (char *)&hdr, sizeof(hdr));
     }
+    rtpc_reply_send(pvt, buf, len);
+}
+
+/*
+ * Send one part of a multi-line reply. Only the final part, sent with
+ * the rtpc_doreply(), accounts for the command in the stats.
+ */
+void
+rtpc_doreply_part(struct rtpp_command *cmd, char *buf, int len)
+{
+
+    rtpc_doreply_send(cmd, buf, len);
+}
+
+void
+rtpc_doreply(struct rtpp_command *cmd, char *buf, int len, int errd)
+{
+
+    rtpc_doreply_send(cmd, buf, len);
     cmd->csp->ncmds_repld.cnt++;
     if (errd == 0) {
         cmd->csp->ncmds_succd.cnt++;
@@ -273,7 +395,7 @@ free_command(struct rtpp_command *cmd)
 
 struct rtpp_command *
 rtpp_command_ctor(struct cfg *cf, int controlfd, double dtime, int *rval,
- struct rtpp_command_stats *csp, int umode)
+ struct rtpp_command_stats *csp, int umode, struct rtpc_reply *rrp)
 {
     struct rtpp_command_priv *pvt;
     struct rtpp_command *cmd;
@@ -289,6 +411,7 @@ rtpp_command_ctor(struct cfg *cf, int controlfd, double dtime, int *rval,
     cmd->dtime = dtime;
     cmd->csp = csp;
     pvt->umode = umode;
+    pvt->reply = rrp;
     return (cmd);
 }
 
@@ -297,17 +420,13 @@ get_command(struct cfg *cf, int controlfd, int *rval, double dtime,
   struct rtpp_command_stats *csp, int umode,
   struct rtpp_cmd_rcache *rcache_obj)
 {
-    char **ap;
-    char *cp;
-    int len, i;
+    int len;
     struct rtpp_command *cmd;
-    struct rtpp_command_priv *pvt;
 
-    cmd = rtpp_command_ctor(cf, controlfd, dtime, rval, csp, umode);
+    cmd = rtpp_command_ctor(cf, controlfd, dtime, rval, csp, umode, NULL);
     if (cmd == NULL) {
         return (NULL);
     }
-    pvt = PUB2PVT(cmd);
     if (umode == 0) {
         for (;;) {
             len = read(controlfd, cmd->buf, sizeof(cmd->buf) - 1);
@@ -326,6 +445,47 @@ get_command(struct cfg *cf, int controlfd, int *rval, double dtime,
         *rval = -1;
         return (NULL);
     }
+    return (rtpc_parse_cmd(cf, cmd, len, rval, rcache_obj));
+}
+
+/*
+ * Construct command out of a single line of a (possibly pipelined)
+ * datagram that has already been received by the caller. Replies are
+ * accumulated in the rrp, it's the responsibility of the caller to
+ * flush it once all commands in the datagram have been handled.
+ */
+struct rtpp_command *
+rtpp_command_dgram_get(struct cfg *cf, int controlfd, const char *buf,
+  int len, const struct sockaddr *raddr, socklen_t rlen, int *rval,
+  double dtime, struct rtpp_command_stats *csp,
+  struct rtpp_cmd_rcache *rcache_obj, struct rtpc_reply *rrp)
+{
+    struct rtpp_command *cmd;
+
+    cmd = rtpp_command_ctor(cf, controlfd, dtime, rval, csp, 1, rrp);
+    if (cmd == NULL) {
+        return (NULL);
+    }
+    if (len > sizeof(cmd->buf) - 1) {
+        len = sizeof(cmd->buf) - 1;
+    }
+    memcpy(cmd->buf, buf, len);
+    cmd->rlen = rlen;
+    memcpy(&cmd->raddr, raddr, rlen);
+    return (rtpc_parse_cmd(cf, cmd, len, rval, rcache_obj));
+}
+
+static struct rtpp_command *
+rtpc_parse_cmd(struct cfg *cf, struct rtpp_command *cmd, int len, int *rval,
+  struct rtpp_cmd_rcache *rcache_obj)
+{
+    char **ap;
+    char *cp;
+    int i, umode;
+    struct rtpp_command_priv *pvt;
+
+    pvt = PUB2PVT(cmd);
+    umode = pvt->umode;
     cmd->buf[len] = '\0';
 
     if (len > 0 && cmd->buf[len - 1] == '\n') {
@@ -335,7 +495,7 @@ get_command(struct cfg *cf, int controlfd, int *rval, double dtime,
         RTPP_LOG(cf->stable->glog, RTPP_LOG_DBUG, "received command \"%s\"",
           cmd->buf);
     }
-    csp->ncmds_rcvd.cnt++;
+    cmd->csp->ncmds_rcvd.cnt++;
 
     cp = cmd->buf;
     for (ap = cmd->argv; (*ap = rtpp_strsep(&cp, "\r\n\t ")) != NULL;) {
@@ -356,12 +516,12 @@ get_command(struct cfg *cf, int controlfd, int *rval, double dtime,
     /* Stream communication mode doesn't use cookie */
     if (umode != 0) {
         pvt->cookie = cmd->argv[0];
-        if (CALL_METHOD(rcache_obj, lookup, pvt->cookie, pvt->buf_r, sizeof(pvt->buf_r)) == 1) {
-            len = strlen(pvt->buf_r);
-            rtpp_anetio_sendto(cf->stable->rtpp_netio_cf, controlfd, pvt->buf_r, len, 0,
-              sstosa(&cmd->raddr), cmd->rlen);
-            csp->ncmds_rcvd.cnt--;
-            csp->ncmds_rcvd_ndups.cnt++;
+        len = CALL_METHOD(rcache_obj, lookup, pvt->cookie, pvt->buf_r,
+          sizeof(pvt->buf_r), cmd->dtime);
+        if (len >= 0) {
+            rtpc_reply_send(pvt, pvt->buf_r, len);
+            cmd->csp->ncmds_rcvd.cnt--;
+            cmd->csp->ncmds_rcvd_ndups.cnt++;
             *rval = 0;
             free_command(cmd);
             return (NULL);
@@ -508,6 +668,11 @@ handle_command(struct cfg *cf, struct rtpp_command *cmd)
                 verbose = 1;
                 break;
 
+            case 'h':
+            case 'H':
+                verbose = -1;
+                break;
+
             default:
                 RTPP_LOG(cf->stable->glog, RTPP_LOG_ERR,
                   "STATS: unknown command modifier `%c'", *cp);
@@ -515,7 +680,32 @@ handle_command(struct cfg *cf, struct rtpp_command *cmd)
                 return 0;
             }
         }
-        i = handle_get_stats(cf, cmd, verbose);
+        if (verbose < 0) {
+            /* Gh: dump relay latency histogram, for debugging */
+            if (PUB2PVT(cmd)->umode != 0 || cmd->argc > 1) {
+                RTPP_LOG(cf->stable->glog, RTPP_LOG_ERR, "STATS: histogram "
+                  "dump takes no arguments and needs a stream control socket");
+                reply_error(cmd, ECODE_INVLARG_8);
+                return 0;
+            }
+            i = handle_get_rlat_hist(cf, cmd);
+        } else {
+            i = handle_get_stats(cf, cmd, verbose);
+        }
+        if (i != 0) {
+            reply_error(cmd, i);
+        }
+        return 0;
+
+    case QUERY_BULK:
+        if (PUB2PVT(cmd)->umode != 0) {
+            /* Output can be arbitrarily large, stream sockets only */
+            RTPP_LOG(cf->stable->glog, RTPP_LOG_ERR, "QUERY_BULK: not "
+              "supported over datagram control sockets");
+            reply_error(cmd, ECODE_INVLARG_7);
+            return 0;
+        }
+        i = handle_query_bulk(cf, cmd);
         if (i != 0) {
             reply_error(cmd, i);
         }
@@ -590,11 +780,17 @@ handle_command(struct cfg *cf, struct rtpp_command *cmd)
 	    ptime = spa->rtp->stream[i]->ptime;
 	}
 	if (playcount != 0 && CALL_SMETHOD(spa->rtp->stream[i], handle_play, codecs,
-          pname, playcount, cmd, ptime) != 0) {
+          pname, playcount, cmd, ptime, cf->stable->pcache) != 0) {
 	    reply_error(cmd, ECODE_PLRFAIL);
 	    return 0;
 	}
 	rtps = CALL_SMETHOD(spa->rtp->stream[i], get_rtps);
+	if (rtps != RTPP_UID_NONE &&
+	  CALL_METHOD(cf->stable->proc_servers, reg, rtps) != 0) {
+	    CALL_SMETHOD(spa->rtp->stream[i], handle_noplay);
+	    reply_error(cmd, ECODE_PLRFAIL);
+	    return 0;
+	}
 	CALL_SMETHOD(spa->rtcp->stream[i], replace_rtps, rtps_old, rtps);
 	reply_ok(cmd);
 	break;
@@ -38,9 +38,11 @@ struct rtpp_command;
 struct rtpp_command_stats;
 struct cfg;
 struct cfg_stable;
+struct rtpp_cfg_stable;
 struct sockaddr;
 struct rtpp_cmd_rcache;
 struct rtpp_socket;
+struct rtpc_reply;
 
 extern struct proto_cap proto_caps[];
 
@@ -53,9 +55,18 @@ void reply_port(struct rtpp_command *cmd, int lport,
   struct sockaddr **lia);
 int rtpp_create_listener(struct cfg *, struct sockaddr *, int *,
   struct rtpp_socket **);
+int rtpp_create_listener_sync(struct cfg *, struct sockaddr *, int *,
+  struct rtpp_socket **);
 struct rtpp_command *rtpp_command_ctor(struct cfg *, int, double, int *,
-  struct rtpp_command_stats *, int);
+  struct rtpp_command_stats *, int, struct rtpc_reply *);
+struct rtpp_command *rtpp_command_dgram_get(struct cfg *, int, const char *,
+  int, const struct sockaddr *, socklen_t, int *, double,
+  struct rtpp_command_stats *, struct rtpp_cmd_rcache *, struct rtpc_reply *);
 
 void rtpc_doreply(struct rtpp_command *, char *, int, int);
+void rtpc_doreply_part(struct rtpp_command *, char *, int);
+void rtpc_reply_init(struct rtpc_reply *, int, int, const struct sockaddr *,
+  socklen_t);
+void rtpc_reply_flush(struct rtpc_reply *, struct rtpp_cfg_stable *);
 
 #endif
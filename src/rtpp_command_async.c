@@ -25,11 +25,18 @@
  *
  */
 
+#if defined(LINUX_XXX) && !defined(_GNU_SOURCE)
+/* recvmmsg(2) */
+#define _GNU_SOURCE
+#endif
+
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <poll.h>
 #include <pthread.h>
 #include <stddef.h>
@@ -58,14 +65,47 @@
 #include "rtpp_list.h"
 #include "rtpp_controlfd.h"
 #include "rtpp_time.h"
+#include "rtpp_ticker.h"
 
 #define RTPC_MAX_CONNECTIONS 100
+#define RTPC_IDLE_POLL       100   /* ms, tickless mode only */
+
+#if defined(MSG_WAITFORONE)
+#define RTPC_HAVE_MMSG 1
+#define RTPC_MAX_MMSG  32
+#endif
+
+/*
+ * Datagrams received in one go from the UDP control socket(s), together
+ * with the reply accumulator used to coalesce replies to pipelined
+ * commands.
+ */
+struct rtpp_cmd_dgbatch {
+#if defined(RTPC_HAVE_MMSG)
+    struct mmsghdr mmsgs[RTPC_MAX_MMSG];
+    struct iovec iovs[RTPC_MAX_MMSG];
+    struct sockaddr_storage raddrs[RTPC_MAX_MMSG];
+    char bufs[RTPC_MAX_MMSG][1024 * 8];
+#else
+    struct sockaddr_storage raddrs[1];
+    char bufs[1][1024 * 8];
+#endif
+    struct rtpc_reply reply;
+};
 
 struct rtpp_cmd_pollset {
     struct pollfd *pfds;
     int pfds_used;
     struct rtpp_cmd_connection *rccs[RTPC_MAX_CONNECTIONS];
     pthread_mutex_t pfds_mutex;
+    /*
+     * Copy of the pfds that the command thread polls on without holding
+     * the pfds_mutex, plus one extra slot for the read end of the wakeup
+     * pipe, which is used to get it out of poll() when new connection
+     * has been added or when it is time to exit.
+     */
+    struct pollfd ppfds[RTPC_MAX_CONNECTIONS + 1];
+    int wakefd[2];
 };
 
 struct rtpp_cmd_accptset {
@@ -93,6 +133,7 @@ struct rtpp_cmd_async_cf {
     struct rtpp_cmd_accptset aset;
     struct cfg *cf_save;
     struct rtpp_cmd_rcache *rcache;
+    struct rtpp_cmd_dgbatch dgbatch;
 };
 
 #define PUB2PVT(pubp)	((struct rtpp_cmd_async_cf *)((char *)(pubp) - offsetof(struct rtpp_cmd_async_cf, pub)))
@@ -103,6 +144,7 @@ struct rtpp_cmd_async_cf {
 static double rtpp_command_async_get_aload(struct rtpp_cmd_async *);
 static int rtpp_command_async_wakeup(struct rtpp_cmd_async *);
 static void rtpp_command_async_dtor(struct rtpp_cmd_async *);
+static void rtpp_cmd_pollset_wakeup(struct rtpp_cmd_pollset *);
 
 static void
 init_cstats(struct rtpp_stats *sobj, struct rtpp_command_stats *csp)
@@ -164,50 +206,130 @@ accept_connection(struct cfg *cf, struct rtpp_ctrl_sock *rcsp, struct sockaddr *
     return (controlfd);
 }
 
+static int
+rtpp_cmd_dispatch(struct cfg *cf, struct rtpp_command *cmd, struct sockaddr *laddr,
+  struct rtpp_command_stats *csp, struct rtpp_stats *rsc)
+{
+    int rval;
+
+    cmd->laddr = laddr;
+    if (cmd->cca.op == GET_STATS || cmd->cca.op == INFO) {
+        flush_cstats(rsc, csp);
+    }
+    if (cmd->no_glock == 0) {
+        pthread_mutex_lock(&cf->glock);
+    }
+    rval = handle_command(cf, cmd);
+    if (cmd->no_glock == 0) {
+        pthread_mutex_unlock(&cf->glock);
+    }
+    free_command(cmd);
+    return (rval);
+}
+
 static int
 process_commands(struct rtpp_ctrl_sock *csock, struct cfg *cf, int controlfd, double dtime,
   struct rtpp_command_stats *csp, struct rtpp_stats *rsc,
   struct rtpp_cmd_rcache *rcp)
 {
-    int i, rval;
+    int rval;
     struct rtpp_command *cmd;
-    int umode;
 
-    umode = RTPP_CTRL_ISDG(csock);
-    i = 0;
-    do {
-        cmd = get_command(cf, controlfd, &rval, dtime, csp, umode, rcp);
-        if (cmd == NULL && rval == 0) {
-            /*
-             * get_command() failed with error other than I/O error
-             * or something, there might be some good commands in
-             * the queue.
-             */
+    cmd = get_command(cf, controlfd, &rval, dtime, csp, 0, rcp);
+    if (cmd == NULL) {
+        /*
+         * rval == 0 means get_command() failed with error other than
+         * I/O error, so the connection is still usable.
+         */
+        return ((rval == 0) ? 0 : -1);
+    }
+    return (rtpp_cmd_dispatch(cf, cmd, sstosa(&csock->bindaddr), csp, rsc));
+}
+
+/*
+ * Handle single datagram received from the UDP control socket. The
+ * datagram may contain several newline-separated cookie-tagged commands,
+ * replies to those are coalesced into a single reply datagram.
+ */
+static void
+process_dgram(struct rtpp_ctrl_sock *csock, struct cfg *cf, int controlfd,
+  char *buf, int len, const struct sockaddr *raddr, socklen_t rlen,
+  double dtime, struct rtpp_command_stats *csp, struct rtpp_stats *rsc,
+  struct rtpp_cmd_rcache *rcp, struct rtpc_reply *rrp)
+{
+    char *cp, *ep, *lp;
+    int llen, rval;
+    struct rtpp_command *cmd;
+
+    rtpc_reply_init(rrp, controlfd, 1, raddr, rlen);
+    for (cp = buf, ep = buf + len; cp < ep; cp += llen + 1) {
+        lp = memchr(cp, '\n', ep - cp);
+        llen = ((lp != NULL) ? lp : ep) - cp;
+        if (llen == 0 || strspn(cp, "\r\t ") >= llen) {
             continue;
         }
-        if (cmd != NULL) {
-            cmd->laddr = sstosa(&csock->bindaddr);
-            if (cmd->cca.op == GET_STATS || cmd->cca.op == INFO) {
-                flush_cstats(rsc, csp);
-            }
-            if (cmd->no_glock == 0) {
-                pthread_mutex_lock(&cf->glock);
-            }
-            i = handle_command(cf, cmd);
-            if (cmd->no_glock == 0) {
-                pthread_mutex_unlock(&cf->glock);
-            }
-            free_command(cmd);
-        } else {
-            i = -1;
+        cmd = rtpp_command_dgram_get(cf, controlfd, cp, llen, raddr, rlen,
+          &rval, dtime, csp, rcp, rrp);
+        if (cmd == NULL) {
+            continue;
+        }
+        rtpp_cmd_dispatch(cf, cmd, sstosa(&csock->bindaddr), csp, rsc);
+    }
+    rtpc_reply_flush(rrp, cf->stable);
+}
+
+static int
+process_commands_dgram(struct rtpp_ctrl_sock *csock, struct cfg *cf, int controlfd,
+  double dtime, struct rtpp_command_stats *csp, struct rtpp_stats *rsc,
+  struct rtpp_cmd_rcache *rcp, struct rtpp_cmd_dgbatch *dgbp)
+{
+    int i, nrecv, len;
+    socklen_t rlen;
+
+    for (;;) {
+#if defined(RTPC_HAVE_MMSG)
+        for (i = 0; i < RTPC_MAX_MMSG; i++) {
+            dgbp->iovs[i].iov_base = dgbp->bufs[i];
+            dgbp->iovs[i].iov_len = sizeof(dgbp->bufs[i]) - 1;
+            dgbp->mmsgs[i].msg_hdr.msg_name = &dgbp->raddrs[i];
+            dgbp->mmsgs[i].msg_hdr.msg_namelen = sizeof(dgbp->raddrs[i]);
+            dgbp->mmsgs[i].msg_hdr.msg_iov = &dgbp->iovs[i];
+            dgbp->mmsgs[i].msg_hdr.msg_iovlen = 1;
+            dgbp->mmsgs[i].msg_hdr.msg_control = NULL;
+            dgbp->mmsgs[i].msg_hdr.msg_controllen = 0;
+            dgbp->mmsgs[i].msg_hdr.msg_flags = 0;
         }
-    } while (i == 0 && umode != 0);
-    return (i);
+        nrecv = recvmmsg(controlfd, dgbp->mmsgs, RTPC_MAX_MMSG, MSG_DONTWAIT,
+          NULL);
+#else
+        rlen = sizeof(dgbp->raddrs[0]);
+        len = recvfrom(controlfd, dgbp->bufs[0], sizeof(dgbp->bufs[0]) - 1, 0,
+          sstosa(&dgbp->raddrs[0]), &rlen);
+        nrecv = (len < 0) ? -1 : 1;
+#endif
+        if (nrecv <= 0) {
+            if (nrecv < 0 && errno != EAGAIN && errno != EINTR)
+                RTPP_ELOG(cf->stable->glog, RTPP_LOG_ERR, "can't read from control socket");
+            break;
+        }
+        for (i = 0; i < nrecv; i++) {
+#if defined(RTPC_HAVE_MMSG)
+            len = dgbp->mmsgs[i].msg_len;
+            rlen = dgbp->mmsgs[i].msg_hdr.msg_namelen;
+#endif
+            dgbp->bufs[i][len] = '\0';
+            process_dgram(csock, cf, controlfd, dgbp->bufs[i], len,
+              sstosa(&dgbp->raddrs[i]), rlen, dtime, csp, rsc, rcp,
+              &dgbp->reply);
+        }
+    }
+    return (0);
 }
 
 static int
 process_commands_stream(struct cfg *cf, struct rtpp_cmd_connection *rcc,
-  double dtime, struct rtpp_command_stats *csp, struct rtpp_stats *rsc)
+  double dtime, struct rtpp_command_stats *csp, struct rtpp_stats *rsc,
+  struct rtpc_reply *rrp)
 {
     int rval;
     struct rtpp_command *cmd;
@@ -216,27 +338,20 @@ process_commands_stream(struct cfg *cf, struct rtpp_cmd_connection *rcc,
     if (rval <= 0) {
         return (-1);
     }
+    /* Replies to all commands pipelined in this read go out in one write */
+    rtpc_reply_init(rrp, rcc->controlfd_out, 0, NULL, 0);
     do {
-        cmd = rtpp_command_stream_get(cf, rcc, &rval, dtime, csp);
+        cmd = rtpp_command_stream_get(cf, rcc, &rval, dtime, csp, rrp);
         if (cmd == NULL) {
             if (rval != 0) {
                 break;
             }
             continue;
         }
-        cmd->laddr = sstosa(&rcc->csock->bindaddr);
-        if (cmd->cca.op == GET_STATS || cmd->cca.op == INFO) {
-            flush_cstats(rsc, csp);
-        }
-        if (cmd->no_glock == 0) {
-            pthread_mutex_lock(&cf->glock);
-        }
-        rval = handle_command(cf, cmd);
-        if (cmd->no_glock == 0) {
-            pthread_mutex_unlock(&cf->glock);
-        }
-        free_command(cmd);
+        rval = rtpp_cmd_dispatch(cf, cmd, sstosa(&rcc->csock->bindaddr), csp,
+          rsc);
     } while (rval == 0);
+    rtpc_reply_flush(rrp, cf->stable);
     return (rval);
 }
 
@@ -337,11 +452,31 @@ rtpp_cmd_acceptor_run(void *arg)
             psp->rccs[psp->pfds_used] = rcc;
             psp->pfds_used++;
             pthread_mutex_unlock(&psp->pfds_mutex);
+            rtpp_cmd_pollset_wakeup(psp);
             rtpp_command_async_wakeup(&cmd_cf->pub);
         }
     }
 }
 
+static void
+rtpp_cmd_pollset_wakeup(struct rtpp_cmd_pollset *psp)
+{
+    char b;
+
+    b = 0;
+    /* Pipe is non-blocking, if it is full the wakeup is pending anyway */
+    (void)write(psp->wakefd[1], &b, 1);
+}
+
+static void
+rtpp_cmd_pollset_drain(struct rtpp_cmd_pollset *psp)
+{
+    char buf[64];
+
+    while (read(psp->wakefd[0], buf, sizeof(buf)) > 0)
+        continue;
+}
+
 static int
 wait_next_clock(struct rtpp_cmd_async_cf *cmd_cf)
 {
@@ -366,23 +501,23 @@ rtpp_cmd_queue_run(void *arg)
 {
     struct rtpp_cmd_async_cf *cmd_cf;
     struct rtpp_cmd_pollset *psp;
-    int i, nready, rval;
+    int i, nready, npolled, rval;
     double sptime;
 #if 0
     double eptime, tused;
 #endif
     struct rtpp_command_stats *csp;
     struct rtpp_stats *rtpp_stats_cf;
+    int tickless, tstate;
 
     cmd_cf = (struct rtpp_cmd_async_cf *)arg;
     rtpp_stats_cf = cmd_cf->cf_save->stable->rtpp_stats;
+    tickless = cmd_cf->cf_save->stable->tickless;
     csp = &cmd_cf->cstats;
 
     psp = &cmd_cf->pset;
 
     for (;;) {
-        sptime = getdtime();
-
         pthread_mutex_lock(&psp->pfds_mutex);
         if (psp->pfds_used == 0) {
             pthread_mutex_unlock(&psp->pfds_mutex);
@@ -391,18 +526,56 @@ rtpp_cmd_queue_run(void *arg)
             }
             continue;
         }
-        nready = poll(psp->pfds, psp->pfds_used, 2);
+        /*
+         * Poll on a private copy of the set, so that the acceptor thread
+         * does not have to wait for poll() to return to add a new
+         * connection. Connections are only ever removed by this thread
+         * and appended at the end by the acceptor, so the first npolled
+         * entries stay the same until we get the lock back.
+         */
+        npolled = psp->pfds_used;
+        memcpy(psp->ppfds, psp->pfds, sizeof(psp->ppfds[0]) * npolled);
+        pthread_mutex_unlock(&psp->pfds_mutex);
+        psp->ppfds[npolled].fd = psp->wakefd[0];
+        psp->ppfds[npolled].events = POLLIN;
+        psp->ppfds[npolled].revents = 0;
+        if (tickless) {
+            /*
+             * Nobody is going to clock us while idle, block on the
+             * sockets instead and check for shutdown now and then.
+             */
+            nready = poll(psp->ppfds, npolled + 1, RTPC_IDLE_POLL);
+        } else {
+            nready = poll(psp->ppfds, npolled + 1, 2);
+        }
+        if (nready > 0 && psp->ppfds[npolled].revents != 0) {
+            rtpp_cmd_pollset_drain(psp);
+            nready--;
+        }
         if (nready == 0) {
-            pthread_mutex_unlock(&psp->pfds_mutex);
+            if (tickless) {
+                pthread_mutex_lock(&cmd_cf->cmd_mutex);
+                tstate = cmd_cf->tstate_queue;
+                pthread_mutex_unlock(&cmd_cf->cmd_mutex);
+                if (tstate == TSTATE_CEASE) {
+                    break;
+                }
+                continue;
+            }
             if (wait_next_clock(cmd_cf) == TSTATE_CEASE) {
                 break;
             }
             continue;
         }
         if (nready < 0 && errno == EINTR) {
-            pthread_mutex_unlock(&psp->pfds_mutex);
             continue;
         }
+        /* Taken after poll(), which may have been blocking for a while */
+        sptime = getdtime();
+        pthread_mutex_lock(&psp->pfds_mutex);
+        for (i = 0; i < npolled; i++) {
+            psp->pfds[i].revents = psp->ppfds[i].revents;
+        }
         if (nready > 0) {
             for (i = 0; i < psp->pfds_used; i++) {
                 if ((psp->pfds[i].revents & (POLLERR | POLLHUP)) != 0) {
@@ -417,7 +590,12 @@ rtpp_cmd_queue_run(void *arg)
                     continue;
                 }
                 if (RTPP_CTRL_ISSTREAM(psp->rccs[i]->csock)) {
-                    rval = process_commands_stream(cmd_cf->cf_save, psp->rccs[i], sptime, csp, rtpp_stats_cf);
+                    rval = process_commands_stream(cmd_cf->cf_save, psp->rccs[i],
+                      sptime, csp, rtpp_stats_cf, &cmd_cf->dgbatch.reply);
+                } else if (RTPP_CTRL_ISDG(psp->rccs[i]->csock)) {
+                    rval = process_commands_dgram(psp->rccs[i]->csock, cmd_cf->cf_save,
+                      psp->pfds[i].fd, sptime, csp, rtpp_stats_cf, cmd_cf->rcache,
+                      &cmd_cf->dgbatch);
                 } else {
                     rval = process_commands(psp->rccs[i]->csock, cmd_cf->cf_save, psp->pfds[i].fd,
                       sptime, csp, rtpp_stats_cf, cmd_cf->rcache);
@@ -446,6 +624,10 @@ closefd:
         pthread_mutex_unlock(&psp->pfds_mutex);
         if (nready > 0) {
             rtpp_anetio_pump(cmd_cf->cf_save->stable->rtpp_netio_cf);
+            if (tickless) {
+                /* Sessions may have come or gone, let main loop re-check */
+                CALL_METHOD(cmd_cf->cf_save->stable->ticker, kick);
+            }
         }
 #if 0
         eptime = getdtime();
@@ -527,8 +709,15 @@ init_pollset(struct cfg *cf, struct rtpp_cmd_pollset *psp)
         return (-1);
     }
     if (pthread_mutex_init(&psp->pfds_mutex, NULL) != 0) {
-        free(psp->pfds);
-        return (-1);
+        goto e0;
+    }
+    if (pipe(psp->wakefd) != 0) {
+        goto e1;
+    }
+    for (i = 0; i < 2; i++) {
+        if (fcntl(psp->wakefd[i], F_SETFL, O_NONBLOCK) != 0) {
+            goto e2;
+        }
     }
     psp->pfds_used = pfds_used;
     if (psp->pfds_used == 0) {
@@ -549,6 +738,14 @@ init_pollset(struct cfg *cf, struct rtpp_cmd_pollset *psp)
         psp->rccs[0]->csock->exit_on_close = 1;
     }
     return (0);
+e2:
+    close(psp->wakefd[0]);
+    close(psp->wakefd[1]);
+e1:
+    pthread_mutex_destroy(&psp->pfds_mutex);
+e0:
+    free(psp->pfds);
+    return (-1);
 }
 
 static void
@@ -559,6 +756,8 @@ free_pollset(struct rtpp_cmd_pollset *psp)
     for (i = 0; i < psp->pfds_used; i ++) {
         rtpp_cmd_connection_dtor(psp->rccs[i]);
     }
+    close(psp->wakefd[0]);
+    close(psp->wakefd[1]);
     free(psp->pfds);
 }
 
@@ -637,9 +836,8 @@ rtpp_command_async_ctor(struct cfg *cf)
     if (pthread_mutex_init(&cmd_cf->cmd_mutex, NULL) != 0) {
         goto e4;
     }
-    assert(cf->stable->rtpp_timed_cf != NULL);
-    cmd_cf->rcache = rtpp_cmd_rcache_ctor(cf->stable->rtpp_timed_cf,
-      32.0 + 3.0);
+    cmd_cf->rcache = rtpp_cmd_rcache_ctor(cf->stable->rtpp_stats,
+      32.0 + 3.0, cf->stable->rcache_mem);
     if (cmd_cf->rcache == NULL) {
         goto e5;
     }
@@ -673,7 +871,6 @@ e7:
         pthread_join(cmd_cf->acpt_thread_id, NULL);
     }
 e6:
-    CALL_METHOD(cmd_cf->rcache, shutdown);
     CALL_SMETHOD(cmd_cf->rcache->rcnt, decref);
 e5:
     pthread_mutex_destroy(&cmd_cf->cmd_mutex);
@@ -709,11 +906,11 @@ rtpp_command_async_dtor(struct rtpp_cmd_async *pub)
     /* notify worker thread */
     pthread_cond_signal(&cmd_cf->cmd_cond);
     pthread_mutex_unlock(&cmd_cf->cmd_mutex);
+    rtpp_cmd_pollset_wakeup(&cmd_cf->pset);
     pthread_join(cmd_cf->thread_id, NULL);        
     if (cmd_cf->acceptor_started != 0) {
         pthread_join(cmd_cf->acpt_thread_id, NULL);
     }
-    CALL_METHOD(cmd_cf->rcache, shutdown);
     CALL_SMETHOD(cmd_cf->rcache->rcnt, decref);
     pthread_cond_destroy(&cmd_cf->cmd_cond);
     pthread_mutex_destroy(&cmd_cf->cmd_mutex);
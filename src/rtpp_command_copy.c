@@ -49,7 +49,8 @@ handle_copy(struct cfg *cf, struct rtpp_session *spa, int idx, char *rname,
 {
     int remote;
 
-    remote = (rname != NULL && strncmp("udp:", rname, 4) == 0)? 1 : 0;
+    remote = (rname != NULL && (strncmp("udp:", rname, 4) == 0 ||
+      strncmp("udpagg:", rname, 7) == 0))? 1 : 0;
 
     if (remote == 0 && record_single_file != 0) {
         if (spa->rtp->stream[idx]->rrc != NULL)
@@ -187,6 +187,17 @@ fill_cmd_props(struct cfg *cf, struct rtpp_command *cmd,
 
     case 'q':
     case 'Q':
+        if (cpp->cmods[0] == 'B' || cpp->cmods[0] == 'b') {
+            cmd->cca.op = QUERY_BULK;
+            cmd->cca.rname = "query_bulk";
+            cmd->cca.hint = "QB[v] * | call_id1 [call_id2 ...[call_idN]]";
+            cmd->no_glock = 1;
+            cpp->max_argc = RTPC_MAX_ARGC;
+            cpp->min_argc = 2;
+            cpp->has_cmods = 1;
+            cpp->has_call_id = 0;
+            break;
+        }
         cmd->cca.op = QUERY;
         cmd->cca.rname = "query";
         cmd->cca.hint = "Q[v] call_id from_tag [to_tag [stat_name1 ...[stat_nameN]]]";
@@ -212,7 +223,7 @@ fill_cmd_props(struct cfg *cf, struct rtpp_command *cmd,
     case 'G':
         cmd->cca.op = GET_STATS;
         cmd->cca.rname = "get_stats";
-        cmd->cca.hint = "G[v] [stat_name1 [stat_name2 [stat_name3 ...[stat_nameN]]]]";
+        cmd->cca.hint = "G[v|h] [stat_name1 [stat_name2 [stat_name3 ...[stat_nameN]]]]";
         cmd->no_glock = 1;
         cpp->max_argc = CALL_METHOD(cf->stable->rtpp_stats, getnstats) + 1;
         cpp->min_argc = 1;
@@ -50,8 +50,21 @@ struct rtpp_command_stats {
 
 #define RTPC_MAX_ARGC   20
 
+/*
+ * Reply accumulator used to coalesce replies to the pipelined commands
+ * received in a single datagram or stream read into a single write.
+ */
+struct rtpc_reply {
+    int fd;
+    int umode;
+    struct sockaddr_storage raddr;
+    socklen_t rlen;
+    int len;
+    char buf[1024 * 8];
+};
+
 enum rtpp_cmd_op {DELETE, RECORD, PLAY, NOPLAY, COPY, UPDATE, LOOKUP, INFO,
-  QUERY, VER_FEATURE, GET_VER, DELETE_ALL, GET_STATS};
+  QUERY, VER_FEATURE, GET_VER, DELETE_ALL, GET_STATS, QUERY_BULK};
 
 struct common_cmd_args {
     enum rtpp_cmd_op op;
@@ -75,6 +88,7 @@ struct rtpp_command
     struct rtpp_command_stats *csp;
     struct common_cmd_args cca;
     int no_glock;
+    int bmode;                      /* Binary protocol, frame the reply */
     struct rtpp_session *sp;
 };
 
@@ -108,6 +122,8 @@ struct rtpp_command
 #define ECODE_INVLARG_4   34
 #define ECODE_INVLARG_5   35
 #define ECODE_INVLARG_6   36
+#define ECODE_INVLARG_7   37
+#define ECODE_INVLARG_8   38
 
 #define ECODE_SESUNKN     50
 
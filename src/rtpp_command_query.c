@@ -29,6 +29,7 @@
 #include <sys/types.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "rtpp_ssrc.h"
@@ -37,11 +38,16 @@
 #include "rtpp_types.h"
 #include "rtpp_log_obj.h"
 #include "rtpp_analyzer.h"
+#include "rtpp_cfg_stable.h"
+#include "rtpp_defines.h"
 #include "rtpp_command.h"
 #include "rtpp_command_private.h"
+#include "rtpp_hash_table.h"
 #include "rtpp_pcount.h"
 #include "rtpp_pcnt_strm.h"
 #include "rtpp_pipe.h"
+#include "rtpp_refcnt.h"
+#include "rtpp_session.h"
 #include "rtpp_stream.h"
 #include "rtpp_util.h"
 #include "rtpp_command_query.h"
@@ -54,10 +60,10 @@
     }
 
 static int
-handle_query_simple(struct cfg *cf, struct rtpp_command *cmd,
-  struct rtpp_pipe *spp, int idx, int verbose)
+query_fmt_simple(struct rtpp_pipe *spp, int idx, int verbose, char *buf,
+  int blen)
 {
-    int len, ttl;
+    int ttl;
     struct rtpps_pcount pcnts;
     struct rtpp_pcnts_strm pst[2];
 
@@ -66,19 +72,28 @@ handle_query_simple(struct cfg *cf, struct rtpp_command *cmd,
     CALL_METHOD(spp->stream[idx]->pcnt_strm, get_stats, &pst[0]);
     CALL_METHOD(spp->stream[NOT(idx)]->pcnt_strm, get_stats, &pst[1]);
     if (verbose == 0) {
-        len = snprintf(cmd->buf_t, sizeof(cmd->buf_t), "%d %lu %lu %lu %lu\n",
-          ttl, pst[0].npkts_in, pst[1].npkts_in, pcnts.nrelayed, pcnts.ndropped);
-    } else {
-        len = snprintf(cmd->buf_t, sizeof(cmd->buf_t), "ttl=%d npkts_ina=%lu "
-          "npkts_ino=%lu nrelayed=%lu ndropped=%lu\n", ttl,
-          pst[0].npkts_in, pst[1].npkts_in, pcnts.nrelayed, pcnts.ndropped);
+        return (snprintf(buf, blen, "%d %lu %lu %lu %lu\n",
+          ttl, pst[0].npkts_in, pst[1].npkts_in, pcnts.nrelayed, pcnts.ndropped));
     }
+    return (snprintf(buf, blen, "ttl=%d npkts_ina=%lu "
+      "npkts_ino=%lu nrelayed=%lu ndropped=%lu\n", ttl,
+      pst[0].npkts_in, pst[1].npkts_in, pcnts.nrelayed, pcnts.ndropped));
+}
+
+static int
+handle_query_simple(struct cfg *cf, struct rtpp_command *cmd,
+  struct rtpp_pipe *spp, int idx, int verbose)
+{
+    int len;
+
+    len = query_fmt_simple(spp, idx, verbose, cmd->buf_t, sizeof(cmd->buf_t));
     rtpc_doreply(cmd, cmd->buf_t, len, 0);
     return (0);
 }
 
 #define PULL_RST() \
     if (rst_pulled == 0) { \
+        CALL_METHOD(spp->stream[idx]->analyzer, activate); \
         CALL_METHOD(spp->stream[idx]->analyzer, get_stats, &rst); \
         rst_pulled = 1; \
     }
@@ -196,6 +211,12 @@ handle_query(struct cfg *cf, struct rtpp_command *cmd,
               rst.pecount);
             continue;
         }
+        if (strcmp(cmd->argv[i], "rtpa_sampled") == 0) {
+            PULL_RST();
+            len += snprintf(cmd->buf_t + len, sizeof(cmd->buf_t) - len, "%d",
+              rst.sampled);
+            continue;
+        }
         RTPP_LOG(spp->log, RTPP_LOG_ERR,
               "QUERY: unsupported/invalid counter name `%s'", cmd->argv[i]);
         return (ECODE_QRYFAIL);
@@ -205,3 +226,111 @@ handle_query(struct cfg *cf, struct rtpp_command *cmd,
     rtpc_doreply(cmd, cmd->buf_t, len, 0);
     return (0);
 }
+
+struct query_bulk_args {
+    struct rtpp_session **spa;
+    int nsp;
+    int alen;
+};
+
+static int
+query_bulk_collect(void *dp, void *ap)
+{
+    struct rtpp_session *sp, **tspa;
+    struct query_bulk_args *qbap;
+
+    sp = (struct rtpp_session *)dp;
+    qbap = (struct query_bulk_args *)ap;
+    if (qbap->nsp == qbap->alen) {
+        tspa = realloc(qbap->spa, sizeof(qbap->spa[0]) * qbap->alen * 2);
+        if (tspa == NULL) {
+            return (RTPP_HT_MATCH_BRK);
+        }
+        qbap->spa = tspa;
+        qbap->alen *= 2;
+    }
+    CALL_SMETHOD(sp->rcnt, incref);
+    qbap->spa[qbap->nsp] = sp;
+    qbap->nsp++;
+    return (RTPP_HT_MATCH_CONT);
+}
+
+/*
+ * QB[v] * | call_id1 [call_id2 ...]
+ *
+ * Reports one line per matching session in the same format as the
+ * simple "Q call_id tag" would, prefixed with the call_id and tag,
+ * followed by an empty line to mark the end of the output. Sessions
+ * are collected into an array of references first, so that the session
+ * table is only locked for as long as it takes to copy the pointers,
+ * and the replies are then generated and written out one by one
+ * without any locks held.
+ */
+int
+handle_query_bulk(struct cfg *cf, struct rtpp_command *cmd)
+{
+    struct query_bulk_args qba;
+    struct rtpp_session *sp;
+    char *cp, buf[1024];
+    int i, len, plen, verbose;
+
+    verbose = 0;
+    for (cp = cmd->argv[0] + 2; *cp != '\0'; cp++) {
+        switch (*cp) {
+        case 'v':
+        case 'V':
+            verbose = 1;
+            break;
+
+        default:
+            RTPP_LOG(cf->stable->glog, RTPP_LOG_ERR,
+              "QUERY_BULK: unknown command modifier `%c'", *cp);
+            return (ECODE_PARSE_8);
+        }
+    }
+
+    memset(&qba, '\0', sizeof(qba));
+    qba.alen = CALL_METHOD(cf->stable->sessions_ht, get_length) + 16;
+    qba.spa = malloc(sizeof(qba.spa[0]) * qba.alen);
+    if (qba.spa == NULL) {
+        return (ECODE_NOMEM_8);
+    }
+    if (cmd->argc == 2 && strcmp(cmd->argv[1], "*") == 0) {
+        CALL_METHOD(cf->stable->sessions_ht, foreach, query_bulk_collect,
+          &qba);
+    } else {
+        for (i = 1; i < cmd->argc; i++) {
+            CALL_METHOD(cf->stable->sessions_ht, foreach_key, cmd->argv[i],
+              query_bulk_collect, &qba);
+        }
+    }
+
+    for (i = 0; i < qba.nsp; i++) {
+        sp = qba.spa[i];
+        if (verbose == 0) {
+            plen = snprintf(buf, sizeof(buf), "%s %s ", sp->call_id, sp->tag);
+        } else {
+            plen = snprintf(buf, sizeof(buf), "call_id=%s tag=%s ",
+              sp->call_id, sp->tag);
+        }
+        if (plen < sizeof(buf)) {
+            len = query_fmt_simple(sp->rtp, 1, verbose, buf + plen,
+              sizeof(buf) - plen);
+            if (plen + len < sizeof(buf)) {
+                rtpc_doreply_part(cmd, buf, plen + len);
+            } else {
+                plen = sizeof(buf);
+            }
+        }
+        if (plen >= sizeof(buf)) {
+            RTPP_LOG(sp->log, RTPP_LOG_ERR, "QUERY_BULK: output buffer "
+              "overflow, session skipped");
+        }
+        CALL_SMETHOD(sp->rcnt, decref);
+    }
+    free(qba.spa);
+
+    len = snprintf(buf, sizeof(buf), "\n");
+    rtpc_doreply(cmd, buf, len, 0);
+    return (0);
+}
@@ -30,3 +30,4 @@
 struct rtpp_pipe;
 
 int handle_query(struct cfg *, struct rtpp_command *, struct rtpp_pipe *, int);
+int handle_query_bulk(struct cfg *, struct rtpp_command *);
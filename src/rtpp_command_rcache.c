@@ -25,90 +25,205 @@
  *
  */
 
+#include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "rtpp_types.h"
 #include "rtpp_command_rcache.h"
 #include "rtpp_command_rcache_fin.h"
-#include "rtpp_hash_table.h"
 #include "rtpp_mallocs.h"
 #include "rtpp_refcnt.h"
-#include "rtpp_timed.h"
+#include "rtpp_stats.h"
 
-#define	RTPP_RCACHE_CPERD	3.0
+/*
+ * Reply cache is a fixed-size ring of entries with the cookie and the
+ * reply stored inline. All entries share the same TTL and are inserted
+ * in the order of increasing time, so that the oldest entry is always
+ * the first one to expire. Expiry is done lazily from insert and lookup
+ * by popping entries off the tail of the ring, which keeps the cost
+ * of each operation O(1) regardless of the command rate. When the ring
+ * is full the oldest entry is evicted early, which bounds the amount of
+ * memory used by the cache.
+ */
 
-struct rtpp_cmd_rcache_pvt {
-    struct rtpp_cmd_rcache pub;
-    double min_ttl;
-    struct rtpp_hash_table *ht;
-    struct rtpp_timed_task *timeout;
-    int timeout_rval;
-};
+#define	RTPP_RCACHE_CLEN	128
+#define	RTPP_RCACHE_RLEN	256
+#define	RTPP_RCACHE_DEFMEM	(16 * 1024 * 1024)
+#define	RTPP_RCACHE_NIL		(-1)
 
 struct rtpp_cmd_rcache_entry {
-    char *reply;
     double etime;
+    uint32_t hash;
+    int hprev;
+    int hnext;
+    int clen;
+    int rlen;
+    char cookie[RTPP_RCACHE_CLEN];
+    char reply[RTPP_RCACHE_RLEN];
+};
+
+struct rtpp_cmd_rcache_pvt {
+    struct rtpp_cmd_rcache pub;
+    double min_ttl;
+    pthread_mutex_t lock;
+    struct rtpp_stats *rtpp_stats;
+    struct {
+        int nhits;
+        int nmiss;
+        int nevict;
+    } stats_idx;
+    int nslots;
+    int head;
+    int nused;
+    uint32_t hmask;
+    int *hbuckets;
+    struct rtpp_cmd_rcache_entry *slots;
 };
 
-static enum rtpp_timed_cb_rvals rtpp_cmd_rcache_cleanup(double, void *);
 static void rtpp_cmd_rcache_insert(struct rtpp_cmd_rcache *, const char *,
   const char *, double);
-int rtpp_cmd_rcache_lookup(struct rtpp_cmd_rcache *, const char *,
-  char *, int);
+static int rtpp_cmd_rcache_lookup(struct rtpp_cmd_rcache *, const char *,
+  char *, int, double);
 static void rtpp_cmd_rcache_dtor(struct rtpp_cmd_rcache_pvt *);
-static void rtpp_cmd_rcache_shutdown(struct rtpp_cmd_rcache *);
 
 struct rtpp_cmd_rcache *
-rtpp_cmd_rcache_ctor(struct rtpp_timed *rtpp_timed_cf, double min_ttl)
+rtpp_cmd_rcache_ctor(struct rtpp_stats *rtpp_stats, double min_ttl,
+  size_t memcap)
 {
     struct rtpp_cmd_rcache_pvt *pvt;
     struct rtpp_refcnt *rcnt;
+    int i, nbuckets;
 
     pvt = rtpp_rzmalloc(sizeof(struct rtpp_cmd_rcache_pvt), &rcnt);
     if (pvt == NULL) {
         return (NULL);
     }
     pvt->pub.rcnt = rcnt;
-#if !defined(RTPP_DEBUG)
-    pvt->ht = rtpp_hash_table_ctor(rtpp_ht_key_str_t, RTPP_HT_NODUPS);
-#else
-    pvt->ht = rtpp_hash_table_ctor(rtpp_ht_key_str_t, RTPP_HT_NODUPS |
-      RTPP_HT_DUP_ABRT);
-#endif
-    if (pvt->ht == NULL) {
+    if (memcap == 0) {
+        memcap = RTPP_RCACHE_DEFMEM;
+    }
+    /* Each slot costs an entry plus roughly two hash buckets */
+    pvt->nslots = memcap / (sizeof(struct rtpp_cmd_rcache_entry) +
+      2 * sizeof(int));
+    if (pvt->nslots < 1) {
+        pvt->nslots = 1;
+    }
+    for (nbuckets = 1; nbuckets < pvt->nslots; nbuckets <<= 1)
+        continue;
+    pvt->hmask = nbuckets - 1;
+    pvt->slots = malloc(sizeof(struct rtpp_cmd_rcache_entry) * pvt->nslots);
+    if (pvt->slots == NULL) {
         goto e0;
     }
-    pvt->timeout = CALL_METHOD(rtpp_timed_cf, schedule_rc, RTPP_RCACHE_CPERD,
-      pvt->pub.rcnt, rtpp_cmd_rcache_cleanup, NULL, pvt);
-    if (pvt->timeout == NULL) {
+    pvt->hbuckets = malloc(sizeof(int) * nbuckets);
+    if (pvt->hbuckets == NULL) {
+        goto e1;
+    }
+    for (i = 0; i < nbuckets; i++) {
+        pvt->hbuckets[i] = RTPP_RCACHE_NIL;
+    }
+    if (pthread_mutex_init(&pvt->lock, NULL) != 0) {
         goto e2;
     }
+    pvt->rtpp_stats = rtpp_stats;
+    pvt->stats_idx.nhits = CALL_METHOD(rtpp_stats, getidxbyname,
+      "rcache_nhits");
+    pvt->stats_idx.nmiss = CALL_METHOD(rtpp_stats, getidxbyname,
+      "rcache_nmiss");
+    pvt->stats_idx.nevict = CALL_METHOD(rtpp_stats, getidxbyname,
+      "rcache_nevict");
     pvt->min_ttl = min_ttl;
-    pvt->timeout_rval = CB_MORE;
     pvt->pub.insert = &rtpp_cmd_rcache_insert;
     pvt->pub.lookup = &rtpp_cmd_rcache_lookup;
-    pvt->pub.shutdown = &rtpp_cmd_rcache_shutdown;
     CALL_SMETHOD(pvt->pub.rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_cmd_rcache_dtor,
       pvt);
     return (&pvt->pub);
 
 e2:
-    CALL_METHOD(pvt->ht, dtor);
+    free(pvt->hbuckets);
+e1:
+    free(pvt->slots);
 e0:
     CALL_SMETHOD(pvt->pub.rcnt, decref);
     free(pvt);
     return (NULL);
 }
 
+static uint32_t
+rtpp_cmd_rcache_hash(const char *cookie, int clen)
+{
+    uint32_t hash;
+    int i;
+
+    /* FNV-1a */
+    hash = 2166136261U;
+    for (i = 0; i < clen; i++) {
+        hash ^= (unsigned char)cookie[i];
+        hash *= 16777619U;
+    }
+    return (hash);
+}
+
 static void
-rtpp_cmd_rcache_entry_free(void *p)
+rtpp_cmd_rcache_unlink(struct rtpp_cmd_rcache_pvt *pvt, int idx)
 {
     struct rtpp_cmd_rcache_entry *rep;
 
-    rep = (struct rtpp_cmd_rcache_entry *)p;
-    free(rep->reply);
-    free(rep);
+    rep = &pvt->slots[idx];
+    if (rep->hprev != RTPP_RCACHE_NIL) {
+        pvt->slots[rep->hprev].hnext = rep->hnext;
+    } else {
+        pvt->hbuckets[rep->hash & pvt->hmask] = rep->hnext;
+    }
+    if (rep->hnext != RTPP_RCACHE_NIL) {
+        pvt->slots[rep->hnext].hprev = rep->hprev;
+    }
+}
+
+static int
+rtpp_cmd_rcache_tail(struct rtpp_cmd_rcache_pvt *pvt)
+{
+    int idx;
+
+    idx = pvt->head - pvt->nused;
+    if (idx < 0) {
+        idx += pvt->nslots;
+    }
+    return (idx);
+}
+
+static void
+rtpp_cmd_rcache_expire(struct rtpp_cmd_rcache_pvt *pvt, double ctime)
+{
+    int idx;
+
+    while (pvt->nused > 0) {
+        idx = rtpp_cmd_rcache_tail(pvt);
+        if (pvt->slots[idx].etime >= ctime)
+            break;
+        rtpp_cmd_rcache_unlink(pvt, idx);
+        pvt->nused--;
+    }
+}
+
+static struct rtpp_cmd_rcache_entry *
+rtpp_cmd_rcache_find(struct rtpp_cmd_rcache_pvt *pvt, const char *cookie,
+  int clen, uint32_t hash)
+{
+    struct rtpp_cmd_rcache_entry *rep;
+    int idx;
+
+    for (idx = pvt->hbuckets[hash & pvt->hmask]; idx != RTPP_RCACHE_NIL;
+      idx = rep->hnext) {
+        rep = &pvt->slots[idx];
+        if (rep->hash == hash && rep->clen == clen &&
+          memcmp(rep->cookie, cookie, clen) == 0) {
+            return (rep);
+        }
+    }
+    return (NULL);
 }
 
 static void
@@ -117,100 +232,90 @@ rtpp_cmd_rcache_insert(struct rtpp_cmd_rcache *pub, const char *cookie,
 {
     struct rtpp_cmd_rcache_pvt *pvt;
     struct rtpp_cmd_rcache_entry *rep;
-    struct rtpp_refcnt *rcnt;
+    int clen, rlen, idx, nevict;
+    uint32_t hash;
 
     pvt = (struct rtpp_cmd_rcache_pvt *)pub;
-    rep = rtpp_rzmalloc(sizeof(struct rtpp_cmd_rcache_entry), &rcnt);
-    if (rep == NULL) {
+    clen = strlen(cookie);
+    rlen = strlen(reply);
+    if (clen >= RTPP_RCACHE_CLEN || rlen >= RTPP_RCACHE_RLEN) {
         return;
     }
-    rep->reply = strdup(reply);
-    if (rep->reply == NULL) {
-        goto e1;
+    hash = rtpp_cmd_rcache_hash(cookie, clen);
+    nevict = 0;
+
+    pthread_mutex_lock(&pvt->lock);
+    rtpp_cmd_rcache_expire(pvt, ctime);
+    if (rtpp_cmd_rcache_find(pvt, cookie, clen, hash) != NULL) {
+        pthread_mutex_unlock(&pvt->lock);
+        return;
+    }
+    if (pvt->nused == pvt->nslots) {
+        /* Cache is full, evict the oldest entry */
+        rtpp_cmd_rcache_unlink(pvt, rtpp_cmd_rcache_tail(pvt));
+        pvt->nused--;
+        nevict = 1;
     }
+    idx = pvt->head;
+    rep = &pvt->slots[idx];
     rep->etime = ctime + pvt->min_ttl;
-    CALL_METHOD(pvt->ht, append_refcnt, cookie, rcnt);
-    CALL_SMETHOD(rcnt, attach, rtpp_cmd_rcache_entry_free, rep);
-    /*
-     * append_refcnt() either takes ownership in which case it incs refcount
-     * or it drops the ball in which it does not, so we release rco and set
-     * it free.
-     */
-    CALL_SMETHOD(rcnt, decref);
-    return;
-e1:
-    CALL_SMETHOD(rcnt, decref);
-    free(rep);
+    rep->hash = hash;
+    rep->clen = clen;
+    rep->rlen = rlen;
+    memcpy(rep->cookie, cookie, clen);
+    memcpy(rep->reply, reply, rlen + 1);
+    rep->hprev = RTPP_RCACHE_NIL;
+    rep->hnext = pvt->hbuckets[hash & pvt->hmask];
+    if (rep->hnext != RTPP_RCACHE_NIL) {
+        pvt->slots[rep->hnext].hprev = idx;
+    }
+    pvt->hbuckets[hash & pvt->hmask] = idx;
+    pvt->head = (idx + 1 == pvt->nslots) ? 0 : idx + 1;
+    pvt->nused++;
+    pthread_mutex_unlock(&pvt->lock);
+
+    if (nevict != 0) {
+        CALL_METHOD(pvt->rtpp_stats, updatebyidx, pvt->stats_idx.nevict, 1);
+    }
 }
 
-int
+static int
 rtpp_cmd_rcache_lookup(struct rtpp_cmd_rcache *pub, const char *cookie,
-  char *rbuf, int rblen)
+  char *rbuf, int rblen, double ctime)
 {
     struct rtpp_cmd_rcache_pvt *pvt;
     struct rtpp_cmd_rcache_entry *rep;
-    struct rtpp_refcnt *rco;
+    int clen, rlen;
 
     pvt = (struct rtpp_cmd_rcache_pvt *)pub;
-    rco = CALL_METHOD(pvt->ht, find, cookie);
-    if (rco == NULL) {
-        return (0);
-    }
-    /*
-     * "find" method returns object that has been incref'ed, so make sure
-     * to decref when we've done with it.
-     */
-    rep = CALL_SMETHOD(rco, getdata);
-    strncpy(rbuf, rep->reply, rblen);
-    CALL_SMETHOD(rco, decref);
-    return (1);
+    clen = strlen(cookie);
+    rlen = -1;
+    if (clen < RTPP_RCACHE_CLEN) {
+        pthread_mutex_lock(&pvt->lock);
+        rtpp_cmd_rcache_expire(pvt, ctime);
+        rep = rtpp_cmd_rcache_find(pvt, cookie, clen,
+          rtpp_cmd_rcache_hash(cookie, clen));
+        if (rep != NULL && rep->rlen < rblen) {
+            rlen = rep->rlen;
+            memcpy(rbuf, rep->reply, rlen + 1);
+        }
+        pthread_mutex_unlock(&pvt->lock);
+    }
+    if (rlen < 0) {
+        CALL_METHOD(pvt->rtpp_stats, updatebyidx, pvt->stats_idx.nmiss, 1);
+        return (-1);
+    }
+    CALL_METHOD(pvt->rtpp_stats, updatebyidx, pvt->stats_idx.nhits, 1);
+    return (rlen);
 }
 
 static void
-rtpp_cmd_rcache_shutdown(struct rtpp_cmd_rcache *pub)
-{
-    struct rtpp_cmd_rcache_pvt *pvt;
-
-    pvt = (struct rtpp_cmd_rcache_pvt *)pub;
-    pvt->timeout_rval = CB_LAST;
-    CALL_METHOD(pvt->timeout, cancel);
-    CALL_SMETHOD(pvt->timeout->rcnt, decref);
-    pvt->timeout = NULL;
-}
-
-void
 rtpp_cmd_rcache_dtor(struct rtpp_cmd_rcache_pvt *pvt)
 {
 
     rtpp_cmd_rcache_fin(&pvt->pub);
-    CALL_METHOD(pvt->ht, dtor);
+    pthread_mutex_destroy(&pvt->lock);
+    free(pvt->hbuckets);
+    free(pvt->slots);
     free(pvt);
 }
-
-static int
-rtpp_cmd_rcache_ematch(void *dp, void *ap)
-{
-    struct rtpp_cmd_rcache_entry *rep;
-    double *ctimep;
-
-    /*
-     * This method does not need us to bump ref, since we are in the
-     * context of the rtpp_hash_table, which hold its own ref.
-     */
-    ctimep = (double *)ap;
-    rep = (struct rtpp_cmd_rcache_entry *)dp;
-    if (rep->etime < *ctimep) {
-        return (RTPP_HT_MATCH_DEL);
-    }
-    return (RTPP_HT_MATCH_CONT);
-}
-
-static enum rtpp_timed_cb_rvals
-rtpp_cmd_rcache_cleanup(double ctime, void *p)
-{
-    struct rtpp_cmd_rcache_pvt *pvt;
-
-    pvt = (struct rtpp_cmd_rcache_pvt *)p;
-    CALL_METHOD(pvt->ht, foreach, rtpp_cmd_rcache_ematch, &ctime);
-    return (pvt->timeout_rval);
-}
@@ -29,6 +29,7 @@
 #include <sys/types.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "rtpp_log.h"
 #include "rtpp_defines.h"
@@ -38,6 +39,8 @@
 #include "rtpp_types.h"
 #include "rtpp_stats.h"
 #include "rtpp_log_obj.h"
+#include "rtpp_lhist.h"
+#include "rtpp_netio_async.h"
 
 #define CHECK_OVERFLOW() \
     if (len > sizeof(cmd->buf_t) - 2) { \
@@ -46,11 +49,58 @@
         return (ECODE_RTOOBIG_1); \
     }
 
+/*
+ * Relay latency percentiles, in seconds. Unlike the rest these are not
+ * kept in the rtpp_stats, but computed from the snapshot of the per-thread
+ * histograms taken when asked for.
+ */
+static const struct {
+    const char *name;
+    double frac;
+} rlat_stats[] = {
+    {.name = "rlat_p50",  .frac = 0.5},
+    {.name = "rlat_p99",  .frac = 0.99},
+    {.name = "rlat_p999", .frac = 0.999},
+    {.name = NULL}
+};
+
+static int
+rlat_nstr(struct cfg *cf, char *buf, int len, const char *name,
+  struct rtpp_lhist *snap, int *havesnap)
+{
+    int i;
+    double pct;
+
+    if (strcmp(name, "rlat_nsamples") == 0) {
+        i = -1;
+    } else {
+        for (i = 0; rlat_stats[i].name != NULL; i++) {
+            if (strcmp(name, rlat_stats[i].name) == 0)
+                break;
+        }
+        if (rlat_stats[i].name == NULL)
+            return (-1);
+    }
+    if (*havesnap == 0) {
+        memset(snap, '\0', sizeof(*snap));
+        rtpp_anetio_get_rlat(cf->stable->rtpp_netio_cf, snap);
+        *havesnap = 1;
+    }
+    if (i < 0)
+        return (snprintf(buf, len, "%llu", (unsigned long long)snap->nsamples));
+    pct = rtpp_lhist_pct(snap, rlat_stats[i].frac);
+    if (pct < 0)
+        pct = 0;
+    return (snprintf(buf, len, "%f", pct / 1000000.0));
+}
+
 int
 handle_get_stats(struct cfg *cf, struct rtpp_command *cmd, int verbose)
 {
-    int len, i, rval;
+    int len, i, rval, havesnap;
+    struct rtpp_lhist snap;
 
+    havesnap = 0;
     len = 0;
     for (i = 1; i < cmd->argc && len < (sizeof(cmd->buf_t) - 2); i++) {
         if (i > 1) {
@@ -63,8 +113,12 @@ handle_get_stats(struct cfg *cf, struct rtpp_command *cmd, int verbose)
               cmd->argv[i]);
         }
         CHECK_OVERFLOW();
-        rval = CALL_METHOD(cf->stable->rtpp_stats, nstr, cmd->buf_t + len,
-          sizeof(cmd->buf_t) - len, cmd->argv[i]);
+        rval = rlat_nstr(cf, cmd->buf_t + len, sizeof(cmd->buf_t) - len,
+          cmd->argv[i], &snap, &havesnap);
+        if (rval < 0) {
+            rval = CALL_METHOD(cf->stable->rtpp_stats, nstr, cmd->buf_t + len,
+              sizeof(cmd->buf_t) - len, cmd->argv[i]);
+        }
         if (rval < 0) {
             return (ECODE_STSFAIL);
         }
@@ -75,3 +129,28 @@ handle_get_stats(struct cfg *cf, struct rtpp_command *cmd, int verbose)
     rtpc_doreply(cmd, cmd->buf_t, len, 0);
     return (0);
 }
+
+/*
+ * Debug output of the relay latency histogram: one "lo hi count" line
+ * for each non-empty bin, bounds in microseconds.
+ */
+int
+handle_get_rlat_hist(struct cfg *cf, struct rtpp_command *cmd)
+{
+    struct rtpp_lhist snap;
+    int i, len;
+    char buf[64];
+
+    memset(&snap, '\0', sizeof(snap));
+    rtpp_anetio_get_rlat(cf->stable->rtpp_netio_cf, &snap);
+    for (i = 0; i < RTPP_LHIST_NBINS; i++) {
+        if (snap.bins[i] == 0)
+            continue;
+        len = snprintf(buf, sizeof(buf), "%u %u %llu\n", rtpp_lhist_binlo(i),
+          rtpp_lhist_binhi(i), (unsigned long long)snap.bins[i]);
+        rtpc_doreply_part(cmd, buf, len);
+    }
+    len = snprintf(buf, sizeof(buf), "\n");
+    rtpc_doreply(cmd, buf, len, 0);
+    return (0);
+}
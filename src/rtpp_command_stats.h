@@ -26,3 +26,4 @@
  */
 
 int handle_get_stats(struct cfg *, struct rtpp_command *, int);
+int handle_get_rlat_hist(struct cfg *, struct rtpp_command *);
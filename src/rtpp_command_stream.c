@@ -27,6 +27,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
 #include <errno.h>
 #include <stdint.h>
 #include <string.h>
@@ -41,6 +42,8 @@
 #include "rtpp_command_private.h"
 #include "rtpp_command_parse.h"
 #include "rtpp_command_stream.h"
+#include "rtpp_list.h"
+#include "rtpp_controlfd.h"
 #include "rtpp_util.h"
 
 static void
@@ -87,19 +90,117 @@ rtpp_command_stream_doio(struct cfg *cf, struct rtpp_cmd_connection *rcs)
     return (len);
 }
 
-struct rtpp_command *
-rtpp_command_stream_get(struct cfg *cf, struct rtpp_cmd_connection *rcs,
-  int *rval, double dtime, struct rtpp_command_stats *csp)
+/*
+ * Binary protocol frame is a 32-bit length of the rest of the frame
+ * followed by the 8-bit argument count and then by each argument
+ * prefixed with its 16-bit length, all in network byte order. First
+ * argument is the command with modifiers, exactly as in the text
+ * protocol (i.e. "Uc0,8"), so that the same handlers can be used for
+ * both. There is no cookie, each reply is the 32-bit length followed
+ * by the reply text without the trailing newline.
+ */
+#define RTPC_BIN_FHDR_LEN	4
+
+static int
+rtpp_command_stream_bin_decode(struct rtpp_command *cmd,
+  const unsigned char *fp, int flen)
 {
-    char **ap;
-    char *cp, *cp1;
+    const unsigned char *ep;
+    char *bp;
+    int i, argc, alen;
+
+    if (flen < 1)
+        return (-1);
+    ep = fp + flen;
+    argc = *fp++;
+    if (argc < 1 || argc > RTPC_MAX_ARGC)
+        return (-1);
+    /* Frame is no larger than cmd->buf, so the arguments always fit */
+    bp = cmd->buf;
+    for (i = 0; i < argc; i++) {
+        if (ep - fp < 2)
+            return (-1);
+        alen = (fp[0] << 8) | fp[1];
+        fp += 2;
+        if (alen == 0 || ep - fp < alen || memchr(fp, '\0', alen) != NULL)
+            return (-1);
+        memcpy(bp, fp, alen);
+        bp[alen] = '\0';
+        cmd->argv[i] = bp;
+        bp += alen + 1;
+        fp += alen;
+    }
+    if (fp != ep)
+        return (-1);
+    cmd->argc = argc;
+    return (0);
+}
+
+static struct rtpp_command *
+rtpp_command_stream_bin_get(struct cfg *cf, struct rtpp_cmd_connection *rcs,
+  int *rval, double dtime, struct rtpp_command_stats *csp,
+  struct rtpc_reply *rrp)
+{
+    const unsigned char *cp;
+    uint32_t flen;
     int len;
     struct rtpp_command *cmd;
 
-    if (rcs->inbuf_epos == rcs->inbuf_ppos) {
+    cp = (unsigned char *)&(rcs->inbuf[rcs->inbuf_ppos]);
+    len = rcs->inbuf_epos - rcs->inbuf_ppos;
+    if (len < RTPC_BIN_FHDR_LEN) {
+        *rval = EAGAIN;
+        return (NULL);
+    }
+    memcpy(&flen, cp, sizeof(flen));
+    flen = ntohl(flen);
+    if (flen > sizeof(rcs->inbuf) - RTPC_BIN_FHDR_LEN) {
+        RTPP_LOG(cf->stable->glog, RTPP_LOG_ERR, "binary command frame is "
+          "too large: %u bytes", flen);
+        *rval = -1;
+        return (NULL);
+    }
+    if (len < RTPC_BIN_FHDR_LEN + flen) {
         *rval = EAGAIN;
         return (NULL);
     }
+
+    cmd = rtpp_command_ctor(cf, rcs->controlfd_out, dtime, rval, csp, 0, rrp);
+    if (cmd == NULL) {
+        return (NULL);
+    }
+    cmd->bmode = 1;
+
+    if (rcs->rlen > 0) {
+        cmd->rlen = rcs->rlen;
+        memcpy(&cmd->raddr, &rcs->raddr, rcs->rlen);
+    }
+
+    rcs->inbuf_ppos += RTPC_BIN_FHDR_LEN + flen;
+    csp->ncmds_rcvd.cnt++;
+
+    if (rtpp_command_stream_bin_decode(cmd, cp + RTPC_BIN_FHDR_LEN, flen) != 0) {
+        RTPP_LOG(cf->stable->glog, RTPP_LOG_ERR, "binary command syntax error");
+        reply_error(cmd, ECODE_PARSE_1);
+        *rval = 0;
+        free_command(cmd);
+        return (NULL);
+    }
+    RTPP_LOG(cf->stable->glog, RTPP_LOG_DBUG, "received binary command \"%s\", "
+      "%d arguments", cmd->argv[0], cmd->argc);
+    return (cmd);
+}
+
+static struct rtpp_command *
+rtpp_command_stream_text_get(struct cfg *cf, struct rtpp_cmd_connection *rcs,
+  int *rval, double dtime, struct rtpp_command_stats *csp,
+  struct rtpc_reply *rrp)
+{
+    char **ap;
+    char *cp, *cp1;
+    int len;
+    struct rtpp_command *cmd;
+
     cp = &(rcs->inbuf[rcs->inbuf_ppos]);
     len = rcs->inbuf_epos - rcs->inbuf_ppos;
     cp1 = memchr(cp, '\n', len);
@@ -108,7 +209,7 @@ rtpp_command_stream_get(struct cfg *cf, struct rtpp_cmd_connection *rcs,
         return (NULL);
     }
 
-    cmd = rtpp_command_ctor(cf, rcs->controlfd_out, dtime, rval, csp, 0);
+    cmd = rtpp_command_ctor(cf, rcs->controlfd_out, dtime, rval, csp, 0, rrp);
     if (cmd == NULL) {
         return (NULL);
     }
@@ -142,6 +243,28 @@ rtpp_command_stream_get(struct cfg *cf, struct rtpp_cmd_connection *rcs,
         free_command(cmd);
         return (NULL);
     }
+    return (cmd);
+}
+
+struct rtpp_command *
+rtpp_command_stream_get(struct cfg *cf, struct rtpp_cmd_connection *rcs,
+  int *rval, double dtime, struct rtpp_command_stats *csp,
+  struct rtpc_reply *rrp)
+{
+    struct rtpp_command *cmd;
+
+    if (rcs->inbuf_epos == rcs->inbuf_ppos) {
+        *rval = EAGAIN;
+        return (NULL);
+    }
+    if (RTPP_CTRL_ISBIN(rcs->csock)) {
+        cmd = rtpp_command_stream_bin_get(cf, rcs, rval, dtime, csp, rrp);
+    } else {
+        cmd = rtpp_command_stream_text_get(cf, rcs, rval, dtime, csp, rrp);
+    }
+    if (cmd == NULL) {
+        return (NULL);
+    }
 
     /* Step I: parse parameters that are common to all ops */
     if (rtpp_command_pre_parse(cf, cmd) != 0) {
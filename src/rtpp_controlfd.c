@@ -157,7 +157,7 @@ controlfd_init_tcp(struct cfg *cf, struct rtpp_ctrl_sock *csp)
     if (cp == NULL || *cp == '\0')
         cp = CPORT;
     csp->port_ctl = atoi(cp);
-    i = (csp->type == RTPC_TCP6) ? AF_INET6 : AF_INET;
+    i = (csp->type == RTPC_TCP6 || csp->type == RTPC_TCP6_B) ? AF_INET6 : AF_INET;
     ifsin = sstosa(&csp->bindaddr);
     if (setbindhost(ifsin, i, csp->cmd_sock, cp) != 0)
         exit(1);
@@ -190,6 +190,7 @@ rtpp_controlfd_init(struct cfg *cf)
 
         case RTPC_IFSUN:
         case RTPC_IFSUN_C:
+        case RTPC_IFSUN_B:
             controlfd_in = controlfd_out = controlfd_init_ifsun(cf, ctrl_sock);
             break;
 
@@ -200,6 +201,8 @@ rtpp_controlfd_init(struct cfg *cf)
 
         case RTPC_TCP4:
         case RTPC_TCP6:
+        case RTPC_TCP4_B:
+        case RTPC_TCP6_B:
             controlfd_in = controlfd_out = controlfd_init_tcp(cf, ctrl_sock);
             break;
 
@@ -227,14 +230,17 @@ rtpp_csock_addrlen(struct rtpp_ctrl_sock *ctrl_sock)
     switch (ctrl_sock->type) {
     case RTPC_IFSUN:
     case RTPC_IFSUN_C:
+    case RTPC_IFSUN_B:
         return (sizeof(struct sockaddr_un));
 
     case RTPC_UDP4:
     case RTPC_TCP4:
+    case RTPC_TCP4_B:
         return (sizeof(struct sockaddr_in));
 
     case RTPC_UDP6:
     case RTPC_TCP6:
+    case RTPC_TCP6_B:
         return (sizeof(struct sockaddr_in6));
 
     default:
@@ -291,6 +297,15 @@ rtpp_ctrl_sock_parse(const char *optarg)
     } else if (strncmp("tcp6:", optarg, 5) == 0) {
         rcsp->type= RTPC_TCP6;
         optarg += 5;
+    } else if (strncmp("bunix:", optarg, 6) == 0) {
+        rcsp->type= RTPC_IFSUN_B;
+        optarg += 6;
+    } else if (strncmp("btcp:", optarg, 5) == 0) {
+        rcsp->type= RTPC_TCP4_B;
+        optarg += 5;
+    } else if (strncmp("btcp6:", optarg, 6) == 0) {
+        rcsp->type= RTPC_TCP6_B;
+        optarg += 6;
     }
     rcsp->cmd_sock = optarg;
 
@@ -326,6 +341,15 @@ rtpp_ctrl_sock_describe(struct rtpp_ctrl_sock *rcsp)
     case RTPC_TCP6:
         return "tcp6";
 
+    case RTPC_IFSUN_B:
+        return "bunix";
+
+    case RTPC_TCP4_B:
+        return "btcp";
+
+    case RTPC_TCP6_B:
+        return "btcp6";
+
     default:
         abort();
     }
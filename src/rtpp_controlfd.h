@@ -27,7 +27,7 @@
  */
 
 enum rtpp_ctrl_type {RTPC_IFSUN, RTPC_UDP4, RTPC_UDP6, RTPC_SYSD, RTPC_STDIO,
-  RTPC_IFSUN_C, RTPC_TCP4, RTPC_TCP6};
+  RTPC_IFSUN_C, RTPC_TCP4, RTPC_TCP6, RTPC_IFSUN_B, RTPC_TCP4_B, RTPC_TCP6_B};
 
 struct rtpp_ctrl_sock {
     struct rtpp_type_linkable t;
@@ -41,11 +41,14 @@ struct rtpp_ctrl_sock {
 };
 
 #define RTPP_CTRL_ISDG(rcsp) ((rcsp)->type == RTPC_UDP4 || (rcsp)->type == RTPC_UDP6)
-#define RTPP_CTRL_ISUNIX(rcsp) ((rcsp)->type == RTPC_IFSUN || (rcsp)->type == RTPC_IFSUN_C)
+#define RTPP_CTRL_ISUNIX(rcsp) ((rcsp)->type == RTPC_IFSUN || (rcsp)->type == RTPC_IFSUN_C \
+  || (rcsp)->type == RTPC_IFSUN_B)
+#define RTPP_CTRL_ISBIN(rcsp) ((rcsp)->type == RTPC_IFSUN_B || (rcsp)->type == RTPC_TCP4_B \
+  || (rcsp)->type == RTPC_TCP6_B)
 #define RTPP_CTRL_ISSTREAM(rcsp) ((rcsp)->type == RTPC_IFSUN_C || (rcsp)->type == RTPC_STDIO \
-  || (rcsp)->type == RTPC_TCP4 || (rcsp)->type == RTPC_TCP6)
+  || (rcsp)->type == RTPC_TCP4 || (rcsp)->type == RTPC_TCP6 || RTPP_CTRL_ISBIN(rcsp))
 #define RTPP_CTRL_ACCEPTABLE(rcsp) ((rcsp)->type == RTPC_IFSUN || (rcsp)->type == RTPC_IFSUN_C \
-  || (rcsp)->type == RTPC_TCP4 || (rcsp)->type == RTPC_TCP6)
+  || (rcsp)->type == RTPC_TCP4 || (rcsp)->type == RTPC_TCP6 || RTPP_CTRL_ISBIN(rcsp))
 
 int rtpp_controlfd_init(struct cfg *cf);
 struct rtpp_ctrl_sock *rtpp_ctrl_sock_parse(const char *);
@@ -44,6 +44,7 @@
 #define	CPORT		"22222"
 #define	MAX_RTP_RATE	100
 #define	POLL_RATE	(MAX_RTP_RATE * 2)	/* target number of poll(2) calls per second */
+#define	TIMED_PERIOD	0.1	/* granularity of the timed tasks, in seconds */
 #define	LOG_LEVEL	RTPP_LOG_DBUG
 #define	UPDATE_WINDOW	10.0	/* in seconds */
 #define	PCAP_FORMAT	DLT_EN10MB
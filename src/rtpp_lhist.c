@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2016 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <stdint.h>
+
+#include "rtpp_lhist.h"
+
+#define SUBB_MASK ((1 << RTPP_LHIST_SUBB) - 1)
+
+static int
+rtpp_lhist_idx(uint32_t val)
+{
+    int e;
+
+    if (val < (1 << RTPP_LHIST_SUBB))
+        return (val);
+    e = 31 - __builtin_clz(val);
+    return (((e - RTPP_LHIST_SUBB + 1) << RTPP_LHIST_SUBB) |
+      ((val >> (e - RTPP_LHIST_SUBB)) & SUBB_MASK));
+}
+
+void
+rtpp_lhist_add(struct rtpp_lhist *hp, uint32_t val)
+{
+    uint64_t *bp;
+
+    bp = &hp->bins[rtpp_lhist_idx(val)];
+    __atomic_store_n(bp, *bp + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&hp->nsamples, hp->nsamples + 1, __ATOMIC_RELAXED);
+}
+
+void
+rtpp_lhist_merge(struct rtpp_lhist *dst, const struct rtpp_lhist *src)
+{
+    int i;
+    uint64_t n;
+
+    for (i = 0; i < RTPP_LHIST_NBINS; i++) {
+        n = __atomic_load_n(&src->bins[i], __ATOMIC_RELAXED);
+        dst->bins[i] += n;
+        dst->nsamples += n;
+    }
+}
+
+/* Lowest value that falls into the bin */
+uint32_t
+rtpp_lhist_binlo(int idx)
+{
+    int shift;
+
+    if (idx < (1 << RTPP_LHIST_SUBB))
+        return (idx);
+    shift = (idx >> RTPP_LHIST_SUBB) - 1;
+    return (((1U << RTPP_LHIST_SUBB) | (idx & SUBB_MASK)) << shift);
+}
+
+/* Highest value that falls into the bin */
+uint32_t
+rtpp_lhist_binhi(int idx)
+{
+    int shift;
+
+    if (idx < (1 << RTPP_LHIST_SUBB))
+        return (idx);
+    shift = (idx >> RTPP_LHIST_SUBB) - 1;
+    return (rtpp_lhist_binlo(idx) + ((1U << shift) - 1));
+}
+
+/*
+ * Value below which the given fraction of samples lie, interpolated
+ * linearly within the bin. Returns -1 if the histogram is empty.
+ */
+double
+rtpp_lhist_pct(const struct rtpp_lhist *hp, double frac)
+{
+    uint64_t cum, rank;
+    double lo, width;
+    int i;
+
+    if (hp->nsamples == 0)
+        return (-1.0);
+    rank = (uint64_t)(frac * (double)hp->nsamples);
+    if (rank >= hp->nsamples)
+        rank = hp->nsamples - 1;
+    cum = 0;
+    for (i = 0; i < RTPP_LHIST_NBINS; i++) {
+        if (hp->bins[i] == 0 || cum + hp->bins[i] <= rank) {
+            cum += hp->bins[i];
+            continue;
+        }
+        lo = rtpp_lhist_binlo(i);
+        width = (double)rtpp_lhist_binhi(i) - lo + 1.0;
+        return (lo + width * (double)(rank - cum) / (double)hp->bins[i]);
+    }
+    return (rtpp_lhist_binhi(RTPP_LHIST_NBINS - 1));
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2016 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef _RTPP_LHIST_H_
+#define _RTPP_LHIST_H_
+
+/*
+ * Log-linear histogram of latencies in microseconds. Values below
+ * 2^RTPP_LHIST_SUBB are counted exactly, above that each power of two
+ * is split into 2^RTPP_LHIST_SUBB equal bins, which bounds the relative
+ * error of the reported percentiles at 1/2^RTPP_LHIST_SUBB.
+ *
+ * Each histogram is meant to have a single writer, counters are
+ * updated with relaxed atomic stores so that other threads can take
+ * snapshots with rtpp_lhist_merge() at any time without locking.
+ */
+#define RTPP_LHIST_SUBB  4
+#define RTPP_LHIST_NBINS ((32 - RTPP_LHIST_SUBB + 1) << RTPP_LHIST_SUBB)
+
+struct rtpp_lhist {
+    uint64_t bins[RTPP_LHIST_NBINS];
+    uint64_t nsamples;
+};
+
+void rtpp_lhist_add(struct rtpp_lhist *, uint32_t);
+void rtpp_lhist_merge(struct rtpp_lhist *, const struct rtpp_lhist *);
+uint32_t rtpp_lhist_binlo(int);
+uint32_t rtpp_lhist_binhi(int);
+double rtpp_lhist_pct(const struct rtpp_lhist *, double);
+
+#endif
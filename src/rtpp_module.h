@@ -1,8 +1,9 @@
-#define MODULE_API_REVISION 2
+#define MODULE_API_REVISION 5
 
 struct rtpp_cfg_stable;
 struct rtpp_module_priv;
 struct rtpp_acct;
+struct rtpp_sess_snap;
 
 #if !defined(MODULE_IF_CODE)
 #include <sys/types.h>
@@ -13,6 +14,10 @@ DEFINE_METHOD(rtpp_cfg_stable, rtpp_module_ctor, struct rtpp_module_priv *);
 DEFINE_METHOD(rtpp_module_priv, rtpp_module_dtor, void);
 DEFINE_METHOD(rtpp_module_priv, rtpp_module_on_session_end, void,
   struct rtpp_acct *);
+DEFINE_METHOD(rtpp_module_priv, rtpp_module_on_session_end_batch, void,
+  struct rtpp_acct * const *, int);
+DEFINE_METHOD(rtpp_module_priv, rtpp_module_on_session_interval, void,
+  const struct rtpp_sess_snap *, int);
 
 #include <stdarg.h>
 
@@ -59,6 +64,30 @@ struct api_on_sess_end {
    rtpp_module_on_session_end_t func;
 };
 
+/*
+ * Same as the above, but receives all records that have accumulated in
+ * the queue at once, in the order sessions have ended. Takes precedence
+ * over the on_session_end if both are provided.
+ */
+struct api_on_sess_end_batch {
+   int rev;
+   size_t argsize;
+   rtpp_module_on_session_end_batch_t func;
+};
+
+/*
+ * Called every "interval" seconds for each active session with the
+ * snapshot of its counters. Snapshots of a number of sessions are
+ * passed in at once, and the array is only valid for the duration
+ * of the call.
+ */
+struct api_on_sess_ival {
+   int rev;
+   size_t argsize;
+   rtpp_module_on_session_interval_t func;
+   double interval;
+};
+
 struct rtpp_minfo {
     /* Upper half, filled by the module */
     struct api_version ver;
@@ -69,6 +98,8 @@ struct rtpp_minfo {
     rtpp_module_ctor_t ctor;
     rtpp_module_dtor_t dtor;
     struct api_on_sess_end on_session_end;
+    struct api_on_sess_end_batch on_session_end_batch;
+    struct api_on_sess_ival on_session_interval;
     /* Lower half, filled by the core */
     rtpp_module_malloc_t _malloc;
     rtpp_module_zmalloc_t _zmalloc;
@@ -48,6 +48,10 @@
 #include "rtpp_acct.h"
 #include "rtpp_pcount.h"
 #include "rtpp_pcnt_strm.h"
+#include "rtpp_cfg_stable.h"
+#include "rtpp_sess_snap.h"
+#include "rtpp_sess_wheel.h"
+#include "rtpp_stats.h"
 #define MODULE_IF_CODE
 #include "rtpp_module.h"
 #include "rtpp_module_if.h"
@@ -59,21 +63,36 @@
 #include "rtpp_memdeb_internal.h"
 #endif
 
-struct rtpp_module_if_priv {
-    struct rtpp_module_if pub;
+/* State of a single loaded module, each has its own queue and worker */
+struct rtpp_mif_mod {
     void *dmp;
     struct rtpp_minfo *mip;
     struct rtpp_module_priv *mpvt;
     struct rtpp_log *log;
+    struct rtpp_stats *rtpp_stats;
     struct rtpp_wi *sigterm;
     pthread_t thread_id;
     struct rtpp_queue *req_q;
+    struct rtpp_sess_wheel *wheel;
+    /* Work items dropped because the worker has fallen behind */
+    unsigned long ndropped;
+    int ndropped_idx;
     /* Privary version of the module's memdeb_p, store it here */
     /* just in case module screws it up                        */
     void *memdeb_p;
 };
 
+struct rtpp_module_if_priv {
+    struct rtpp_module_if pub;
+    struct rtpp_log *log;
+    struct rtpp_stats *rtpp_stats;
+    int ndropped_idx;
+    int nmods;
+    struct rtpp_mif_mod *mods[RTPP_MODULES_MAX];
+};
+
 static void rtpp_mif_dtor(struct rtpp_module_if_priv *);
+static void rtpp_mif_mod_dtor(struct rtpp_mif_mod *);
 #if !RTPP_CHECK_LEAKS
 static int rtpp_module_asprintf(char **, const char *, void *, const char *,
   int, const char *, ...);
@@ -81,28 +100,70 @@ static int rtpp_module_vasprintf(char **, const char *, void *, const char *,
   int, const char *, va_list);
 #endif
 static void rtpp_mif_run(void *);
+static int rtpp_mif_load(struct rtpp_module_if *, struct rtpp_cfg_stable *,
+  const char *);
 static void rtpp_mif_do_acct(struct rtpp_module_if *, struct rtpp_acct *);
+static void rtpp_mif_do_ival(void *, struct rtpp_sess_snap *, int);
 
 #define PUB2PVT(pubp) \
   ((struct rtpp_module_if_priv *)((char *)(pubp) - offsetof(struct rtpp_module_if_priv, pub)))
 
 static const char *do_acct_aname = "do_acct";
+static const char *do_ival_aname = "do_ival";
+
+struct rtpp_mif_ival {
+    struct rtpp_sess_snap *snaps;
+    int nsnaps;
+};
+
+/* Max number of accounting records handed over to the module at once */
+#define RTPP_MIF_BATCH 64
+
+/*
+ * Max number of work items waiting for each module, anything in excess
+ * of that is dropped, so that a slow module cannot eat all the memory.
+ */
+#define RTPP_MIF_QLEN 4096
 
 struct rtpp_module_if *
-rtpp_module_if_ctor(struct rtpp_cfg_stable *cfsp, struct rtpp_log *log,
-  const char *mpath)
+rtpp_module_if_ctor(struct rtpp_log *log, struct rtpp_stats *rtpp_stats)
 {
     struct rtpp_refcnt *rcnt;
     struct rtpp_module_if_priv *pvt;
-    const char *derr;
 
     pvt = rtpp_rzmalloc(sizeof(struct rtpp_module_if_priv), &rcnt);
     if (pvt == NULL) {
-        goto e0;
+        return (NULL);
     }
     pvt->pub.rcnt = rcnt;
-    pvt->dmp = dlopen(mpath, RTLD_NOW);
-    if (pvt->dmp == NULL) {
+    CALL_SMETHOD(log->rcnt, incref);
+    pvt->log = log;
+    pvt->rtpp_stats = rtpp_stats;
+    pvt->ndropped_idx = CALL_METHOD(rtpp_stats, getidxbyname,
+      "nmod_reqs_dropped");
+    pvt->pub.load = &rtpp_mif_load;
+    pvt->pub.do_acct = &rtpp_mif_do_acct;
+    CALL_SMETHOD(pvt->pub.rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_mif_dtor,
+      pvt);
+    return ((&pvt->pub));
+}
+
+static struct rtpp_mif_mod *
+rtpp_mif_mod_ctor(struct rtpp_module_if_priv *pvt,
+  struct rtpp_cfg_stable *cfsp, const char *mpath)
+{
+    struct rtpp_mif_mod *mp;
+    struct rtpp_log *log;
+    const char *derr;
+    int i;
+
+    log = pvt->log;
+    mp = rtpp_zmalloc(sizeof(struct rtpp_mif_mod));
+    if (mp == NULL) {
+        goto e0;
+    }
+    mp->dmp = dlopen(mpath, RTLD_NOW);
+    if (mp->dmp == NULL) {
         derr = dlerror();
         if (strstr(derr, mpath) == NULL) {
             RTPP_LOG(log, RTPP_LOG_ERR, "can't dlopen(%s): %s", mpath, derr);
@@ -111,8 +172,8 @@ rtpp_module_if_ctor(struct rtpp_cfg_stable *cfsp, struct rtpp_log *log,
         }
         goto e1;
     }
-    pvt->mip = dlsym(pvt->dmp, "rtpp_module");
-    if (pvt->mip == NULL) {
+    mp->mip = dlsym(mp->dmp, "rtpp_module");
+    if (mp->mip == NULL) {
         derr = dlerror();
         if (strstr(derr, mpath) == NULL) {
             RTPP_LOG(log, RTPP_LOG_ERR, "can't find 'rtpp_module' symbol in the %s"
@@ -123,168 +184,327 @@ rtpp_module_if_ctor(struct rtpp_cfg_stable *cfsp, struct rtpp_log *log,
         }
         goto e2;
     }
-    if (!MI_VER_CHCK(pvt->mip)) {
+    for (i = 0; i < pvt->nmods; i++) {
+        /* dlopen() hands out the same object for the same module */
+        if (pvt->mods[i]->mip == mp->mip) {
+            RTPP_LOG(log, RTPP_LOG_ERR, "%s: module '%s' is already loaded",
+              mpath, mp->mip->name);
+            goto e2;
+        }
+    }
+    if (!MI_VER_CHCK(mp->mip)) {
         RTPP_LOG(log, RTPP_LOG_ERR, "incompatible API version in the %s, "
           "consider recompiling the module", mpath);
         goto e2;
     }
 
 #if RTPP_CHECK_LEAKS
-    pvt->mip->_malloc = &rtpp_memdeb_malloc;
-    pvt->mip->_zmalloc = &rtpp_zmalloc_memdeb;
-    pvt->mip->_free = &rtpp_memdeb_free;
-    pvt->mip->_realloc = &rtpp_memdeb_realloc;
-    pvt->mip->_strdup = &rtpp_memdeb_strdup;
-    pvt->mip->_asprintf = &rtpp_memdeb_asprintf;
-    pvt->mip->_vasprintf = &rtpp_memdeb_vasprintf;
-    pvt->memdeb_p = rtpp_memdeb_init();
-    rtpp_memdeb_setlog(pvt->memdeb_p, log);
-    if (pvt->memdeb_p == NULL) {
+    mp->mip->_malloc = &rtpp_memdeb_malloc;
+    mp->mip->_zmalloc = &rtpp_zmalloc_memdeb;
+    mp->mip->_free = &rtpp_memdeb_free;
+    mp->mip->_realloc = &rtpp_memdeb_realloc;
+    mp->mip->_strdup = &rtpp_memdeb_strdup;
+    mp->mip->_asprintf = &rtpp_memdeb_asprintf;
+    mp->mip->_vasprintf = &rtpp_memdeb_vasprintf;
+    mp->memdeb_p = rtpp_memdeb_init();
+    rtpp_memdeb_setlog(mp->memdeb_p, log);
+    if (mp->memdeb_p == NULL) {
         goto e2;
     }
     /* We make a copy, so that the module cannot screw us up */
-    pvt->mip->memdeb_p = pvt->memdeb_p;
+    mp->mip->memdeb_p = mp->memdeb_p;
 #else
-    pvt->mip->_malloc = (rtpp_module_malloc_t)&malloc;
-    pvt->mip->_zmalloc = (rtpp_module_zmalloc_t)&rtpp_zmalloc;
-    pvt->mip->_free = (rtpp_module_free_t)&free;
-    pvt->mip->_realloc = (rtpp_module_realloc_t)&realloc;
-    pvt->mip->_strdup = (rtpp_module_strdup_t)&strdup;
-    pvt->mip->_asprintf = rtpp_module_asprintf;
-    pvt->mip->_vasprintf = rtpp_module_vasprintf;
+    mp->mip->_malloc = (rtpp_module_malloc_t)&malloc;
+    mp->mip->_zmalloc = (rtpp_module_zmalloc_t)&rtpp_zmalloc;
+    mp->mip->_free = (rtpp_module_free_t)&free;
+    mp->mip->_realloc = (rtpp_module_realloc_t)&realloc;
+    mp->mip->_strdup = (rtpp_module_strdup_t)&strdup;
+    mp->mip->_asprintf = rtpp_module_asprintf;
+    mp->mip->_vasprintf = rtpp_module_vasprintf;
 #endif
-    pvt->sigterm = rtpp_wi_malloc_sgnl(SIGTERM, NULL, 0);
-    if (pvt->sigterm == NULL) {
+    mp->sigterm = rtpp_wi_malloc_sgnl(SIGTERM, NULL, 0);
+    if (mp->sigterm == NULL) {
         goto e3;
     }
-    pvt->req_q = rtpp_queue_init(1, "rtpp_module_if(%s)", pvt->mip->name);
-    if (pvt->req_q == NULL) {
+    mp->req_q = rtpp_queue_init(1, "rtpp_module_if(%s)", mp->mip->name);
+    if (mp->req_q == NULL) {
         goto e4;
     }
-    if (pvt->mip->ctor != NULL) {
-        pvt->mpvt = pvt->mip->ctor(cfsp);
-        if (pvt->mpvt == NULL) {
+    if (mp->mip->ctor != NULL) {
+        mp->mpvt = mp->mip->ctor(cfsp);
+        if (mp->mpvt == NULL) {
             RTPP_LOG(log, RTPP_LOG_ERR, "module '%s' failed to initialize",
-              pvt->mip->name);
+              mp->mip->name);
             goto e5;
         }
     }
-    if (pvt->mip->on_session_end.argsize != rtpp_acct_OSIZE()) {
+    if ((mp->mip->on_session_end.func != NULL &&
+      mp->mip->on_session_end.argsize != rtpp_acct_OSIZE()) ||
+      (mp->mip->on_session_end_batch.func != NULL &&
+      mp->mip->on_session_end_batch.argsize != rtpp_acct_OSIZE())) {
         RTPP_LOG(log, RTPP_LOG_ERR, "incompatible API version in the %s, "
           "consider recompiling the module", mpath);
         goto e6;
     }
-
-    if (pthread_create(&pvt->thread_id, NULL,
-      (void *(*)(void *))&rtpp_mif_run, pvt) != 0) {
+    if (mp->mip->on_session_interval.func != NULL &&
+      (mp->mip->on_session_interval.argsize != rtpp_sess_snap_OSIZE() ||
+      mp->mip->on_session_interval.interval <= 0.0)) {
+        RTPP_LOG(log, RTPP_LOG_ERR, "incompatible API version in the %s, "
+          "consider recompiling the module", mpath);
         goto e6;
     }
-    CALL_SMETHOD(log->rcnt, incref);
-    pvt->log = log;
-    pvt->pub.do_acct = &rtpp_mif_do_acct;
-    CALL_SMETHOD(pvt->pub.rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_mif_dtor,
-      pvt);
-    return ((&pvt->pub));
+
+    mp->log = log;
+    mp->rtpp_stats = pvt->rtpp_stats;
+    mp->ndropped_idx = pvt->ndropped_idx;
+    if (mp->mip->on_session_interval.func != NULL) {
+        mp->wheel = rtpp_sess_wheel_ctor(cfsp->sessions_wrt,
+          cfsp->rtpp_timed_cf, mp->mip->on_session_interval.interval,
+          rtpp_mif_do_ival, mp);
+        if (mp->wheel == NULL) {
+            goto e6;
+        }
+    }
+    if (pthread_create(&mp->thread_id, NULL,
+      (void *(*)(void *))&rtpp_mif_run, mp) != 0) {
+        goto e7;
+    }
+    return (mp);
+e7:
+    if (mp->wheel != NULL) {
+        CALL_METHOD(mp->wheel, shutdown);
+        CALL_SMETHOD(mp->wheel->rcnt, decref);
+    }
 e6:
-    if (pvt->mip->dtor != NULL) {
-        pvt->mip->dtor(pvt->mpvt);
+    if (mp->mip->dtor != NULL) {
+        mp->mip->dtor(mp->mpvt);
     }
 e5:
-    rtpp_queue_destroy(pvt->req_q);
+    rtpp_queue_destroy(mp->req_q);
 #if RTPP_CHECK_LEAKS
-    if (rtpp_memdeb_dumpstats(pvt->memdeb_p, 1) != 0) {
+    if (rtpp_memdeb_dumpstats(mp->memdeb_p, 1) != 0) {
         RTPP_LOG(log, RTPP_LOG_ERR, "module '%s' leaked memory in the failed "
-          "constructor", pvt->mip->name);
+          "constructor", mp->mip->name);
     }
 #endif
 e4:
-    rtpp_wi_free(pvt->sigterm);
+    rtpp_wi_free(mp->sigterm);
 e3:
 #if RTPP_CHECK_LEAKS
-    rtpp_memdeb_dtor(pvt->memdeb_p);
+    rtpp_memdeb_dtor(mp->memdeb_p);
 #endif
 e2:
-    dlclose(pvt->dmp);
+    dlclose(mp->dmp);
 e1:
-    CALL_SMETHOD(rcnt, decref);
-    free(pvt);
+    free(mp);
 e0:
     return (NULL);
 }
 
+static int
+rtpp_mif_load(struct rtpp_module_if *self, struct rtpp_cfg_stable *cfsp,
+  const char *mpath)
+{
+    struct rtpp_module_if_priv *pvt;
+    struct rtpp_mif_mod *mp;
+
+    pvt = PUB2PVT(self);
+    if (pvt->nmods == RTPP_MODULES_MAX) {
+        RTPP_LOG(pvt->log, RTPP_LOG_ERR, "%s: too many modules", mpath);
+        return (-1);
+    }
+    mp = rtpp_mif_mod_ctor(pvt, cfsp, mpath);
+    if (mp == NULL) {
+        return (-1);
+    }
+    pvt->mods[pvt->nmods] = mp;
+    pvt->nmods++;
+    return (0);
+}
+
 static void
-rtpp_mif_dtor(struct rtpp_module_if_priv *pvt)
+rtpp_mif_mod_dtor(struct rtpp_mif_mod *mp)
 {
 
-    rtpp_module_if_fin(&(pvt->pub));
-    /* First, stop the worker thread and wait for it to terminate */
-    rtpp_queue_put_item(pvt->sigterm, pvt->req_q);
-    pthread_join(pvt->thread_id, NULL);
-    rtpp_queue_destroy(pvt->req_q);
+    /* First, stop taking snapshots, so that nothing new gets queued */
+    if (mp->wheel != NULL) {
+        CALL_METHOD(mp->wheel, shutdown);
+        CALL_SMETHOD(mp->wheel->rcnt, decref);
+    }
+    /* Then, stop the worker thread and wait for it to terminate */
+    rtpp_queue_put_item(mp->sigterm, mp->req_q);
+    pthread_join(mp->thread_id, NULL);
+    rtpp_queue_destroy(mp->req_q);
+    if (mp->ndropped > 0) {
+        RTPP_LOG(mp->log, RTPP_LOG_ERR, "module '%s' has fallen behind, %lu "
+          "requests dropped", mp->mip->name, mp->ndropped);
+    }
 
     /* Then run module destructor (if any) */
-    if (pvt->mip->dtor != NULL) {
-        pvt->mip->dtor(pvt->mpvt);
+    if (mp->mip->dtor != NULL) {
+        mp->mip->dtor(mp->mpvt);
     }
 
 #if RTPP_CHECK_LEAKS
     /* Check if module leaked any mem */
-    if (rtpp_memdeb_dumpstats(pvt->memdeb_p, 1) != 0) {
-        RTPP_LOG(pvt->log, RTPP_LOG_ERR, "module '%s' leaked memory after "
-          "destruction", pvt->mip->name);
+    if (rtpp_memdeb_dumpstats(mp->memdeb_p, 1) != 0) {
+        RTPP_LOG(mp->log, RTPP_LOG_ERR, "module '%s' leaked memory after "
+          "destruction", mp->mip->name);
     }
-    rtpp_memdeb_dtor(pvt->memdeb_p);
+    rtpp_memdeb_dtor(mp->memdeb_p);
 #endif
     /* Unload and free everything */
-    dlclose(pvt->dmp);
+    dlclose(mp->dmp);
+    free(mp);
+}
+
+static void
+rtpp_mif_dtor(struct rtpp_module_if_priv *pvt)
+{
+    int i;
+
+    rtpp_module_if_fin(&(pvt->pub));
+    for (i = pvt->nmods - 1; i >= 0; i--) {
+        rtpp_mif_mod_dtor(pvt->mods[i]);
+    }
     CALL_SMETHOD(pvt->log->rcnt, decref);
     free(pvt);
 }
 
+static void
+rtpp_mif_deliver(struct rtpp_mif_mod *mp, struct rtpp_acct **raps,
+  int nraps)
+{
+    int i;
+
+    if (nraps == 0)
+        return;
+    if (mp->mip->on_session_end_batch.func != NULL) {
+        mp->mip->on_session_end_batch.func(mp->mpvt,
+          (struct rtpp_acct * const *)raps, nraps);
+    } else if (mp->mip->on_session_end.func != NULL) {
+        for (i = 0; i < nraps; i++) {
+            mp->mip->on_session_end.func(mp->mpvt, raps[i]);
+        }
+    }
+    for (i = 0; i < nraps; i++) {
+        CALL_SMETHOD(raps[i]->rcnt, decref);
+    }
+}
+
 static void
 rtpp_mif_run(void *argp)
 {
-    struct rtpp_module_if_priv *pvt;
-    struct rtpp_wi *wi;
-    int signum;
+    struct rtpp_mif_mod *mp;
+    struct rtpp_wi *wis[RTPP_MIF_BATCH], *wi;
+    int signum, i, nwis, nraps, done;
     const char *aname;
-    struct rtpp_acct *rap;
+    struct rtpp_acct *rap, *raps[RTPP_MIF_BATCH];
+    struct rtpp_mif_ival ival;
 
-    pvt = (struct rtpp_module_if_priv *)argp;
-    for (;;) {
-        wi = rtpp_queue_get_item(pvt->req_q, 0);
-        if (rtpp_wi_get_type(wi) == RTPP_WI_TYPE_SGNL) {
-            signum = rtpp_wi_sgnl_get_signum(wi);
-            rtpp_wi_free(wi);
-            if (signum == SIGTERM) {
-                break;
+    mp = (struct rtpp_mif_mod *)argp;
+    /*
+     * Once SIGTERM has been seen keep going until the queue is empty,
+     * every work item holds a reference to the record it carries, so
+     * anything left behind would be leaked and never reach the module.
+     */
+    for (done = 0; done == 0 || rtpp_queue_get_length(mp->req_q) > 0;) {
+        nwis = rtpp_queue_get_items(mp->req_q, wis, RTPP_MIF_BATCH, 0);
+        nraps = 0;
+        for (i = 0; i < nwis; i++) {
+            wi = wis[i];
+            if (rtpp_wi_get_type(wi) == RTPP_WI_TYPE_SGNL) {
+                signum = rtpp_wi_sgnl_get_signum(wi);
+                rtpp_wi_free(wi);
+                if (signum == SIGTERM) {
+                    /* Process the rest of the batch as usual */
+                    done = 1;
+                }
+                continue;
             }
-            continue;
-        }
-        aname = rtpp_wi_apis_getnamearg(wi, (void **)&rap, sizeof(rap));
-        if (aname == do_acct_aname) {
-            pvt->mip->on_session_end.func(pvt->mpvt, rap);
+            aname = rtpp_wi_apis_getname(wi);
+            if (aname == do_ival_aname) {
+                rtpp_wi_apis_getnamearg(wi, (void **)&ival, sizeof(ival));
+                /* Keep snapshots in order with the final records */
+                rtpp_mif_deliver(mp, raps, nraps);
+                nraps = 0;
+                mp->mip->on_session_interval.func(mp->mpvt, ival.snaps,
+                  ival.nsnaps);
+                free(ival.snaps);
+            } else if (aname == do_acct_aname) {
+                rtpp_wi_apis_getnamearg(wi, (void **)&rap, sizeof(rap));
+                raps[nraps++] = rap;
+            }
+            rtpp_wi_free(wi);
         }
-        CALL_SMETHOD(rap->rcnt, decref);
-        rtpp_wi_free(wi);
+        rtpp_mif_deliver(mp, raps, nraps);
     }
 }
 
+static int
+rtpp_mif_mod_put(struct rtpp_mif_mod *mp, struct rtpp_wi *wi)
+{
+
+    if (rtpp_queue_get_length(mp->req_q) >= RTPP_MIF_QLEN) {
+        __atomic_add_fetch(&mp->ndropped, 1, __ATOMIC_RELAXED);
+        CALL_METHOD(mp->rtpp_stats, updatebyidx, mp->ndropped_idx, 1);
+        return (-1);
+    }
+    rtpp_queue_put_item(wi, mp->req_q);
+    return (0);
+}
+
 static void
 rtpp_mif_do_acct(struct rtpp_module_if *self, struct rtpp_acct *acct)
 {
     struct rtpp_module_if_priv *pvt;
+    struct rtpp_mif_mod *mp;
     struct rtpp_wi *wi;
+    int i;
 
     pvt = PUB2PVT(self);
-    wi = rtpp_wi_malloc_apis(do_acct_aname, &acct, sizeof(acct));
+    /* The record is shared by all modules, each gets its own reference */
+    for (i = 0; i < pvt->nmods; i++) {
+        mp = pvt->mods[i];
+        if (mp->mip->on_session_end.func == NULL &&
+          mp->mip->on_session_end_batch.func == NULL) {
+            continue;
+        }
+        wi = rtpp_wi_malloc_apis(do_acct_aname, &acct, sizeof(acct));
+        if (wi == NULL) {
+            RTPP_LOG(pvt->log, RTPP_LOG_ERR, "module '%s': cannot allocate "
+              "memory", mp->mip->name);
+            continue;
+        }
+        CALL_SMETHOD(acct->rcnt, incref);
+        if (rtpp_mif_mod_put(mp, wi) != 0) {
+            CALL_SMETHOD(acct->rcnt, decref);
+            rtpp_wi_free(wi);
+        }
+    }
+}
+
+static void
+rtpp_mif_do_ival(void *arg, struct rtpp_sess_snap *snaps, int nsnaps)
+{
+    struct rtpp_mif_mod *mp;
+    struct rtpp_mif_ival ival;
+    struct rtpp_wi *wi;
+
+    mp = (struct rtpp_mif_mod *)arg;
+    ival.snaps = snaps;
+    ival.nsnaps = nsnaps;
+    wi = rtpp_wi_malloc_apis(do_ival_aname, &ival, sizeof(ival));
     if (wi == NULL) {
-        RTPP_LOG(pvt->log, RTPP_LOG_ERR, "module '%s': cannot allocate "
-          "memory", pvt->mip->name);
+        RTPP_LOG(mp->log, RTPP_LOG_ERR, "module '%s': cannot allocate "
+          "memory", mp->mip->name);
+        free(snaps);
         return;
     }
-    CALL_SMETHOD(acct->rcnt, incref);
-    rtpp_queue_put_item(wi, pvt->req_q);
+    if (rtpp_mif_mod_put(mp, wi) != 0) {
+        rtpp_wi_free(wi);
+        free(snaps);
+    }
 }
 
 #if !RTPP_CHECK_LEAKS
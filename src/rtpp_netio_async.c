@@ -25,8 +25,14 @@
  *
  */
 
+#if defined(LINUX_XXX) && !defined(_GNU_SOURCE)
+/* sendmmsg(2) */
+#define _GNU_SOURCE
+#endif
+
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <errno.h>
 #include <pthread.h>
 #include <sched.h>
@@ -48,6 +54,7 @@
 #include "rtpp_queue.h"
 #include "rtpp_network.h"
 #include "rtpp_netio_async.h"
+#include "rtpp_lhist.h"
 #include "rtpp_time.h"
 #include "rtpp_mallocs.h"
 #include "rtpp_debug.h"
@@ -63,6 +70,9 @@ struct sthread_args {
     struct recfilter average_load;
 #endif
     struct rtpp_wi *sigterm;
+    int rlat_sample;
+    int rlat_skip;
+    struct rtpp_lhist rlat;
 };
 
 #define SEND_THREADS 1
@@ -73,12 +83,82 @@ struct rtpp_anetio_cf {
 };
 
 #define RTPP_ANETIO_MAX_RETRY 3
+#define RTPP_ANETIO_BATCH     100
+
+#if defined(MSG_WAITFORONE)
+#define RTPP_ANETIO_HAVE_MMSG 1
+
+/*
+ * Push run of datagrams queued for the same socket with a single
+ * sendmmsg(2) call. Anything that has not been sent here (errors, short
+ * batch or duplicate send in the -2 mode) is left for the per-datagram
+ * sendto(2) loop to deal with.
+ */
+static void
+rtpp_anetio_sendmmsg(struct rtpp_wi *wis[], int nwis)
+{
+    struct mmsghdr mmsgs[RTPP_ANETIO_BATCH];
+    struct iovec iovs[RTPP_ANETIO_BATCH];
+    int i, n;
+
+    for (i = 0; i < nwis; i++) {
+        iovs[i].iov_base = wis[i]->msg;
+        iovs[i].iov_len = wis[i]->msg_len;
+        memset(&mmsgs[i], '\0', sizeof(mmsgs[i]));
+        mmsgs[i].msg_hdr.msg_name = (void *)wis[i]->sendto;
+        mmsgs[i].msg_hdr.msg_namelen = wis[i]->tolen;
+        mmsgs[i].msg_hdr.msg_iov = &iovs[i];
+        mmsgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    n = sendmmsg(wis[0]->sock, mmsgs, nwis, wis[0]->flags);
+    for (i = 0; i < n; i++) {
+        wis[i]->nsend--;
+    }
+}
+#endif
+
+/*
+ * Account time the relayed packet has spent in the rtpproxy, from the
+ * kernel receive timestamp to the moment it's been handed back over to
+ * the kernel. Locally generated packets have no receive time and are
+ * skipped, as are plain buffers queued via rtpp_anetio_sendto() and
+ * rtpp_anetio_send_buf().
+ */
+static void
+rtpp_anetio_rlat_reg(struct sthread_args *args, struct rtpp_wi *wi,
+  double *dtimep)
+{
+    struct rtp_packet *pkt;
+    double lat;
+
+    if (wi->free_ptr == (void *)wi) {
+        /* Raw buffer, not a packet */
+        return;
+    }
+    pkt = (struct rtp_packet *)wi->free_ptr;
+    if (pkt->rtime <= 0)
+        return;
+    if (args->rlat_skip > 0) {
+        args->rlat_skip--;
+        return;
+    }
+    args->rlat_skip = args->rlat_sample - 1;
+    if (*dtimep == 0)
+        *dtimep = getdtime();
+    lat = *dtimep - pkt->rtime;
+    if (lat < 0)
+        lat = 0;
+    else if (lat > (double)UINT32_MAX / 1000000.0)
+        lat = (double)UINT32_MAX / 1000000.0;
+    rtpp_lhist_add(&args->rlat, (uint32_t)(lat * 1000000.0));
+}
 
 static void
 rtpp_anetio_sthread(struct sthread_args *args)
 {
-    int n, nsend, i, send_errno, nretry;
-    struct rtpp_wi *wi, *wis[100];
+    int n, nsend, i, j, send_errno, nretry;
+    struct rtpp_wi *wi, *wis[RTPP_ANETIO_BATCH];
+    double stime;
 #if RTPP_DEBUG_timers
     double tp[3], runtime, sleeptime;
     long run_n;
@@ -88,11 +168,26 @@ rtpp_anetio_sthread(struct sthread_args *args)
     tp[0] = getdtime();
 #endif
     for (;;) {
-        nsend = rtpp_queue_get_items(args->out_q, wis, 100, 0);
+        nsend = rtpp_queue_get_items(args->out_q, wis, RTPP_ANETIO_BATCH, 0);
 #if RTPP_DEBUG_timers
         tp[1] = getdtime();
 #endif
 
+#if defined(RTPP_ANETIO_HAVE_MMSG)
+        for (i = 0; i < nsend; i = j) {
+            wi = wis[i];
+            for (j = i + 1; j < nsend; j++) {
+                if (wis[j]->wi_type != RTPP_WI_TYPE_OPKT || wis[j]->sock != wi->sock ||
+                  wis[j]->flags != wi->flags)
+                    break;
+            }
+            if (wi->wi_type == RTPP_WI_TYPE_OPKT && j - i > 1) {
+                rtpp_anetio_sendmmsg(&wis[i], j - i);
+            }
+        }
+#endif
+
+        stime = 0;
         for (i = 0; i < nsend; i++) {
 	    wi = wis[i];
             if (wi->wi_type == RTPP_WI_TYPE_SGNL) {
@@ -100,7 +195,7 @@ rtpp_anetio_sthread(struct sthread_args *args)
                 goto out;
             }
             nretry = 0;
-            do {
+            while (wi->nsend > 0) {
                 n = sendto(wi->sock, wi->msg, wi->msg_len, wi->flags,
                   wi->sendto, wi->tolen);
                 send_errno = (n < 0) ? errno : 0;
@@ -141,7 +236,11 @@ rtpp_anetio_sthread(struct sthread_args *args)
                         break;
                     }
                 }
-            } while (wi->nsend > 0);
+            }
+            if (wi->wi_type == RTPP_WI_TYPE_OPKT && wi->nsend == 0 &&
+              args->rlat_sample > 0) {
+                rtpp_anetio_rlat_reg(args, wi, &stime);
+            }
             rtpp_wi_free(wi);
         }
 #if RTPP_DEBUG_timers
@@ -188,6 +287,33 @@ rtpp_anetio_sendto(struct rtpp_anetio_cf *netio_cf, int sock, const void *msg, \
     return (0);
 }
 
+/*
+ * Queue a copy of the buffer to be sent by the sender thread, keeping
+ * the sock_rcnt referenced until it's done. The sendto may be NULL if the
+ * socket is connected.
+ */
+int
+rtpp_anetio_send_buf(struct sthread_args *sender, int sock, const void *msg,
+  size_t msg_len, const struct sockaddr *sendto, socklen_t tolen,
+  struct rtpp_refcnt *sock_rcnt)
+{
+    struct rtpp_wi *wi;
+
+    wi = rtpp_wi_malloc(sock, msg, msg_len, 0, sendto, tolen);
+    if (wi == NULL) {
+        return (-1);
+    }
+    if (tolen == 0) {
+        wi->sendto = NULL;
+    }
+    if (sock_rcnt != NULL) {
+        CALL_SMETHOD(sock_rcnt, incref);
+        wi->sock_rcnt = sock_rcnt;
+    }
+    rtpp_queue_put_item(wi, sender->out_q);
+    return (0);
+}
+
 void
 rtpp_anetio_pump(struct rtpp_anetio_cf *netio_cf)
 {
@@ -319,6 +445,7 @@ rtpp_netio_async_init(struct cfg *cf, int qlen)
         CALL_SMETHOD(cf->stable->glog->rcnt, incref);
         netio_cf->args[i].glog = cf->stable->glog;
         netio_cf->args[i].dmode = cf->stable->dmode;
+        netio_cf->args[i].rlat_sample = cf->stable->rlat_sample;
 #if RTPP_DEBUG_timers
         recfilter_init(&netio_cf->args[i].average_load, 0.9, 0.0, 0);
 #endif
@@ -366,6 +493,20 @@ e0:
     return (NULL);
 }
 
+/*
+ * Merge relay latency histograms of all sender threads into the one
+ * provided.
+ */
+void
+rtpp_anetio_get_rlat(struct rtpp_anetio_cf *netio_cf, struct rtpp_lhist *hp)
+{
+    int i;
+
+    for (i = 0; i < SEND_THREADS; i++) {
+        rtpp_lhist_merge(hp, &netio_cf->args[i].rlat);
+    }
+}
+
 void
 rtpp_netio_async_destroy(struct rtpp_anetio_cf *netio_cf)
 {
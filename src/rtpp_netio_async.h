@@ -34,6 +34,7 @@ struct rtpp_queue;
 struct sthread_args;
 struct rtpp_log;
 struct rtpp_netaddr;
+struct rtpp_lhist;
 
 int rtpp_anetio_sendto(struct rtpp_anetio_cf *, int, const void *, \
   size_t, int, const struct sockaddr *, socklen_t);
@@ -43,9 +44,12 @@ int rtpp_anetio_send_pkt(struct sthread_args *, int, \
 int rtpp_anetio_send_pkt_na(struct sthread_args *, int, \
   struct rtpp_netaddr *, struct rtp_packet *,
   struct rtpp_refcnt *, struct rtpp_log *);
+int rtpp_anetio_send_buf(struct sthread_args *, int, const void *, size_t,
+  const struct sockaddr *, socklen_t, struct rtpp_refcnt *);
 void rtpp_anetio_pump(struct rtpp_anetio_cf *);
 void rtpp_anetio_pump_q(struct sthread_args *);
 struct sthread_args *rtpp_anetio_pick_sender(struct rtpp_anetio_cf *);
+void rtpp_anetio_get_rlat(struct rtpp_anetio_cf *, struct rtpp_lhist *);
 
 struct rtpp_anetio_cf *rtpp_netio_async_init(struct cfg *cf, int);
 void rtpp_netio_async_destroy(struct rtpp_anetio_cf *);
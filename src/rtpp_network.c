@@ -283,6 +283,27 @@ rtpp_in_cksum(void *p, int len)
     return (0xffff & ~sum);
 }
 
+/*
+ * Same as above, but specialized for the 20-byte IPv4 header without
+ * options: the header is summed as five 32-bit words in a 64-bit
+ * accumulator and the carries are folded back at the end. Does not care
+ * about the alignment of the header.
+ */
+uint16_t
+rtpp_in_cksum_ip4(const void *p)
+{
+    uint32_t w[5];
+    uint64_t sum;
+
+    memcpy(w, p, sizeof(w));
+    sum = (uint64_t)w[0] + w[1] + w[2] + w[3] + w[4];
+    sum = (sum >> 32) + (sum & 0xffffffff);
+    sum = (sum >> 16) + (sum & 0xffff);
+    sum = (sum >> 16) + (sum & 0xffff);
+    sum += sum >> 16;
+    return (0xffff & ~sum);
+}
+
 int
 local4remote(const struct sockaddr *ra, struct sockaddr_storage *la)
 {
@@ -49,6 +49,7 @@ char *addr2char_r(struct sockaddr *, char *buf, int size);
 char *addrport2char_r(struct sockaddr *, char *buf, int size, char);
 int resolve(struct sockaddr *, int, const char *, const char *, int);
 uint16_t rtpp_in_cksum(void *, int);
+uint16_t rtpp_in_cksum_ip4(const void *);
 int local4remote(const struct sockaddr *, struct sockaddr_storage *);
 int extractaddr(const char *, char **, char **, int *);
 int setbindhost(struct sockaddr *, int, const char *, const char *);
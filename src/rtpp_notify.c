@@ -34,6 +34,8 @@
 #include <netinet/in.h>
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stddef.h>
@@ -51,6 +53,7 @@
 #include "rtpp_queue.h"
 #include "rtpp_tnotify_tgt.h"
 #include "rtpp_mallocs.h"
+#include "rtpp_time.h"
 #include "rtpp_wi.h"
 #include "rtpp_wi_private.h"
 
@@ -61,12 +64,56 @@ struct rtpp_notify_wi
     char notify_buf[0];
 };
 
+/*
+ * Notifications are queued per target and whatever has accumulated for
+ * the target by the time its socket becomes writable goes out in a
+ * single send(). Connects are non-blocking, so a target that is slow to
+ * respond or down does not hold up the others. A target that has failed
+ * RTPP_NOTIFY_BRK_THRS times in a row is put on hold for a while
+ * (circuit breaker), with notifications to it being dropped until the
+ * hold time expires, at which point we try to connect again. A connect
+ * that has not completed within RTPP_NOTIFY_CONN_TOUT counts as a
+ * failure. Only whole lines are ever taken off the target's buffer, so
+ * that a notification that has been partially sent when the connection
+ * is lost goes out in full over the next one.
+ */
+#define RTPP_NOTIFY_BATCH      32
+#define RTPP_NOTIFY_POLL_IVAL  100      /* ms */
+#define RTPP_NOTIFY_BRK_THRS   3
+#define RTPP_NOTIFY_BRK_HOLD   1.0      /* s, doubles on every failure */
+#define RTPP_NOTIFY_BRK_MAXHOLD 30.0
+#define RTPP_NOTIFY_OBUF_MAX   (64 * 1024)
+#define RTPP_NOTIFY_DRAIN_TOUT 1.0      /* s, upon shutdown */
+#define RTPP_NOTIFY_CONN_TOUT  3.0      /* s */
+
+enum rtpp_notify_tstate {TS_IDLE = 0, TS_CONNECTING, TS_CONNECTED};
+
+struct rtpp_notify_target {
+    struct rtpp_tnotify_target *rttp;
+    enum rtpp_notify_tstate state;
+    char *obuf;
+    size_t olen;
+    size_t oalen;
+    /* Bytes of the first line in obuf sent over the current connection */
+    size_t ooff;
+    double conn_until;
+    int nfails;
+    double hold_until;
+    unsigned long ndropped;
+};
+
 struct rtpp_notify_priv {
     struct rtpp_notify pub;
     struct rtpp_queue *nqueue;
     struct rtpp_wi *sigterm;
     pthread_t thread_id;
     struct rtpp_log *glog;
+    /* Only accessed by the notification thread */
+    struct rtpp_notify_target *tgts;
+    int ntgts;
+    int atgts;
+    struct pollfd *pfds;
+    struct rtpp_notify_target **ptgts;
 };
 
 #define PUB2PVT(pubp)      ((struct rtpp_notify_priv *)((char *)(pubp) - offsetof(struct rtpp_notify_priv, pub)))
@@ -74,29 +121,60 @@ struct rtpp_notify_priv {
 static int rtpp_notify_schedule(struct rtpp_notify *,
   struct rtpp_tnotify_target *, const char *);
 static void rtpp_notify_dtor(struct rtpp_notify *);
-static void do_timeout_notification(struct rtpp_notify_wi *, int, struct rtpp_log *);
+static void rtpp_notify_enqueue(struct rtpp_notify_priv *,
+  struct rtpp_notify_wi *, double);
+static void rtpp_notify_service(struct rtpp_notify_priv *, int);
+
+static int
+rtpp_notify_haswork(struct rtpp_notify_priv *pvt)
+{
+    int i;
+
+    for (i = 0; i < pvt->ntgts; i++) {
+        if (pvt->tgts[i].olen > 0 || pvt->tgts[i].state == TS_CONNECTING)
+            return (1);
+    }
+    return (0);
+}
 
 static void
 rtpp_notify_queue_run(void *arg)
 {
-    struct rtpp_wi *wi;
+    struct rtpp_wi *wis[RTPP_NOTIFY_BATCH];
     struct rtpp_notify_wi *wi_data;
     struct rtpp_notify_priv *pvt;
+    double dtime, stop_at;
+    int i, n, busy, stopping;
 
     pvt = (struct rtpp_notify_priv *)arg;
+    stopping = 0;
+    stop_at = 0;
     for (;;) {
-        wi = rtpp_queue_get_item(pvt->nqueue, 0);
-        if (rtpp_wi_get_type(wi) == RTPP_WI_TYPE_SGNL) {
-            rtpp_wi_free(wi);
+        busy = rtpp_notify_haswork(pvt);
+        if (stopping != 0 && (busy == 0 || getdtime() > stop_at))
             break;
+        if (busy == 0 || rtpp_queue_get_length(pvt->nqueue) > 0) {
+            /* Nothing in flight, block until there is something to do */
+            n = rtpp_queue_get_items(pvt->nqueue, wis, RTPP_NOTIFY_BATCH, 0);
+        } else {
+            n = 0;
         }
-        wi_data = rtpp_wi_data_get_ptr(wi, sizeof(struct rtpp_notify_wi), 0);
-
-        /* main work here */
-        do_timeout_notification(wi_data, 3, wi->log);
-
-        /* deallocate wi */
-        rtpp_wi_free(wi);
+        dtime = getdtime();
+        for (i = 0; i < n; i++) {
+            if (rtpp_wi_get_type(wis[i]) == RTPP_WI_TYPE_SGNL) {
+                /* Give whatever is still queued a chance to go out */
+                stopping = 1;
+                stop_at = dtime + RTPP_NOTIFY_DRAIN_TOUT;
+                rtpp_wi_free(wis[i]);
+                continue;
+            }
+            wi_data = rtpp_wi_data_get_ptr(wis[i],
+              sizeof(struct rtpp_notify_wi), 0);
+            rtpp_notify_enqueue(pvt, wi_data, dtime);
+            rtpp_wi_free(wis[i]);
+        }
+        rtpp_notify_service(pvt, rtpp_queue_get_length(pvt->nqueue) > 0 ?
+          0 : RTPP_NOTIFY_POLL_IVAL);
     }
 }
 
@@ -120,18 +198,20 @@ rtpp_notify_ctor(struct rtpp_log *glog)
         goto e2;
     }
 
+    CALL_SMETHOD(glog->rcnt, incref);
+    pvt->glog = glog;
+
     if (pthread_create(&pvt->thread_id, NULL, (void *(*)(void *))&rtpp_notify_queue_run, pvt) != 0) {
         goto e3;
     }
 
-    CALL_SMETHOD(glog->rcnt, incref);
-    pvt->glog = glog;
     pvt->pub.schedule = &rtpp_notify_schedule;
     pvt->pub.dtor = &rtpp_notify_dtor;
 
     return (&pvt->pub);
 
 e3:
+    CALL_SMETHOD(glog->rcnt, decref);
     rtpp_wi_free(pvt->sigterm);
 e2:
     rtpp_queue_destroy(pvt->nqueue);
@@ -145,12 +225,33 @@ static void
 rtpp_notify_dtor(struct rtpp_notify *pub)
 {
     struct rtpp_notify_priv *pvt;
+    int i;
 
     pvt = PUB2PVT(pub);
 
     rtpp_queue_put_item(pvt->sigterm, pvt->nqueue);
     pthread_join(pvt->thread_id, NULL);
     rtpp_queue_destroy(pvt->nqueue);
+    for (i = 0; i < pvt->ntgts; i++) {
+        if (pvt->tgts[i].olen > 0) {
+            RTPP_LOG(pvt->glog, RTPP_LOG_ERR, "%d bytes of timeout "
+              "notifications not delivered on shutdown",
+              (int)pvt->tgts[i].olen);
+        }
+        if (pvt->tgts[i].state == TS_CONNECTING) {
+            /* rtpp_tnotify_set only takes care of the connected ones */
+            close(pvt->tgts[i].rttp->fd);
+            pvt->tgts[i].rttp->fd = -1;
+        }
+        if (pvt->tgts[i].obuf != NULL)
+            free(pvt->tgts[i].obuf);
+    }
+    if (pvt->tgts != NULL)
+        free(pvt->tgts);
+    if (pvt->pfds != NULL)
+        free(pvt->pfds);
+    if (pvt->ptgts != NULL)
+        free(pvt->ptgts);
     CALL_SMETHOD(pvt->glog->rcnt, decref);
     free(pvt);
 }
@@ -188,67 +289,298 @@ rtpp_notify_schedule(struct rtpp_notify *pub,
     return (0);
 }
 
+static struct rtpp_notify_target *
+rtpp_notify_gettgt(struct rtpp_notify_priv *pvt,
+  struct rtpp_tnotify_target *rttp)
+{
+    struct rtpp_notify_target *tgts, *tp;
+    struct pollfd *pfds;
+    struct rtpp_notify_target **ptgts;
+    int i, alen;
+
+    for (i = 0; i < pvt->ntgts; i++) {
+        if (pvt->tgts[i].rttp == rttp)
+            return (&pvt->tgts[i]);
+    }
+    if (pvt->ntgts == pvt->atgts) {
+        alen = (pvt->atgts == 0) ? 4 : pvt->atgts * 2;
+        tgts = realloc(pvt->tgts, alen * sizeof(pvt->tgts[0]));
+        if (tgts == NULL)
+            return (NULL);
+        pvt->tgts = tgts;
+        pfds = realloc(pvt->pfds, alen * sizeof(pvt->pfds[0]));
+        if (pfds == NULL)
+            return (NULL);
+        pvt->pfds = pfds;
+        ptgts = realloc(pvt->ptgts, alen * sizeof(pvt->ptgts[0]));
+        if (ptgts == NULL)
+            return (NULL);
+        pvt->ptgts = ptgts;
+        pvt->atgts = alen;
+    }
+    tp = &pvt->tgts[pvt->ntgts];
+    memset(tp, '\0', sizeof(*tp));
+    tp->rttp = rttp;
+    tp->state = (rttp->connected != 0) ? TS_CONNECTED : TS_IDLE;
+    pvt->ntgts += 1;
+    return (tp);
+}
+
 static void
-reconnect_timeout_handler(struct rtpp_log *log, struct rtpp_tnotify_target *rttp)
+rtpp_notify_drop(struct rtpp_notify_priv *pvt, struct rtpp_notify_target *tp)
 {
 
-    assert (rttp->connected == 0);
+    if (tp->ndropped == 0) {
+        RTPP_LOG(pvt->glog, RTPP_LOG_ERR, "unable to send timeout "
+          "notification, target is not available");
+    }
+    tp->ndropped += 1;
+}
+
+static void
+rtpp_notify_enqueue(struct rtpp_notify_priv *pvt, struct rtpp_notify_wi *wi,
+  double dtime)
+{
+    struct rtpp_notify_target *tp;
+    size_t len, alen;
+    char *obuf;
+
+    tp = rtpp_notify_gettgt(pvt, wi->rttp);
+    if (tp == NULL) {
+        RTPP_LOG(pvt->glog, RTPP_LOG_ERR, "unable to send timeout "
+          "notification: out of memory");
+        return;
+    }
+    len = wi->len - 1;
+    if (tp->nfails >= RTPP_NOTIFY_BRK_THRS && dtime < tp->hold_until) {
+        rtpp_notify_drop(pvt, tp);
+        return;
+    }
+    if (tp->olen + len > RTPP_NOTIFY_OBUF_MAX) {
+        rtpp_notify_drop(pvt, tp);
+        return;
+    }
+    if (tp->olen + len > tp->oalen) {
+        alen = (tp->oalen == 0) ? 512 : tp->oalen;
+        while (alen < tp->olen + len)
+            alen *= 2;
+        obuf = realloc(tp->obuf, alen);
+        if (obuf == NULL) {
+            rtpp_notify_drop(pvt, tp);
+            return;
+        }
+        tp->obuf = obuf;
+        tp->oalen = alen;
+    }
+    memcpy(tp->obuf + tp->olen, wi->notify_buf, len);
+    tp->olen += len;
+}
+
+static void
+rtpp_notify_fail(struct rtpp_notify_priv *pvt, struct rtpp_notify_target *tp,
+  double dtime)
+{
+    double hold;
+    int i;
+
+    if (tp->rttp->fd != -1) {
+        close(tp->rttp->fd);
+        tp->rttp->fd = -1;
+    }
+    tp->rttp->connected = 0;
+    tp->state = TS_IDLE;
+    tp->ooff = 0;
+    tp->nfails += 1;
+    if (tp->nfails < RTPP_NOTIFY_BRK_THRS)
+        return;
+    hold = RTPP_NOTIFY_BRK_HOLD;
+    for (i = RTPP_NOTIFY_BRK_THRS; i < tp->nfails && hold < RTPP_NOTIFY_BRK_MAXHOLD; i++)
+        hold *= 2;
+    if (hold > RTPP_NOTIFY_BRK_MAXHOLD)
+        hold = RTPP_NOTIFY_BRK_MAXHOLD;
+    tp->hold_until = dtime + hold;
+    if (tp->olen > 0) {
+        tp->ndropped += 1;
+        tp->olen = 0;
+    }
+    RTPP_LOG(pvt->glog, RTPP_LOG_ERR, "timeout notification target has "
+      "failed %d times in a row, suspending it for %.0f seconds", tp->nfails,
+      hold);
+}
+
+static void
+rtpp_notify_connect(struct rtpp_notify_priv *pvt, struct rtpp_notify_target *tp,
+  double dtime)
+{
+    struct rtpp_tnotify_target *rttp;
+    int flags;
+
+    rttp = tp->rttp;
+    assert(rttp->connected == 0);
 
     if (rttp->fd == -1) {
-        RTPP_LOG(log, RTPP_LOG_DBUG, "connecting timeout socket");
+        RTPP_LOG(pvt->glog, RTPP_LOG_DBUG, "connecting timeout socket");
     } else {
-        RTPP_LOG(log, RTPP_LOG_DBUG, "reconnecting timeout socket");
+        RTPP_LOG(pvt->glog, RTPP_LOG_DBUG, "reconnecting timeout socket");
         close(rttp->fd);
     }
     rttp->fd = socket(rttp->socket_type, SOCK_STREAM, 0);
     if (rttp->fd == -1) {
-        RTPP_ELOG(log, RTPP_LOG_ERR, "can't create timeout socket");
-        return;
+        RTPP_ELOG(pvt->glog, RTPP_LOG_ERR, "can't create timeout socket");
+        goto e0;
     }
+    flags = fcntl(rttp->fd, F_GETFL);
+    fcntl(rttp->fd, F_SETFL, flags | O_NONBLOCK);
     if (rttp->local != NULL) {
         if (bind(rttp->fd, rttp->local, SA_LEN(rttp->local)) < 0) {
-            RTPP_ELOG(log, RTPP_LOG_ERR, "can't bind timeout socket");
+            RTPP_ELOG(pvt->glog, RTPP_LOG_ERR, "can't bind timeout socket");
             goto e0;
         }
     }
     if (connect(rttp->fd, (struct sockaddr *)&(rttp->remote), rttp->remote_len) == -1) {
-        RTPP_ELOG(log, RTPP_LOG_ERR, "can't connect to timeout socket");
-        goto e0;
+        if (errno != EINPROGRESS) {
+            RTPP_ELOG(pvt->glog, RTPP_LOG_ERR, "can't connect to timeout socket");
+            goto e0;
+        }
+        tp->state = TS_CONNECTING;
+        tp->conn_until = dtime + RTPP_NOTIFY_CONN_TOUT;
     } else {
         rttp->connected = 1;
+        tp->state = TS_CONNECTED;
     }
     return;
 
 e0:
-    close(rttp->fd);
-    rttp->fd = -1;
-    return;
+    rtpp_notify_fail(pvt, tp, dtime);
 }
 
 static void
-do_timeout_notification(struct rtpp_notify_wi *wi, int retries,
-  struct rtpp_log *log)
+rtpp_notify_connected(struct rtpp_notify_priv *pvt,
+  struct rtpp_notify_target *tp)
 {
-    int result;
-
-    if (wi->rttp->connected == 0) {
-        reconnect_timeout_handler(log, wi->rttp);
 
-        /* If connect fails, no notification will be sent */
-        if (wi->rttp->connected == 0) {
-            RTPP_LOG(log, RTPP_LOG_ERR, "unable to send timeout notification");
-            return;
-        }
+    tp->rttp->connected = 1;
+    tp->state = TS_CONNECTED;
+    if (tp->nfails >= RTPP_NOTIFY_BRK_THRS || tp->ndropped > 0) {
+        RTPP_LOG(pvt->glog, RTPP_LOG_INFO, "timeout notification target is "
+          "back, %lu notification(s) have been lost", tp->ndropped);
     }
+    tp->nfails = 0;
+    tp->ndropped = 0;
+}
+
+static void
+rtpp_notify_flush(struct rtpp_notify_priv *pvt, struct rtpp_notify_target *tp,
+  double dtime)
+{
+    ssize_t result;
+    size_t sent, done;
 
     do {
-        result = send(wi->rttp->fd, wi->notify_buf, wi->len - 1, 0);
+        result = send(tp->rttp->fd, tp->obuf + tp->ooff, tp->olen - tp->ooff,
+          0);
     } while (result == -1 && errno == EINTR);
 
     if (result < 0) {
-        wi->rttp->connected = 0;
-        RTPP_ELOG(log, RTPP_LOG_ERR, "failed to send timeout notification");
-        if (retries > 0)
-            do_timeout_notification(wi, retries - 1, log);
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return;
+        RTPP_ELOG(pvt->glog, RTPP_LOG_ERR, "failed to send timeout notification");
+        rtpp_notify_fail(pvt, tp, dtime);
+        return;
+    }
+    if (tp->nfails > 0 || tp->ndropped > 0)
+        rtpp_notify_connected(pvt, tp);
+    /* Drop complete lines only, remember how far into the next one we are */
+    sent = tp->ooff + result;
+    for (done = sent; done > 0 && tp->obuf[done - 1] != '\n'; done--)
+        continue;
+    if (done > 0) {
+        if (done < tp->olen)
+            memmove(tp->obuf, tp->obuf + done, tp->olen - done);
+        tp->olen -= done;
+    }
+    tp->ooff = sent - done;
+}
+
+/*
+ * Make progress on all targets: start connects to the ones that have
+ * something to send, then wait up to the timeout for sockets to become
+ * writable and push out whatever is queued. Connections that have been
+ * closed by the other side while idle show up as readable, those are
+ * re-established before sending.
+ */
+static void
+rtpp_notify_service(struct rtpp_notify_priv *pvt, int timeout)
+{
+    struct rtpp_notify_target *tp;
+    double dtime;
+    int i, n, nready, serr;
+    ssize_t rlen;
+    socklen_t slen;
+    char rbuf[128];
+
+    dtime = getdtime();
+    n = 0;
+    for (i = 0; i < pvt->ntgts; i++) {
+        tp = &pvt->tgts[i];
+        if (tp->state == TS_IDLE && tp->olen > 0) {
+            if (tp->nfails >= RTPP_NOTIFY_BRK_THRS && dtime < tp->hold_until) {
+                continue;
+            }
+            rtpp_notify_connect(pvt, tp, dtime);
+        }
+        if (tp->state == TS_IDLE || (tp->state == TS_CONNECTED && tp->olen == 0))
+            continue;
+        pvt->pfds[n].fd = tp->rttp->fd;
+        pvt->pfds[n].events = (tp->state == TS_CONNECTING) ? POLLOUT :
+          (POLLOUT | POLLIN);
+        pvt->pfds[n].revents = 0;
+        pvt->ptgts[n] = tp;
+        n++;
+    }
+    if (n == 0)
+        return;
+    nready = poll(pvt->pfds, n, timeout);
+    if (nready < 0)
+        return;
+    dtime = getdtime();
+    for (i = 0; i < n; i++) {
+        tp = pvt->ptgts[i];
+        if (pvt->pfds[i].revents == 0) {
+            if (tp->state == TS_CONNECTING && dtime >= tp->conn_until) {
+                RTPP_LOG(pvt->glog, RTPP_LOG_ERR, "timed out connecting to "
+                  "timeout socket");
+                rtpp_notify_fail(pvt, tp, dtime);
+            }
+            continue;
+        }
+        if (tp->state == TS_CONNECTING) {
+            serr = 0;
+            slen = sizeof(serr);
+            getsockopt(tp->rttp->fd, SOL_SOCKET, SO_ERROR, &serr, &slen);
+            if (serr != 0) {
+                errno = serr;
+                RTPP_ELOG(pvt->glog, RTPP_LOG_ERR, "can't connect to timeout socket");
+                rtpp_notify_fail(pvt, tp, dtime);
+                continue;
+            }
+            rtpp_notify_connected(pvt, tp);
+        } else if ((pvt->pfds[i].revents & (POLLIN | POLLHUP | POLLERR)) != 0) {
+            rlen = recv(tp->rttp->fd, rbuf, sizeof(rbuf), 0);
+            if (rlen == 0 || (rlen < 0 && errno != EAGAIN &&
+              errno != EWOULDBLOCK && errno != EINTR)) {
+                /* Closed by the other side, reconnect on the next pass */
+                RTPP_LOG(pvt->glog, RTPP_LOG_DBUG, "timeout socket closed by peer");
+                close(tp->rttp->fd);
+                tp->rttp->fd = -1;
+                tp->rttp->connected = 0;
+                tp->state = TS_IDLE;
+                tp->ooff = 0;
+                continue;
+            }
+        }
+        if (tp->olen > 0 && (pvt->pfds[i].revents & POLLOUT) != 0) {
+            rtpp_notify_flush(pvt, tp, dtime);
+        }
     }
 }
@@ -1,6 +1,37 @@
-#if defined(RTPP_DEBUG)
-#include <assert.h>
-#endif
+/*
+ * Copyright (c) 2016 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -9,91 +40,275 @@
 #include "rtpp_hash_table.h"
 #include "rtpp_pcache.h"
 #include "rtpp_mallocs.h"
+#include "rtpp_refcnt.h"
 
 struct rtpp_pcache_priv {
-  struct rtpp_pcache *real;
-  struct rtpp_hash_table *hash_table;
+    struct rtpp_pcache pub;
+    struct rtpp_hash_table *hash_table;
+    /* Serializes lookup / insert / eviction of the entries */
+    pthread_mutex_t lock;
 };
 
-struct rtpp_pcache_full {
-  struct rtpp_pcache pub;
-  struct rtpp_pcache_priv pvt;
+/* Single prompt file, shared between all players using it */
+struct rtpp_pcache_ent {
+    struct rtpp_refcnt *rcnt;
+    const unsigned char *base;
+    size_t size;
+    /* Identity of the file, used to detect prompts replaced on disk */
+    dev_t dev;
+    ino_t ino;
+    time_t mtime;
+    /* Number of open handles, protected by the pcache lock */
+    int nusers;
+    /* Our entry in the hash table, NULL once evicted */
+    struct rtpp_hash_table_entry *hte;
 };
 
 struct rtpp_pcache_fd {
-  off_t cpos;
-  struct rtpp_hash_table_entry *hte;
+    off_t cpos;
+    struct rtpp_pcache_ent *pep;
 };
 
-static void rtpp_pcache_dtor(struct rtpp_pcache *);
+#define PUB2PVT(pubp) \
+  ((struct rtpp_pcache_priv *)((char *)(pubp) - offsetof(struct rtpp_pcache_priv, pub)))
+
+static void rtpp_pcache_dtor(struct rtpp_pcache_priv *);
 static struct rtpp_pcache_fd *rtpp_pcache_open(struct rtpp_pcache *, const char *);
 static int rtpp_pcache_read(struct rtpp_pcache *, struct rtpp_pcache_fd *, void *, size_t);
+static void rtpp_pcache_rewind(struct rtpp_pcache *, struct rtpp_pcache_fd *);
 static void rtpp_pcache_close(struct rtpp_pcache *, struct rtpp_pcache_fd *);
 
 struct rtpp_pcache *
 rtpp_pcache_ctor(void)
 {
-    struct rtpp_pcache_full *fp;
-    struct rtpp_pcache *pub;
     struct rtpp_pcache_priv *pvt;
+    struct rtpp_refcnt *rcnt;
 
-    fp = rtpp_zmalloc(sizeof(struct rtpp_pcache_full));
-    if (fp == NULL) {
-        return (NULL);
+    pvt = rtpp_rzmalloc(sizeof(struct rtpp_pcache_priv), &rcnt);
+    if (pvt == NULL) {
+        goto e0;
     }
-    pub = &(fp->pub);
-    pvt = &(fp->pvt);
+    pvt->pub.rcnt = rcnt;
     pvt->hash_table = rtpp_hash_table_ctor(rtpp_ht_key_str_t, 0);
     if (pvt->hash_table == NULL) {
-        free(fp);
-        return (NULL);
+        goto e1;
+    }
+    if (pthread_mutex_init(&pvt->lock, NULL) != 0) {
+        goto e2;
+    }
+    pvt->pub.open = &rtpp_pcache_open;
+    pvt->pub.read = &rtpp_pcache_read;
+    pvt->pub.rewind = &rtpp_pcache_rewind;
+    pvt->pub.close = &rtpp_pcache_close;
+    CALL_SMETHOD(pvt->pub.rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_pcache_dtor,
+      pvt);
+    return (&pvt->pub);
+e2:
+    CALL_METHOD(pvt->hash_table, dtor);
+e1:
+    CALL_SMETHOD(pvt->pub.rcnt, decref);
+    free(pvt);
+e0:
+    return (NULL);
+}
+
+static void
+rtpp_pcache_ent_dtor(struct rtpp_pcache_ent *pep)
+{
+
+    if (pep->base != NULL) {
+        free((void *)pep->base);
+    }
+    free(pep);
+}
+
+static struct rtpp_pcache_ent *
+rtpp_pcache_ent_ctor(const char *fname)
+{
+    struct rtpp_pcache_ent *pep;
+    struct rtpp_refcnt *rcnt;
+    struct stat sb;
+    unsigned char *base;
+    size_t rsize;
+    ssize_t rval;
+    int fd;
+
+    fd = open(fname, O_RDONLY);
+    if (fd == -1) {
+        goto e0;
+    }
+    if (fstat(fd, &sb) == -1 || !S_ISREG(sb.st_mode)) {
+        goto e1;
+    }
+    pep = rtpp_rzmalloc(sizeof(struct rtpp_pcache_ent), &rcnt);
+    if (pep == NULL) {
+        goto e1;
     }
-    pub->pvt = pvt;
-    pub->open = &rtpp_pcache_open;
-    pub->read = &rtpp_pcache_read;
-    pub->close = &rtpp_pcache_close;
-    pub->dtor = &rtpp_pcache_dtor;
-#if defined(RTPP_DEBUG)
-    assert((void *)fp == (void *)pub);
-#endif
-    return (pub);
+    pep->rcnt = rcnt;
+    pep->dev = sb.st_dev;
+    pep->ino = sb.st_ino;
+    pep->mtime = sb.st_mtime;
+    /*
+     * Prompts are small, so the whole file is read in rather than mapped:
+     * with a mapping, a file truncated or rewritten in place while being
+     * played would SIGBUS the processing thread. Empty prompt is not an
+     * error, the player would just hit EOF.
+     */
+    if (sb.st_size > 0) {
+        base = malloc(sb.st_size);
+        if (base == NULL) {
+            goto e2;
+        }
+        for (rsize = 0; rsize < (size_t)sb.st_size; rsize += rval) {
+            rval = read(fd, base + rsize, sb.st_size - rsize);
+            if (rval == -1 && errno == EINTR) {
+                rval = 0;
+                continue;
+            }
+            if (rval == -1) {
+                free(base);
+                goto e2;
+            }
+            if (rval == 0) {
+                /* File has shrunk since fstat(), take what is there */
+                break;
+            }
+        }
+        pep->base = base;
+        pep->size = rsize;
+    }
+    close(fd);
+    CALL_SMETHOD(pep->rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_pcache_ent_dtor,
+      pep);
+    return (pep);
+e2:
+    CALL_SMETHOD(pep->rcnt, decref);
+    free(pep);
+e1:
+    close(fd);
+e0:
+    return (NULL);
 }
 
-struct rtpp_pcache_fd *
+static int
+rtpp_pcache_ent_isstale(struct rtpp_pcache_ent *pep, const char *fname)
+{
+    struct stat sb;
+
+    if (stat(fname, &sb) == -1)
+        return (1);
+    return (sb.st_dev != pep->dev || sb.st_ino != pep->ino ||
+      sb.st_mtime != pep->mtime || (size_t)sb.st_size != pep->size);
+}
+
+static void
+rtpp_pcache_ent_evict(struct rtpp_pcache_priv *pvt, struct rtpp_pcache_ent *pep)
+{
+
+    if (pep->hte == NULL)
+        return;
+    CALL_METHOD(pvt->hash_table, remove_nc, pep->hte);
+    pep->hte = NULL;
+}
+
+static struct rtpp_pcache_fd *
 rtpp_pcache_open(struct rtpp_pcache *self, const char *fname)
 {
     struct rtpp_pcache_fd *p_fd;
     struct rtpp_pcache_priv *pvt;
+    struct rtpp_pcache_ent *pep;
+    struct rtpp_refcnt *rco;
 
+    pvt = PUB2PVT(self);
     p_fd = rtpp_zmalloc(sizeof(struct rtpp_pcache_fd));
     if (p_fd == NULL) {
         return (NULL);
     }
-    pvt = self->pvt;
-    p_fd->hte = CALL_METHOD(pvt->hash_table, append, fname, p_fd);    
+    pthread_mutex_lock(&pvt->lock);
+    pep = NULL;
+    rco = CALL_METHOD(pvt->hash_table, find, fname);
+    if (rco != NULL) {
+        pep = CALL_SMETHOD(rco, getdata);
+        if (rtpp_pcache_ent_isstale(pep, fname)) {
+            /*
+             * File has been replaced, players that are still using old
+             * content keep their reference, new ones get a fresh copy.
+             */
+            rtpp_pcache_ent_evict(pvt, pep);
+            CALL_SMETHOD(rco, decref);
+            pep = NULL;
+        }
+    }
+    if (pep == NULL) {
+        pep = rtpp_pcache_ent_ctor(fname);
+        if (pep == NULL) {
+            goto e0;
+        }
+        pep->hte = CALL_METHOD(pvt->hash_table, append_refcnt, fname,
+          pep->rcnt);
+        if (pep->hte == NULL) {
+            CALL_SMETHOD(pep->rcnt, decref);
+            goto e0;
+        }
+    }
+    pep->nusers += 1;
+    pthread_mutex_unlock(&pvt->lock);
+    p_fd->pep = pep;
     return (p_fd);
+e0:
+    pthread_mutex_unlock(&pvt->lock);
+    free(p_fd);
+    return (NULL);
 }
 
 static void
 rtpp_pcache_close(struct rtpp_pcache *self, struct rtpp_pcache_fd *p_fd)
 {
+    struct rtpp_pcache_priv *pvt;
+    struct rtpp_pcache_ent *pep;
 
-    CALL_METHOD(self->pvt->hash_table, remove_nc, p_fd->hte);
+    pvt = PUB2PVT(self);
+    pep = p_fd->pep;
+    pthread_mutex_lock(&pvt->lock);
+    pep->nusers -= 1;
+    if (pep->nusers == 0) {
+        rtpp_pcache_ent_evict(pvt, pep);
+    }
+    pthread_mutex_unlock(&pvt->lock);
+    CALL_SMETHOD(pep->rcnt, decref);
     free(p_fd);
 }
 
 static int
-rtpp_pcache_read(struct rtpp_pcache *self, struct rtpp_pcache_fd *p_fd, void *buf, size_t len)
+rtpp_pcache_read(struct rtpp_pcache *self, struct rtpp_pcache_fd *p_fd,
+  void *buf, size_t len)
+{
+    struct rtpp_pcache_ent *pep;
+    size_t rlen;
+
+    pep = p_fd->pep;
+    if ((size_t)p_fd->cpos >= pep->size)
+        return (0);
+    rlen = pep->size - p_fd->cpos;
+    if (rlen > len)
+        rlen = len;
+    memcpy(buf, pep->base + p_fd->cpos, rlen);
+    p_fd->cpos += rlen;
+    return (rlen);
+}
+
+static void
+rtpp_pcache_rewind(struct rtpp_pcache *self, struct rtpp_pcache_fd *p_fd)
 {
 
-    p_fd->cpos += len;
-    memset(buf, p_fd->cpos, len);
-    return(len);
+    p_fd->cpos = 0;
 }
 
 static void
-rtpp_pcache_dtor(struct rtpp_pcache *self)
+rtpp_pcache_dtor(struct rtpp_pcache_priv *pvt)
 {
 
-    free(self);
+    CALL_METHOD(pvt->hash_table, dtor);
+    pthread_mutex_destroy(&pvt->lock);
+    free(pvt);
 }
@@ -1,24 +1,62 @@
+/*
+ * Copyright (c) 2016 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef _RTPP_PCACHE_H_
+#define _RTPP_PCACHE_H_
+
+/*
+ * Shared cache of the prompt files used by the players. Each file
+ * ("name.codec") is loaded into memory once and shared by all players
+ * that are playing it; the copy goes away when the last player closes it.
+ * Reading from the cache is a plain memcpy(), no syscalls involved.
+ */
+
 struct rtpp_pcache;
 struct rtpp_pcache_fd;
+struct rtpp_refcnt;
 
 #if !defined(DEFINE_METHOD)
 #error "rtpp_types.h" needs to be included
 #endif
 
-DEFINE_METHOD(rtpp_pcache, rtpp_pcache_dtor, void);
 DEFINE_METHOD(rtpp_pcache, rtpp_pcache_open, struct rtpp_pcache_fd *, const char *);
 DEFINE_METHOD(rtpp_pcache, rtpp_pcache_read, int, struct rtpp_pcache_fd *, void *, size_t);
+DEFINE_METHOD(rtpp_pcache, rtpp_pcache_rewind, void, struct rtpp_pcache_fd *);
 DEFINE_METHOD(rtpp_pcache, rtpp_pcache_close, void, struct rtpp_pcache_fd *);
 
-struct rtpp_pcache_priv;
-
 struct rtpp_pcache
 {
-    rtpp_pcache_open_t open;
-    rtpp_pcache_read_t read;
-    rtpp_pcache_close_t close;
-    rtpp_pcache_dtor_t dtor;
-    struct rtpp_pcache_priv *pvt;
+    METHOD_ENTRY(rtpp_pcache_open, open);
+    METHOD_ENTRY(rtpp_pcache_read, read);
+    METHOD_ENTRY(rtpp_pcache_rewind, rewind);
+    METHOD_ENTRY(rtpp_pcache_close, close);
+    struct rtpp_refcnt *rcnt;
 };
 
 struct rtpp_pcache *rtpp_pcache_ctor(void);
+
+#endif
@@ -72,7 +72,8 @@ static void rtpp_pipe_upd_cntrs(struct rtpp_pipe *, struct rtpp_acct_pipe *);
 struct rtpp_pipe *
 rtpp_pipe_ctor(uint64_t seuid, struct rtpp_weakref_obj *streams_wrt,
   struct rtpp_weakref_obj *servers_wrt, struct rtpp_log *log,
-  struct rtpp_stats *rtpp_stats, int pipe_type)
+  struct rtpp_stats *rtpp_stats, int pipe_type,
+  struct rtpa_policy *rtpa_policy)
 {
     struct rtpp_pipe_priv *pvt;
     struct rtpp_refcnt *rcnt;
@@ -89,7 +90,7 @@ rtpp_pipe_ctor(uint64_t seuid, struct rtpp_weakref_obj *streams_wrt,
     rtpp_gen_uid(&pvt->pub.ppuid);
     for (i = 0; i < 2; i++) {
         pvt->pub.stream[i] = rtpp_stream_ctor(log, servers_wrt,
-          rtpp_stats, i, pipe_type, seuid);
+          rtpp_stats, i, pipe_type, seuid, rtpa_policy);
         if (pvt->pub.stream[i] == NULL) {
             goto e1;
         }
@@ -32,6 +32,7 @@
 struct rtpp_stats;
 struct rtpp_pipe;
 struct rtpp_acct_pipe;
+struct rtpa_policy;
 
 #define PIPE_RTP        1
 #define PIPE_RTCP       2
@@ -66,6 +67,6 @@ struct rtpp_pipe {
 
 struct rtpp_pipe *rtpp_pipe_ctor(uint64_t, struct rtpp_weakref_obj *,
   struct rtpp_weakref_obj *, struct rtpp_log *,
-  struct rtpp_stats *, int);
+  struct rtpp_stats *, int, struct rtpa_policy *);
 
 #endif
@@ -30,6 +30,7 @@
 #include <sys/socket.h>
 #include <poll.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "rtpp_types.h"
@@ -58,6 +59,13 @@
 #include "rtpp_pipe.h"
 #include "rtpp_netaddr.h"
 
+/*
+ * Upper bound on the number of packets processed per tick, in units of
+ * the per-stream quantum times the number of ready streams. Streams that
+ * have less than the quantum queued leave their share to the others.
+ */
+#define RTPP_DRR_NROUNDS 4
+
 struct rtpp_proc_ready_lst {
     struct rtpp_session *sp;
     struct rtpp_stream *stp;
@@ -87,27 +95,27 @@ fill_session_addr(struct cfg *cf, struct rtpp_stream *stp,
     return (rval);
 }
 
-static void
+/*
+ * Receive and relay up to the quantum packets queued on the stream's
+ * socket. Packets that are discarded count against the quantum too, so
+ * that a socket being flooded can't hold up the rest. Returns number of
+ * packets received, which is less than quantum if the socket has been
+ * drained.
+ */
+static int
 rxmit_packets(struct cfg *cf, struct rtpp_stream *stp,
-  double dtime, int drain_repeat, struct sthread_args *sender,
+  double dtime, int quantum, struct sthread_args *sender,
   struct rtpp_proc_rstats *rsp)
 {
-    int ndrain;
+    int nrcvd;
     struct rtp_packet *packet = NULL;
 
     /* Repeat since we may have several packets queued on the same socket */
-    ndrain = -1;
-    do {
-        if (ndrain < 0) {
-            ndrain = drain_repeat - 1;
-        } else {
-            ndrain -= 1;
-        }
-
+    for (nrcvd = 0; nrcvd < quantum; nrcvd++) {
 	packet = CALL_METHOD(stp->fd, rtp_recv, dtime, stp->laddr, stp->port);
 	if (packet == NULL) {
             /* Move on to the next session */
-            return;
+            break;
         }
         rsp->npkts_rcvd.cnt++;
 
@@ -122,7 +130,6 @@ rxmit_packets(struct cfg *cf, struct rtpp_stream *stp,
 			 * Continue, since there could be good packets in
 			 * queue.
 			 */
-                        ndrain += 1;
                         CALL_METHOD(stp->pcount, reg_ignr);
                         rsp->npkts_discard.cnt++;
 			goto discard_and_continue;
@@ -142,7 +149,6 @@ rxmit_packets(struct cfg *cf, struct rtpp_stream *stp,
 		     * Continue, since there could be good packets in
 		     * queue.
 		     */
-                    ndrain += 1;
                     CALL_METHOD(stp->pcount, reg_ignr);
                     rsp->npkts_discard.cnt++;
 		    goto discard_and_continue;
@@ -184,8 +190,8 @@ discard_and_continue:
         if (packet != NULL) {
             rtp_packet_free(packet);
         }
-    } while (ndrain > 0);
-    return;
+    }
+    return (nrcvd);
 
 #if 0
 discard:
@@ -221,7 +227,7 @@ send_packet(struct cfg *cf, struct rtpp_stream *stp_in,
 
     if (stp_in->rrc != NULL) {
         if (!CALL_SMETHOD(stp_out, isplayer_active)) {
-            CALL_METHOD(stp_in->rrc, write, stp_out, packet);
+            CALL_METHOD(stp_in->rrc, write, sender, stp_out, packet);
         }
     }
 
@@ -265,11 +271,52 @@ drain_socket(struct rtpp_socket *rfd, struct rtpp_proc_rstats *rsp)
     return (ndrained);
 }
 
+static int
+rtpp_proc_drr_grow(struct rtpp_proc_drr *drr, int len)
+{
+    struct rtpp_proc_ready_lst *rlst;
+    int *active;
+
+    if (drr->alen >= len)
+        return (0);
+    rlst = realloc(drr->rlst, len * sizeof(drr->rlst[0]));
+    if (rlst == NULL)
+        return (-1);
+    drr->rlst = rlst;
+    active = realloc(drr->active, len * sizeof(drr->active[0]));
+    if (active == NULL)
+        return (-1);
+    drr->active = active;
+    drr->alen = len;
+    return (0);
+}
+
+void
+rtpp_proc_drr_free(struct rtpp_proc_drr *drr)
+{
+
+    if (drr->rlst != NULL)
+        free(drr->rlst);
+    if (drr->active != NULL)
+        free(drr->active);
+    memset(drr, '\0', sizeof(*drr));
+}
+
+/*
+ * Relay packets from all ready sockets. The work is done in deficit
+ * round-robin fashion: each round every stream that still has something
+ * queued gets to process up to drain_repeat packets, until either all
+ * are drained or the per-tick budget is exhausted. In the latter case
+ * the leftovers are picked up on the next tick and the overrun is
+ * reported. The starting point rotates from one tick to the next, so
+ * that it is not the same streams that get cut off each time.
+ */
 void
 process_rtp_only(struct cfg *cf, struct rtpp_polltbl *ptbl, double dtime,
-  int drain_repeat, struct sthread_args *sender, struct rtpp_proc_rstats *rsp)
+  int drain_repeat, struct rtpp_proc_drr *drr, struct sthread_args *sender,
+  struct rtpp_proc_rstats *rsp)
 {
-    int readyfd;
+    int i, j, k, n, nactive, budget, quantum, nrcvd;
     struct rtpp_session *sp;
     struct rtpp_stream *stp;
     struct rtp_packet *packet;
@@ -278,11 +325,17 @@ process_rtp_only(struct cfg *cf, struct rtpp_polltbl *ptbl, double dtime,
     int fd, ndrained;
 #endif
 
-    for (readyfd = 0; readyfd < ptbl->curlen; readyfd++) {
-        if ((ptbl->pfds[readyfd].revents & POLLIN) == 0)
+    if (ptbl->curlen == 0 || rtpp_proc_drr_grow(drr, ptbl->curlen) != 0)
+        return;
+
+    n = 0;
+    drr->rr_start = (drr->rr_start + 1) % ptbl->curlen;
+    for (k = 0; k < ptbl->curlen; k++) {
+        i = (drr->rr_start + k) % ptbl->curlen;
+        if ((ptbl->pfds[i].revents & POLLIN) == 0)
             continue;
         stp = CALL_METHOD(ptbl->streams_wrt, get_by_idx,
-          ptbl->mds[readyfd].stuid);
+          ptbl->mds[i].stuid);
         if (stp == NULL)
             continue;
         sp = CALL_METHOD(cf->stable->sessions_wrt, get_by_idx, stp->seuid);
@@ -291,31 +344,59 @@ process_rtp_only(struct cfg *cf, struct rtpp_polltbl *ptbl, double dtime,
             continue;
         }
         if (sp->complete != 0) {
-            rxmit_packets(cf, stp, dtime, drain_repeat, sender, rsp);
-            CALL_SMETHOD(sp->rcnt, decref);
-            if (stp->resizer != NULL) {
-                while ((packet = rtp_resizer_get(stp->resizer, dtime)) != NULL) {
-                    send_packet(cf, stp, packet, sender, rsp);
-                    rsp->npkts_resizer_out.cnt++;
-                    packet = NULL;
-                }
-            }
-        } else {
-            CALL_SMETHOD(sp->rcnt, decref);
+            drr->rlst[n].sp = sp;
+            drr->rlst[n].stp = stp;
+            drr->active[n] = n;
+            n++;
+            continue;
+        }
+        CALL_SMETHOD(sp->rcnt, decref);
 #if RTPP_DEBUG
-            proto = CALL_SMETHOD(stp, get_proto);
-            fd = CALL_METHOD(stp->fd, getfd);
-            RTPP_LOG(stp->log, RTPP_LOG_DBUG, "Draining %s socket %d", proto,
-              fd);
-            ndrained = drain_socket(stp->fd, rsp);
-            if (ndrained > 0) {
-                RTPP_LOG(stp->log, RTPP_LOG_DBUG, "Draining %s socket %d: %d "
-                  "packets discarded", proto, fd, ndrained);
-            }
+        proto = CALL_SMETHOD(stp, get_proto);
+        fd = CALL_METHOD(stp->fd, getfd);
+        RTPP_LOG(stp->log, RTPP_LOG_DBUG, "Draining %s socket %d", proto,
+          fd);
+        ndrained = drain_socket(stp->fd, rsp);
+        if (ndrained > 0) {
+            RTPP_LOG(stp->log, RTPP_LOG_DBUG, "Draining %s socket %d: %d "
+              "packets discarded", proto, fd, ndrained);
+        }
 #else
-            drain_socket(stp->fd, rsp);
+        drain_socket(stp->fd, rsp);
 #endif
+        CALL_SMETHOD(stp->rcnt, decref);
+    }
+
+    budget = n * drain_repeat * RTPP_DRR_NROUNDS;
+    for (nactive = n; nactive > 0 && budget > 0; nactive = j) {
+        for (i = j = 0; i < nactive; i++) {
+            quantum = (budget < drain_repeat) ? budget : drain_repeat;
+            if (quantum == 0) {
+                drr->active[j++] = drr->active[i];
+                continue;
+            }
+            nrcvd = rxmit_packets(cf, drr->rlst[drr->active[i]].stp, dtime,
+              quantum, sender, rsp);
+            budget -= nrcvd;
+            if (nrcvd == quantum) {
+                /* May have more queued, keep it for the next round */
+                drr->active[j++] = drr->active[i];
+            }
+        }
+    }
+    if (nactive > 0) {
+        rsp->ntick_overruns.cnt++;
+    }
 
+    for (i = 0; i < n; i++) {
+        stp = drr->rlst[i].stp;
+        CALL_SMETHOD(drr->rlst[i].sp->rcnt, decref);
+        if (stp->resizer != NULL) {
+            while ((packet = rtp_resizer_get(stp->resizer, dtime)) != NULL) {
+                send_packet(cf, stp, packet, sender, rsp);
+                rsp->npkts_resizer_out.cnt++;
+                packet = NULL;
+            }
         }
         CALL_SMETHOD(stp->rcnt, decref);
     }
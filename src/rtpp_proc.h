@@ -45,11 +45,24 @@ struct rtpp_proc_rstats {
     struct rtpp_proc_stat npkts_resizer_out;
     struct rtpp_proc_stat npkts_resizer_discard;
     struct rtpp_proc_stat npkts_discard;
+    struct rtpp_proc_stat ntick_overruns;
+};
+
+struct rtpp_proc_ready_lst;
+
+/* Scratch state for the round-robin over the ready streams */
+struct rtpp_proc_drr {
+    struct rtpp_proc_ready_lst *rlst;
+    int *active;
+    int alen;
+    int rr_start;
 };
 
 void process_rtp_servers(struct cfg *, double, struct sthread_args *,
   struct rtpp_proc_rstats *);
 void process_rtp_only(struct cfg *, struct rtpp_polltbl *, double, int,
-  struct sthread_args *sender, struct rtpp_proc_rstats *);
+  struct rtpp_proc_drr *, struct sthread_args *sender,
+  struct rtpp_proc_rstats *);
+void rtpp_proc_drr_free(struct rtpp_proc_drr *);
 
 #endif
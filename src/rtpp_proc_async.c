@@ -25,11 +25,17 @@
  *
  */
 
+#if defined(LINUX_XXX) && !defined(_GNU_SOURCE)
+/* CPU_SET(3) and pthread_setaffinity_np(3) */
+#define _GNU_SOURCE
+#endif
+
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <errno.h>
 #include <poll.h>
 #include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <stddef.h>
 #include <string.h>
@@ -104,6 +110,7 @@ flush_rstats(struct rtpp_stats *sobj, struct rtpp_proc_rstats *rsp)
     FLUSH_STAT(sobj, rsp->npkts_resizer_out);
     FLUSH_STAT(sobj, rsp->npkts_resizer_discard);
     FLUSH_STAT(sobj, rsp->npkts_discard);
+    FLUSH_STAT(sobj, rsp->ntick_overruns);
 }
 
 static void
@@ -117,6 +124,43 @@ init_rstats(struct rtpp_stats *sobj, struct rtpp_proc_rstats *rsp)
     rsp->npkts_resizer_out.cnt_idx = CALL_METHOD(sobj, getidxbyname, "npkts_resizer_out");
     rsp->npkts_resizer_discard.cnt_idx = CALL_METHOD(sobj, getidxbyname, "npkts_resizer_discard");
     rsp->npkts_discard.cnt_idx = CALL_METHOD(sobj, getidxbyname, "npkts_discard");
+    rsp->ntick_overruns.cnt_idx = CALL_METHOD(sobj, getidxbyname, "ntick_overruns");
+}
+
+/*
+ * Busy-poll mode: rather than going to sleep until the next tick keep
+ * polling RTP sockets and relay whatever arrives right away. Spinning
+ * stops when the next tick is due or when nothing has been received for
+ * the configured amount of time, in which case we fall back to blocking
+ * on the time queue.
+ */
+static void
+rtpp_proc_async_spin(struct cfg *cf, struct rtpp_proc_async_cf *proc_cf,
+  struct rtpp_polltbl *ptbl, struct rtpp_proc_drr *drr)
+{
+    double budget, stime, dtime;
+    int nready;
+    struct sthread_args *sender;
+
+    budget = (double)cf->stable->busy_poll / 1000000.0;
+    stime = getdtime();
+    while (ptbl->curlen > 0 && rtpp_queue_get_length(proc_cf->time_q) == 0) {
+        nready = poll(ptbl->pfds, ptbl->curlen, 0);
+        dtime = getdtime();
+        if (nready > 0) {
+            sender = rtpp_anetio_pick_sender(proc_cf->op);
+            process_rtp_only(cf, ptbl, dtime, 1, drr, sender,
+              &proc_cf->rstats);
+            rtpp_anetio_pump_q(sender);
+            flush_rstats(cf->stable->rtpp_stats, &proc_cf->rstats);
+            stime = dtime;
+            continue;
+        }
+        if (nready < 0 && errno != EINTR)
+            break;
+        if (dtime - stime > budget)
+            break;
+    }
 }
 
 static void
@@ -142,6 +186,7 @@ rtpp_proc_async_run(void *arg)
     struct rtpp_stats *stats_cf;
     struct rtpp_polltbl ptbl_rtp;
     struct rtpp_polltbl ptbl_rtcp;
+    struct rtpp_proc_drr drr_rtp, drr_rtcp;
 
     proc_cf = (struct rtpp_proc_async_cf *)arg;
     cf = proc_cf->cf_save;
@@ -150,6 +195,8 @@ rtpp_proc_async_run(void *arg)
 
     memset(&ptbl_rtp, '\0', sizeof(struct rtpp_polltbl));
     memset(&ptbl_rtcp, '\0', sizeof(struct rtpp_polltbl));
+    memset(&drr_rtp, '\0', sizeof(struct rtpp_proc_drr));
+    memset(&drr_rtcp, '\0', sizeof(struct rtpp_proc_drr));
 
     last_tick_time = 0;
     wi = rtpp_queue_get_item(proc_cf->time_q, 0);
@@ -179,6 +226,8 @@ rtpp_proc_async_run(void *arg)
             }
             rtpp_polltbl_free(&ptbl_rtp);
             rtpp_polltbl_free(&ptbl_rtcp);
+            rtpp_proc_drr_free(&drr_rtp);
+            rtpp_proc_drr_free(&drr_rtcp);
             return;
         }   
         i -= 1;
@@ -274,24 +323,27 @@ rtpp_proc_async_run(void *arg)
 
         sender = rtpp_anetio_pick_sender(proc_cf->op);
         if (nready_rtp > 0) {
-            process_rtp_only(cf, &ptbl_rtp, tp[2], ndrain, sender, rstats);
+            process_rtp_only(cf, &ptbl_rtp, tp[2], ndrain, &drr_rtp, sender,
+              rstats);
         }
         if (nready_rtcp > 0 && rtp_only == 0) {
-            process_rtp_only(cf, &ptbl_rtcp, tp[2], ndrain, sender, rstats);
+            process_rtp_only(cf, &ptbl_rtcp, tp[2], ndrain, &drr_rtcp, sender,
+              rstats);
         }
         if (alarm_tick != 0) {
             rtpp_proc_ttl(cf->stable->sessions_ht, cf->stable->sessions_wrt,
               cf->stable->rtpp_notify_cf, cf->stable->rtpp_stats);
         }
 
-        if (CALL_METHOD(cf->stable->servers_wrt, get_length) > 0) {
-            rtpp_proc_servers(cf, tp[2], sender, rstats);
-        }
+        CALL_METHOD(cf->stable->proc_servers, run, tp[2], sender, rstats);
 
         rtpp_anetio_pump_q(sender);
         CALL_METHOD(cf->stable->rtpp_cmd_cf, wakeup);
-        tp[3] = getdtime();
         flush_rstats(stats_cf, rstats);
+        if (cf->stable->busy_poll > 0) {
+            rtpp_proc_async_spin(cf, proc_cf, &ptbl_rtp, &drr_rtp);
+        }
+        tp[3] = getdtime();
 
 #if RTPP_DEBUG_timers
         recfilter_apply(&proc_cf->sleep_time, tp[1] - tp[0]);
@@ -370,6 +422,21 @@ rtpp_proc_async_ctor(struct cfg *cf)
     if (pthread_create(&proc_cf->thread_id, NULL, (void *(*)(void *))&rtpp_proc_async_run, proc_cf) != 0) {
         goto e3;
     }
+    if (cf->stable->busy_poll > 0 && cf->stable->busy_poll_cpu >= 0) {
+#if defined(CPU_SET)
+        cpu_set_t cpus;
+
+        CPU_ZERO(&cpus);
+        CPU_SET(cf->stable->busy_poll_cpu, &cpus);
+        if (pthread_setaffinity_np(proc_cf->thread_id, sizeof(cpus), &cpus) != 0) {
+            RTPP_LOG(cf->stable->glog, RTPP_LOG_ERR, "can't bind packet "
+              "processing thread to CPU %d", cf->stable->busy_poll_cpu);
+        }
+#else
+        RTPP_LOG(cf->stable->glog, RTPP_LOG_ERR, "binding threads to a "
+          "CPU is not supported on this platform");
+#endif
+    }
     proc_cf->pub.dtor = &rtpp_proc_async_dtor;
     proc_cf->pub.wakeup = &rtpp_proc_async_wakeup;
     return (&proc_cf->pub);
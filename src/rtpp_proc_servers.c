@@ -28,11 +28,15 @@
 
 #include <sys/types.h>
 #include <netinet/in.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include "rtpp_defines.h"
 #include "rtpp_cfg_stable.h"
 #include "rtpp_types.h"
+#include "rtpp_mallocs.h"
 #include "rtpp_refcnt.h"
 #include "rtpp_weakref.h"
 #include "rtpp_hash_table.h"
@@ -44,49 +48,182 @@
 #include "rtpp_stream.h"
 #include "rtpp_netaddr.h"
 
-struct foreach_args {
-    double dtime;
-    struct sthread_args *sender;
-    struct rtpp_proc_rstats *rsp;
+struct rtpp_psrv_ent {
+    double deadline;
+    uint64_t sruid;
+};
+
+/* Binary min-heap ordered by the deadline */
+struct rtpp_psrv_heap {
+    struct rtpp_psrv_ent *v;
+    int len;
+    int alen;
+};
+
+struct rtpp_proc_servers_priv {
+    struct rtpp_proc_servers pub;
+    struct rtpp_weakref_obj *servers_wrt;
     struct rtpp_weakref_obj *rtp_streams_wrt;
     struct rtpp_weakref_obj *rtcp_streams_wrt;
+    /* Owned by the processing thread */
+    struct rtpp_psrv_heap dq;
+    /* Newly created players, handed over by the command thread */
+    pthread_mutex_t lock;
+    uint64_t *pending;
+    int npending;
+    int apending;
 };
 
+#define PUB2PVT(pubp) \
+  ((struct rtpp_proc_servers_priv *)((char *)(pubp) - offsetof(struct rtpp_proc_servers_priv, pub)))
+
+static void rtpp_proc_servers_dtor(struct rtpp_proc_servers_priv *);
+static int rtpp_proc_servers_reg(struct rtpp_proc_servers *, uint64_t);
+static void rtpp_proc_servers_run(struct rtpp_proc_servers *, double,
+  struct sthread_args *, struct rtpp_proc_rstats *);
+
+struct rtpp_proc_servers *
+rtpp_proc_servers_ctor(struct rtpp_cfg_stable *cfsp)
+{
+    struct rtpp_proc_servers_priv *pvt;
+    struct rtpp_refcnt *rcnt;
+
+    pvt = rtpp_rzmalloc(sizeof(struct rtpp_proc_servers_priv), &rcnt);
+    if (pvt == NULL) {
+        goto e0;
+    }
+    pvt->pub.rcnt = rcnt;
+    if (pthread_mutex_init(&pvt->lock, NULL) != 0) {
+        goto e1;
+    }
+    pvt->servers_wrt = cfsp->servers_wrt;
+    pvt->rtp_streams_wrt = cfsp->rtp_streams_wrt;
+    pvt->rtcp_streams_wrt = cfsp->rtcp_streams_wrt;
+    pvt->pub.reg = &rtpp_proc_servers_reg;
+    pvt->pub.run = &rtpp_proc_servers_run;
+    CALL_SMETHOD(pvt->pub.rcnt, attach,
+      (rtpp_refcnt_dtor_t)&rtpp_proc_servers_dtor, pvt);
+    return (&pvt->pub);
+e1:
+    CALL_SMETHOD(pvt->pub.rcnt, decref);
+    free(pvt);
+e0:
+    return (NULL);
+}
+
+static void
+rtpp_proc_servers_dtor(struct rtpp_proc_servers_priv *pvt)
+{
+
+    if (pvt->dq.v != NULL)
+        free(pvt->dq.v);
+    if (pvt->pending != NULL)
+        free(pvt->pending);
+    pthread_mutex_destroy(&pvt->lock);
+    free(pvt);
+}
+
 static int
-process_rtp_servers_foreach(void *dp, void *ap)
+psrv_heap_push(struct rtpp_psrv_heap *hp, double deadline, uint64_t sruid)
+{
+    struct rtpp_psrv_ent *nv;
+    int i, p, nalen;
+
+    if (hp->len == hp->alen) {
+        nalen = (hp->alen == 0) ? 16 : hp->alen * 2;
+        nv = realloc(hp->v, nalen * sizeof(hp->v[0]));
+        if (nv == NULL)
+            return (-1);
+        hp->v = nv;
+        hp->alen = nalen;
+    }
+    for (i = hp->len++; i > 0; i = p) {
+        p = (i - 1) / 2;
+        if (hp->v[p].deadline <= deadline)
+            break;
+        hp->v[i] = hp->v[p];
+    }
+    hp->v[i].deadline = deadline;
+    hp->v[i].sruid = sruid;
+    return (0);
+}
+
+static uint64_t
+psrv_heap_pop(struct rtpp_psrv_heap *hp)
+{
+    struct rtpp_psrv_ent last;
+    uint64_t sruid;
+    int i, c;
+
+    sruid = hp->v[0].sruid;
+    last = hp->v[--hp->len];
+    for (i = 0; (c = 2 * i + 1) < hp->len; i = c) {
+        if (c + 1 < hp->len && hp->v[c + 1].deadline < hp->v[c].deadline)
+            c++;
+        if (last.deadline <= hp->v[c].deadline)
+            break;
+        hp->v[i] = hp->v[c];
+    }
+    hp->v[i] = last;
+    return (sruid);
+}
+
+static int
+rtpp_proc_servers_reg(struct rtpp_proc_servers *self, uint64_t sruid)
+{
+    struct rtpp_proc_servers_priv *pvt;
+    uint64_t *np;
+    int nalen;
+
+    pvt = PUB2PVT(self);
+    pthread_mutex_lock(&pvt->lock);
+    if (pvt->npending == pvt->apending) {
+        nalen = (pvt->apending == 0) ? 16 : pvt->apending * 2;
+        np = realloc(pvt->pending, nalen * sizeof(pvt->pending[0]));
+        if (np == NULL) {
+            pthread_mutex_unlock(&pvt->lock);
+            return (-1);
+        }
+        pvt->pending = np;
+        pvt->apending = nalen;
+    }
+    pvt->pending[pvt->npending++] = sruid;
+    pthread_mutex_unlock(&pvt->lock);
+    return (0);
+}
+
+/*
+ * Generate all packets that are due for the player, returns 1 once the
+ * player has reached the end of the prompt, 0 otherwise.
+ */
+static int
+process_rtp_server(struct rtpp_proc_servers_priv *pvt, struct rtpp_server *rsrv,
+  double dtime, struct sthread_args *sender, struct rtpp_proc_rstats *rsp)
 {
-    struct foreach_args *fap;
-    struct rtpp_server *rsrv;
     struct rtp_packet *pkt;
     int len;
     struct rtpp_stream *rsop;
     uint64_t rtps_old;
 
-    fap = (struct foreach_args *)ap;
-    /*
-     * This method does not need us to bump ref, since we are in the
-     * locked context of the rtpp_hash_table, which holds its own ref.
-     */
-    rsrv = (struct rtpp_server *)dp;
-    rsop = CALL_METHOD(fap->rtp_streams_wrt, get_by_idx, rsrv->stuid);
+    rsop = CALL_METHOD(pvt->rtp_streams_wrt, get_by_idx, rsrv->stuid);
     if (rsop == NULL) {
-        return (RTPP_WR_MATCH_CONT);
+        return (0);
     }
     for (;;) {
-        pkt = CALL_METHOD(rsrv, get, fap->dtime, &len);
+        pkt = CALL_METHOD(rsrv, get, dtime, &len);
         if (pkt == NULL) {
             if (len == RTPS_EOF) {
                 struct rtpp_stream *rsop_rtcp;
                 CALL_SMETHOD(rsop, finish_playback, rsrv->sruid);
                 rtps_old = rsrv->sruid;
-                rsop_rtcp = CALL_METHOD(fap->rtcp_streams_wrt, get_by_idx,
+                rsop_rtcp = CALL_METHOD(pvt->rtcp_streams_wrt, get_by_idx,
                   rsop->stuid_rtcp);
                 if (rsop_rtcp != NULL) {
                     CALL_SMETHOD(rsop_rtcp, replace_rtps, rtps_old, RTPP_UID_NONE);
                     CALL_SMETHOD(rsop_rtcp->rcnt, decref);
                 }
                 CALL_SMETHOD(rsop->rcnt, decref);
-                return (RTPP_WR_MATCH_DEL);
+                return (1);
             } else if (len != RTPS_LATER) {
                 /* XXX some error, brag to logs */
             }
@@ -97,25 +234,62 @@ process_rtp_servers_foreach(void *dp, void *ap)
             rtp_packet_free(pkt);
             continue;
         }
-        CALL_SMETHOD(rsop, send_pkt, fap->sender, pkt);
-        fap->rsp->npkts_played.cnt++;
+        CALL_SMETHOD(rsop, send_pkt, sender, pkt);
+        rsp->npkts_played.cnt++;
     }
     CALL_SMETHOD(rsop->rcnt, decref);
-    return (RTPP_WR_MATCH_CONT);
+    return (0);
 }
 
-void
-rtpp_proc_servers(struct cfg *cf, double dtime, struct sthread_args *sender,
-  struct rtpp_proc_rstats *rsp)
+static void
+rtpp_proc_servers_run(struct rtpp_proc_servers *self, double dtime,
+  struct sthread_args *sender, struct rtpp_proc_rstats *rsp)
 {
-    struct foreach_args fargs;
+    struct rtpp_proc_servers_priv *pvt;
+    struct rtpp_server *rsrv;
+    uint64_t sruid;
+    double deadline;
+    int i;
 
-    fargs.dtime = dtime;
-    fargs.sender = sender;
-    fargs.rsp = rsp;
-    fargs.rtp_streams_wrt = cf->stable->rtp_streams_wrt;
-    fargs.rtcp_streams_wrt = cf->stable->rtcp_streams_wrt;
+    pvt = PUB2PVT(self);
 
-    CALL_METHOD(cf->stable->servers_wrt, foreach, process_rtp_servers_foreach,
-      &fargs);
+    pthread_mutex_lock(&pvt->lock);
+    for (i = 0; i < pvt->npending; i++) {
+        sruid = pvt->pending[i];
+        rsrv = CALL_METHOD(pvt->servers_wrt, get_by_idx, sruid);
+        if (rsrv == NULL) {
+            /* Stopped before it had a chance to play anything */
+            continue;
+        }
+        if (psrv_heap_push(&pvt->dq, CALL_METHOD(rsrv, get_deadline),
+          sruid) != 0) {
+            CALL_METHOD(pvt->servers_wrt, unreg, sruid);
+        }
+        CALL_SMETHOD(rsrv->rcnt, decref);
+    }
+    pvt->npending = 0;
+    pthread_mutex_unlock(&pvt->lock);
+
+    while (pvt->dq.len > 0 && pvt->dq.v[0].deadline <= dtime) {
+        sruid = psrv_heap_pop(&pvt->dq);
+        rsrv = CALL_METHOD(pvt->servers_wrt, get_by_idx, sruid);
+        if (rsrv == NULL) {
+            /* Player has been stopped by the command thread */
+            continue;
+        }
+        if (process_rtp_server(pvt, rsrv, dtime, sender, rsp) != 0) {
+            CALL_METHOD(pvt->servers_wrt, unreg, sruid);
+            CALL_SMETHOD(rsrv->rcnt, decref);
+            continue;
+        }
+        deadline = CALL_METHOD(rsrv, get_deadline);
+        if (deadline <= dtime) {
+            /* Could not make progress this time (no stream yet), retry next run */
+            deadline = dtime + 1e-6;
+        }
+        if (psrv_heap_push(&pvt->dq, deadline, sruid) != 0) {
+            CALL_METHOD(pvt->servers_wrt, unreg, sruid);
+        }
+        CALL_SMETHOD(rsrv->rcnt, decref);
+    }
 }
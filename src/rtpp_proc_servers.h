@@ -1,2 +1,55 @@
-void rtpp_proc_servers(struct cfg *, double, struct sthread_args *,
-  struct rtpp_proc_rstats *);
+/*
+ * Copyright (c) 2016 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef _RTPP_PROC_SERVERS_H_
+#define _RTPP_PROC_SERVERS_H_
+
+/*
+ * Deadline queue of the active players. The command thread registers
+ * each new player, the processing thread then only visits players whose
+ * next packet is due instead of walking all of them on every tick.
+ */
+
+struct rtpp_proc_servers;
+struct rtpp_cfg_stable;
+struct rtpp_refcnt;
+struct sthread_args;
+struct rtpp_proc_rstats;
+
+DEFINE_METHOD(rtpp_proc_servers, rtpp_proc_servers_reg, int, uint64_t);
+DEFINE_METHOD(rtpp_proc_servers, rtpp_proc_servers_run, void, double,
+  struct sthread_args *, struct rtpp_proc_rstats *);
+
+struct rtpp_proc_servers {
+    METHOD_ENTRY(rtpp_proc_servers_reg, reg);
+    METHOD_ENTRY(rtpp_proc_servers_run, run);
+    struct rtpp_refcnt *rcnt;
+};
+
+struct rtpp_proc_servers *rtpp_proc_servers_ctor(struct rtpp_cfg_stable *);
+
+#endif
@@ -60,17 +60,22 @@
 #include "rtpp_log_obj.h"
 #include "rtpp_mallocs.h"
 #include "rtpp_monotime.h"
+#include "rtpp_netio_async.h"
 #include "rtpp_network.h"
 #include "rtpp_record.h"
 #include "rtpp_record_fin.h"
+#include "rtpp_record_mmap.h"
 #include "rtpp_record_private.h"
+#include "rtpp_record_writer.h"
 #include "rtpp_session.h"
+#include "rtpp_socket.h"
 #include "rtpp_stream.h"
 #include "rtpp_time.h"
 #include "rtpp_pipe.h"
 #include "rtpp_netaddr.h"
 
-enum record_mode {MODE_LOCAL_PKT, MODE_REMOTE_RTP, MODE_LOCAL_PCAP}; /* MODE_LOCAL_RTP/MODE_REMOTE_PKT? */
+enum record_mode {MODE_LOCAL_PKT, MODE_REMOTE_RTP, MODE_LOCAL_PCAP,
+  MODE_REMOTE_AGG}; /* MODE_LOCAL_RTP/MODE_REMOTE_PKT? */
 
 struct rtpp_record_channel {
     struct rtpp_record pub;
@@ -78,35 +83,93 @@ struct rtpp_record_channel {
     char rpath[PATH_MAX + 1];
     int fd;
     int needspool;
-    char rbuf[4096];
+    char *rbuf;
     int rbuf_len;
+    int rbuf_npkts;
+    /* Set by the writer thread if writing into the file has failed */
+    int werror;
+    struct rtpp_record_writer *writer;
+    /* Set if the file is written via the mapping instead of the writer */
+    int mmapped;
+    struct rtpp_record_mmap rmap;
     enum record_mode mode;
     int record_single_file;
     const char *proto;
     struct rtpp_log *log;
+    /* MODE_REMOTE_AGG: shared socket, target and leg identity */
+    struct rtpp_socket *rsock;
+    struct sockaddr_storage raddr;
+    socklen_t raddr_len;
+    uint32_t leg_id;
+    int rra_flags;
 };
 
-static void rtpp_record_write(struct rtpp_record *, struct rtpp_stream *, struct rtp_packet *);
+static void rtpp_record_write(struct rtpp_record *, struct sthread_args *,
+  struct rtpp_stream *, struct rtp_packet *);
 static void rtpp_record_close(struct rtpp_record_channel *);
+static void rtpp_record_close_fin(struct rtpp_record_channel *);
 static int get_hdr_size(const struct sockaddr *);
 
 #define PUB2PVT(pubp) \
   ((struct rtpp_record_channel *)((char *)(pubp) - offsetof(struct rtpp_record_channel, pub)))
 
+static struct rtpp_socket *
+ropen_agg_sock(struct rtpp_cfg_stable *cfs, struct rtpp_log *log)
+{
+    struct rtpp_socket *rsock;
+
+    /*
+     * Channels are only opened from the command thread, so there is no
+     * need to lock around the lazy creation.
+     */
+    if (cfs->rrec_agg_sock == NULL) {
+        rsock = rtpp_socket_ctor(AF_INET, SOCK_DGRAM);
+        if (rsock == NULL) {
+            RTPP_ELOG(log, RTPP_LOG_ERR, "ropen: can't create socket");
+            return (NULL);
+        }
+        CALL_METHOD(rsock, setnonblock);
+        cfs->rrec_agg_sock = rsock;
+    }
+    CALL_SMETHOD(cfs->rrec_agg_sock->rcnt, incref);
+    return (cfs->rrec_agg_sock);
+}
+
+static void
+ragg_send_ctl(struct rtpp_record_channel *rrc, int flags, const char *msg)
+{
+    struct {
+        struct rtpp_rra_hdr hdr;
+        char msg[256];
+    } cbuf;
+    int len;
+
+    len = (msg != NULL) ? snprintf(cbuf.msg, sizeof(cbuf.msg), "%s", msg) : 0;
+    if (len >= sizeof(cbuf.msg))
+        len = sizeof(cbuf.msg) - 1;
+    cbuf.hdr.version = RRA_VERSION;
+    cbuf.hdr.flags = rrc->rra_flags | flags;
+    cbuf.hdr.plen = htons(len);
+    cbuf.hdr.leg_id = htonl(rrc->leg_id);
+    sendto(CALL_METHOD(rrc->rsock, getfd), &cbuf, sizeof(cbuf.hdr) + len, 0,
+      sstosa(&rrc->raddr), rrc->raddr_len);
+}
+
 static int
-ropen_remote_ctor_pa(struct rtpp_record_channel *rrc, struct rtpp_log *log,
-  char *rname, int is_rtcp)
+ropen_remote_ctor_pa(struct rtpp_record_channel *rrc,
+  struct rtpp_cfg_stable *cfs, struct rtpp_log *log, char *rname, int is_rtcp)
 {
     char *cp, *tmp;
-    int n, port;
-    struct sockaddr_storage raddr;
+    int n, port, agg;
+    static uint32_t last_leg_id = 0;
 
-    tmp = strdup(rname + 4);
+    agg = (strncmp("udpagg:", rname, 7) == 0) ? 1 : 0;
+    tmp = strdup(rname + (agg ? 7 : 4));
     if (tmp == NULL) {
         RTPP_ELOG(log, RTPP_LOG_ERR, "can't allocate memory");
         goto e0;
     }
-    rrc->mode = MODE_REMOTE_RTP;
+    rrc->mode = agg ? MODE_REMOTE_AGG : MODE_REMOTE_RTP;
     rrc->needspool = 0;
     cp = strrchr(tmp, ':');
     if (cp == NULL) {
@@ -116,7 +179,7 @@ ropen_remote_ctor_pa(struct rtpp_record_channel *rrc, struct rtpp_log *log,
     *cp = '\0';
     cp++;
 
-    if (is_rtcp) {
+    if (is_rtcp && !agg) {
         /* Handle RTCP (increase target port by 1) */
         port = atoi(cp);
         if (port <= 0 || port > 65534) {
@@ -126,17 +189,28 @@ ropen_remote_ctor_pa(struct rtpp_record_channel *rrc, struct rtpp_log *log,
         sprintf(cp, "%d", port + 1);
     }
 
-    n = resolve(sstosa(&raddr), AF_INET, tmp, cp, AI_PASSIVE);
+    n = resolve(sstosa(&rrc->raddr), AF_INET, tmp, cp, AI_PASSIVE);
     if (n != 0) {
         RTPP_LOG(log, RTPP_LOG_ERR, "ropen: getaddrinfo: %s", gai_strerror(n));
         goto e1;
     }
+    rrc->raddr_len = SA_LEN(sstosa(&rrc->raddr));
+    if (agg) {
+        /* RTP and RTCP go into the same flow, marked by the header */
+        rrc->rsock = ropen_agg_sock(cfs, log);
+        if (rrc->rsock == NULL)
+            goto e1;
+        rrc->fd = CALL_METHOD(rrc->rsock, getfd);
+        rrc->leg_id = ++last_leg_id;
+        free(tmp);
+        return (0);
+    }
     rrc->fd = socket(AF_INET, SOCK_DGRAM, 0);
     if (rrc->fd == -1) {
         RTPP_ELOG(log, RTPP_LOG_ERR, "ropen: can't create socket");
         goto e1;
     }
-    if (connect(rrc->fd, sstosa(&raddr), SA_LEN(sstosa(&raddr))) == -1) {
+    if (connect(rrc->fd, sstosa(&rrc->raddr), rrc->raddr_len) == -1) {
         RTPP_ELOG(log, RTPP_LOG_ERR, "ropen: can't connect socket");
         goto e2;
     }
@@ -161,7 +235,8 @@ rtpp_record_open(struct cfg *cf, struct rtpp_session *sp, char *rname, int orig,
     int rval, remote;
     pcap_hdr_t pcap_hdr;
 
-    remote = (rname != NULL && strncmp("udp:", rname, 4) == 0) ? 1 : 0;
+    remote = (rname != NULL && (strncmp("udp:", rname, 4) == 0 ||
+      strncmp("udpagg:", rname, 7) == 0)) ? 1 : 0;
 
     rrc = rtpp_rzmalloc(sizeof(*rrc), &rcnt);
     if (rrc == NULL) {
@@ -180,10 +255,22 @@ rtpp_record_open(struct cfg *cf, struct rtpp_session *sp, char *rname, int orig,
     CALL_SMETHOD(sp->log->rcnt, incref);
     rrc->pub.write = &rtpp_record_write;
     if (remote) {
-	rval = ropen_remote_ctor_pa(rrc, sp->log, rname, (record_type == RECORD_RTCP));
+	rval = ropen_remote_ctor_pa(rrc, cf->stable, sp->log, rname,
+          (record_type == RECORD_RTCP));
         if (rval < 0) {
             goto e2;
         }
+        if (rrc->mode == MODE_REMOTE_AGG) {
+            char lbuf[256];
+
+            if (orig == 0)
+                rrc->rra_flags |= RRA_F_ANSWER;
+            if (record_type == RECORD_RTCP)
+                rrc->rra_flags |= RRA_F_RTCP;
+            snprintf(lbuf, sizeof(lbuf), "%s %s", sp->call_id,
+              sp->tag_nomedianum);
+            ragg_send_ctl(rrc, RRA_F_START, lbuf);
+        }
         CALL_SMETHOD(rrc->pub.rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_record_close,
           rrc);
         return (&rrc->pub);
@@ -193,7 +280,6 @@ rtpp_record_open(struct cfg *cf, struct rtpp_session *sp, char *rname, int orig,
 	RTPP_LOG(sp->log, RTPP_LOG_ERR, "directory for saving local recordings is not configured");
         goto e2;
     }
-
     if (cf->stable->record_pcap != 0) {
 	rrc->mode = MODE_LOCAL_PCAP;
     } else {
@@ -225,7 +311,9 @@ rtpp_record_open(struct cfg *cf, struct rtpp_session *sp, char *rname, int orig,
     } else {
 	sprintf(rrc->spath, "%s/%s%s", sdir, rname, suffix2);
     }
-    rrc->fd = open(rrc->spath, O_WRONLY | O_CREAT | O_TRUNC, DEFFILEMODE);
+    /* Shared writable mapping needs the file to be open for reading too */
+    rrc->fd = open(rrc->spath, ((cf->stable->record_io_mmap != 0) ? O_RDWR :
+      O_WRONLY) | O_CREAT | O_TRUNC, DEFFILEMODE);
     if (rrc->fd == -1) {
 	RTPP_ELOG(sp->log, RTPP_LOG_ERR, "can't open file %s for writing",
 	  rrc->spath);
@@ -253,6 +341,24 @@ rtpp_record_open(struct cfg *cf, struct rtpp_session *sp, char *rname, int orig,
 	}
     }
 
+    if (cf->stable->record_io_mmap != 0) {
+	if (rtpp_record_mmap_open(&rrc->rmap, rrc->fd,
+	  lseek(rrc->fd, 0, SEEK_CUR)) == 0) {
+	    rrc->mmapped = 1;
+	} else {
+	    RTPP_ELOG(sp->log, RTPP_LOG_ERR, "%s: can't map file, falling "
+	      "back to write(2)", rrc->spath);
+	}
+    }
+    if (rrc->mmapped == 0) {
+	rrc->writer = cf->stable->rtpp_recwr_cf;
+	rrc->rbuf = malloc(RTPP_RECORD_BUFSIZE);
+	if (rrc->rbuf == NULL) {
+	    RTPP_ELOG(sp->log, RTPP_LOG_ERR, "can't allocate memory");
+	    goto e3;
+	}
+    }
+
     CALL_SMETHOD(rrc->pub.rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_record_close,
       rrc);
     return (&rrc->pub);
@@ -260,6 +366,8 @@ rtpp_record_open(struct cfg *cf, struct rtpp_session *sp, char *rname, int orig,
 e3:
     close(rrc->fd);
 e2:
+    if (rrc->rbuf != NULL)
+        free(rrc->rbuf);
     CALL_SMETHOD(rrc->log->rcnt, decref);
     CALL_SMETHOD(rrc->pub.rcnt, decref);
     free(rrc);
@@ -267,23 +375,43 @@ e0:
     return NULL;
 }
 
+static void
+rtpp_record_wreq_init(struct rtpp_record_channel *rrc,
+  struct rtpp_record_wreq *wrp)
+{
+
+    memset(wrp, '\0', sizeof(*wrp));
+    wrp->fd = rrc->fd;
+    wrp->buf = rrc->rbuf;
+    wrp->len = rrc->rbuf_len;
+    wrp->npkts = rrc->rbuf_npkts;
+    wrp->errp = &rrc->werror;
+    wrp->proto = rrc->proto;
+    wrp->log = rrc->log;
+}
+
 static int
 flush_rbuf(struct rtpp_record_channel *rrc)
 {
-    int rval;
-
-    rval = write(rrc->fd, rrc->rbuf, rrc->rbuf_len);
-    if (rval != -1) {
-	rrc->rbuf_len = 0;
-	return 0;
+    struct rtpp_record_wreq wreq;
+    char *nbuf;
+
+    nbuf = malloc(RTPP_RECORD_BUFSIZE);
+    if (nbuf == NULL) {
+	RTPP_ELOG(rrc->log, RTPP_LOG_ERR, "can't allocate memory");
+    }
+    rtpp_record_wreq_init(rrc, &wreq);
+    wreq.rcnt = rrc->pub.rcnt;
+    if (nbuf == NULL || CALL_METHOD(rrc->writer, enqueue, &wreq, 0) != 0) {
+	/* Writer is overloaded, discard the buffer and carry on */
+	if (nbuf != NULL)
+	    free(nbuf);
+    } else {
+	rrc->rbuf = nbuf;
     }
-
-    RTPP_ELOG(rrc->log, RTPP_LOG_ERR, "error while recording session (%s)",
-      rrc->proto);
-    /* Prevent futher writing if error happens */
-    close(rrc->fd);
-    rrc->fd = -1;
-    return -1;
+    rrc->rbuf_len = 0;
+    rrc->rbuf_npkts = 0;
+    return 0;
 }
 
 static int
@@ -456,7 +584,7 @@ prepare_pkt_hdr_pcap(struct rtpp_log *log, struct rtp_packet *packet,
         ipp.v4->ip_p = IPPROTO_UDP;
         ipp.v4->ip_id = htons(ip_id++);
         ipp.v4->ip_ttl = 127;
-        ipp.v4->ip_sum = rtpp_in_cksum(ipp.v4, sizeof(*ipp.v4));
+        ipp.v4->ip_sum = rtpp_in_cksum_ip4(ipp.v4);
     } else {
         ipp.v6->ip6_vfc |= IPV6_VERSION;
         ipp.v6->ip6_hlim = IPV6_DEFHLIM;
@@ -517,17 +645,32 @@ get_hdr_size(const struct sockaddr *raddr)
 }
 
 static void
-rtpp_record_write(struct rtpp_record *self, struct rtpp_stream *stp, struct rtp_packet *packet)
+ragg_send_pkt(struct rtpp_record_channel *rrc, struct sthread_args *sender,
+  struct rtpp_stream *stp, struct rtp_packet *packet)
 {
-    struct iovec v[2];
-    union {
-	union pkt_hdr_pcap pcap;
-	struct pkt_hdr_adhoc adhoc;
-    } hdr;
-    int rval, hdr_size;
+    struct {
+        struct rtpp_rra_hdr hdr;
+        unsigned char buf[sizeof(packet->data.buf)];
+    } abuf;
+
+    abuf.hdr.version = RRA_VERSION;
+    abuf.hdr.flags = rrc->rra_flags;
+    if (stp->pipe_type != PIPE_RTP)
+        abuf.hdr.flags |= RRA_F_RTCP;
+    abuf.hdr.plen = htons(packet->size);
+    abuf.hdr.leg_id = htonl(rrc->leg_id);
+    memcpy(abuf.buf, packet->data.buf, packet->size);
+    rtpp_anetio_send_buf(sender, rrc->fd, &abuf, sizeof(abuf.hdr) +
+      packet->size, sstosa(&rrc->raddr), rrc->raddr_len, rrc->pub.rcnt);
+}
+
+static void
+rtpp_record_write(struct rtpp_record *self, struct sthread_args *sender,
+  struct rtpp_stream *stp, struct rtp_packet *packet)
+{
+    int hdr_size;
     int (*prepare_pkt_hdr)(struct rtpp_log *, struct rtp_packet *, void *,
       const struct sockaddr *, struct sockaddr *, int, int);
-    const char *proto;
     struct sockaddr_storage daddr;
     struct sockaddr *ldaddr;
     int ldport, face;
@@ -536,20 +679,35 @@ rtpp_record_write(struct rtpp_record *self, struct rtpp_stream *stp, struct rtp_
 
     rrc = PUB2PVT(self);
 
-    if (rrc->fd == -1)
+    if (rrc->fd == -1 || rrc->werror != 0)
 	return;
 
+    /*
+     * Remote recording goes out via the async sender, so that it's
+     * batched together with the relayed packets. The channel is kept
+     * referenced until the datagram has been sent.
+     */
+    switch (rrc->mode) {
+    case MODE_REMOTE_RTP:
+	rtpp_anetio_send_buf(sender, rrc->fd, packet->data.buf, packet->size,
+	  NULL, 0, rrc->pub.rcnt);
+	return;
+
+    case MODE_REMOTE_AGG:
+	ragg_send_pkt(rrc, sender, stp, packet);
+	return;
+
+    default:
+	break;
+    }
+
     dalen = CALL_SMETHOD(stp->rem_addr, get, sstosa(&daddr), sizeof(daddr));
     ldaddr = stp->laddr;
     ldport = stp->port;
 
     switch (rrc->mode) {
-    case MODE_REMOTE_RTP:
-	send(rrc->fd, packet->data.buf, packet->size, 0);
-	return;
-
     case MODE_LOCAL_PKT:
-	hdr_size = sizeof(hdr.adhoc);
+	hdr_size = sizeof(struct pkt_hdr_adhoc);
 	prepare_pkt_hdr = (void *)&prepare_pkt_hdr_adhoc;
 	break;
 
@@ -563,57 +721,101 @@ rtpp_record_write(struct rtpp_record *self, struct rtpp_stream *stp, struct rtp_
         abort();
     }
 
-    /* Check if the write buffer has necessary space, and flush if not */
-    if ((rrc->rbuf_len + hdr_size + packet->size > sizeof(rrc->rbuf)) && rrc->rbuf_len > 0)
-	if (flush_rbuf(rrc) != 0)
-	    return;
-
     face = (rrc->record_single_file == 0) ? 0 : (stp->pipe_type != PIPE_RTP);
 
-    /* Check if received packet doesn't fit into the buffer, do synchronous write  if so */
-    if (rrc->rbuf_len + hdr_size + packet->size > sizeof(rrc->rbuf)) {
-	if (prepare_pkt_hdr(stp->log, packet, (void *)&hdr, sstosa(&daddr), ldaddr, ldport, face) != 0)
-	    return;
-
-	v[0].iov_base = (void *)&hdr;
-	v[0].iov_len = hdr_size;
-	v[1].iov_base = packet->data.buf;
-	v[1].iov_len = packet->size;
+    if (rrc->mmapped != 0) {
+	char *wp;
 
-	rval = writev(rrc->fd, v, 2);
-	if (rval != -1)
+	/* Store header and the packet straight into the file mapping */
+	wp = rtpp_record_mmap_reserve(&rrc->rmap, hdr_size + packet->size);
+	if (wp == NULL) {
+	    RTPP_ELOG(rrc->log, RTPP_LOG_ERR, "error while recording session (%s)",
+	      rrc->proto);
+	    rrc->werror = 1;
 	    return;
-
-        proto = CALL_SMETHOD(stp, get_proto);
-	RTPP_ELOG(stp->log, RTPP_LOG_ERR, "error while recording session (%s)",
-	  proto);
-	/* Prevent futher writing if error happens */
-	close(rrc->fd);
-	rrc->fd = -1;
+	}
+	if (prepare_pkt_hdr(stp->log, packet, (void *)wp, sstosa(&daddr),
+	  ldaddr, ldport, face) != 0) {
+	    rrc->rmap.pos -= hdr_size + packet->size;
+	    return;
+	}
+	memcpy(wp + hdr_size, packet->data.buf, packet->size);
 	return;
     }
+
+    /*
+     * Check if the write buffer has necessary space, and hand it over to
+     * the writer if not. Buffer is large enough to hold the largest packet
+     * we can receive along with its header.
+     */
+    if (rrc->rbuf_len + hdr_size + packet->size > RTPP_RECORD_BUFSIZE)
+	if (flush_rbuf(rrc) != 0)
+	    return;
+
     if (prepare_pkt_hdr(stp->log, packet, (void *)rrc->rbuf + rrc->rbuf_len,
       sstosa(&daddr), ldaddr, ldport, face) != 0)
 	return;
     rrc->rbuf_len += hdr_size;
     memcpy(rrc->rbuf + rrc->rbuf_len, packet->data.buf, packet->size);
     rrc->rbuf_len += packet->size;
+    rrc->rbuf_npkts += 1;
 }
 
 static void
 rtpp_record_close(struct rtpp_record_channel *rrc)
 {
-    static int keep = 1;
+    struct rtpp_record_wreq wreq;
 
     rtpp_record_fin(&rrc->pub);
-    if (rrc->mode != MODE_REMOTE_RTP && rrc->rbuf_len > 0)
-	flush_rbuf(rrc);
+    if (rrc->mode == MODE_REMOTE_AGG) {
+	ragg_send_ctl(rrc, RRA_F_END, NULL);
+	CALL_SMETHOD(rrc->rsock->rcnt, decref);
+	goto done;
+    }
+    if (rrc->mode == MODE_REMOTE_RTP) {
+	if (rrc->fd != -1)
+	    close(rrc->fd);
+	goto done;
+    }
 
-    if (rrc->fd != -1)
+    if (rrc->mmapped != 0) {
+	if (rtpp_record_mmap_close(&rrc->rmap) == -1)
+	    RTPP_ELOG(rrc->log, RTPP_LOG_ERR, "can't truncate session record "
+	      "%s", rrc->spath);
 	close(rrc->fd);
+	rtpp_record_close_fin(rrc);
+	return;
+    }
 
-    if (rrc->mode == MODE_REMOTE_RTP)
-	goto done;
+    /*
+     * Let the writer push out whatever is left in the buffer once all
+     * previously queued buffers are on the disk, then close the file and
+     * move it out of the spool from its thread.
+     */
+    rtpp_record_wreq_init(rrc, &wreq);
+    wreq.closefd = 1;
+    wreq.done = (void (*)(void *))&rtpp_record_close_fin;
+    wreq.done_arg = rrc;
+    if (CALL_METHOD(rrc->writer, enqueue, &wreq, 1) == 0)
+	return;
+    if (rrc->werror == 0 && rrc->rbuf_len > 0 &&
+      write(rrc->fd, rrc->rbuf, rrc->rbuf_len) == -1)
+	RTPP_ELOG(rrc->log, RTPP_LOG_ERR, "error while recording session (%s)",
+	  rrc->proto);
+    free(rrc->rbuf);
+    close(rrc->fd);
+    rtpp_record_close_fin(rrc);
+    return;
+
+done:
+    CALL_SMETHOD(rrc->log->rcnt, decref);
+    free(rrc);
+}
+
+static void
+rtpp_record_close_fin(struct rtpp_record_channel *rrc)
+{
+    static int keep = 1;
 
     if (keep == 0) {
 	if (unlink(rrc->spath) == -1)
@@ -624,7 +826,6 @@ rtpp_record_close(struct rtpp_record_channel *rrc)
 	    RTPP_ELOG(rrc->log, RTPP_LOG_ERR, "can't move "
 	      "session record from spool into permanent storage");
     }
-done:
     CALL_SMETHOD(rrc->log->rcnt, decref);
 
     free(rrc);
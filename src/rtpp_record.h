@@ -34,8 +34,10 @@ struct rtpp_session;
 struct rtpp_stream;
 struct rtp_packet;
 struct rtpp_record;
+struct sthread_args;
 
-DEFINE_METHOD(rtpp_record, rtpp_record_write, void, struct rtpp_stream *, struct rtp_packet *);
+DEFINE_METHOD(rtpp_record, rtpp_record_write, void, struct sthread_args *,
+  struct rtpp_stream *, struct rtp_packet *);
 
 struct rtpp_record {
     struct rtpp_refcnt *rcnt;
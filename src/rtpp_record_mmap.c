@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2016 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Writing recordings through a memory-mapped window. The file is extended
+ * and the space preallocated one RTPP_RECORD_SEGSIZE segment at a time,
+ * so that appending a record is just a store into the mapping. A syscall
+ * is only needed when crossing into the next segment. When the recording
+ * is closed the file is truncated back to the amount of data written.
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include "config_pp.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <unistd.h>
+
+#include "rtpp_record_mmap.h"
+
+static int
+rtpp_record_mmap_map(struct rtpp_record_mmap *rmp)
+{
+    off_t woff;
+    void *base;
+    int rval;
+
+    woff = rmp->pos - (rmp->pos % getpagesize());
+    /*
+     * The space has to be really allocated: extending a sparse file
+     * instead would make stores into the mapping SIGBUS once the disk
+     * fills up, so there is no fallback to ftruncate(2) here.
+     */
+    rval = posix_fallocate(rmp->fd, woff, RTPP_RECORD_SEGSIZE);
+    if (rval != 0) {
+        errno = rval;
+        return (-1);
+    }
+    base = mmap(NULL, RTPP_RECORD_SEGSIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+      rmp->fd, woff);
+    if (base == MAP_FAILED)
+        return (-1);
+    rmp->base = base;
+    rmp->woff = woff;
+    return (0);
+}
+
+static void
+rtpp_record_mmap_unmap(struct rtpp_record_mmap *rmp)
+{
+
+    if (rmp->base == NULL)
+        return;
+    munmap(rmp->base, RTPP_RECORD_SEGSIZE);
+    rmp->base = NULL;
+}
+
+int
+rtpp_record_mmap_open(struct rtpp_record_mmap *rmp, int fd, off_t pos)
+{
+
+    rmp->fd = fd;
+    rmp->base = NULL;
+    rmp->woff = 0;
+    rmp->pos = pos;
+    if (rtpp_record_mmap_map(rmp) != 0) {
+        /* Could have been extended already, undo that */
+        ftruncate(fd, pos);
+        return (-1);
+    }
+    return (0);
+}
+
+/*
+ * Return pointer to the next len bytes of the file, mapping in the next
+ * segment if the current one does not have enough space left. The len
+ * has to be well below RTPP_RECORD_SEGSIZE.
+ */
+void *
+rtpp_record_mmap_reserve(struct rtpp_record_mmap *rmp, size_t len)
+{
+    char *rp;
+
+    if (rmp->base == NULL || rmp->pos + len > rmp->woff + RTPP_RECORD_SEGSIZE) {
+        rtpp_record_mmap_unmap(rmp);
+        if (rtpp_record_mmap_map(rmp) != 0)
+            return (NULL);
+    }
+    rp = rmp->base + (rmp->pos - rmp->woff);
+    rmp->pos += len;
+    return (rp);
+}
+
+int
+rtpp_record_mmap_close(struct rtpp_record_mmap *rmp)
+{
+
+    rtpp_record_mmap_unmap(rmp);
+    return (ftruncate(rmp->fd, rmp->pos));
+}
@@ -130,6 +130,27 @@ union sockaddr_in_s {
     struct sockaddr_in6_s in6;
 };
 
+/*
+ * Header prepended to each packet sent to the aggregated remote recording
+ * target ("udpagg:" in place of "udp:"). All legs being recorded share
+ * the same UDP flow and are told apart by the leg_id. The RRA_F_START
+ * message carries "call_id tag" and is sent when the leg is opened, the
+ * RRA_F_END one has no payload and is sent once the last packet has
+ * gone out.
+ */
+#define	RRA_VERSION	1
+#define	RRA_F_RTCP	0x01	/* Payload is RTCP, RTP otherwise */
+#define	RRA_F_ANSWER	0x02	/* Leg is on the answering side */
+#define	RRA_F_START	0x04	/* Leg has been opened */
+#define	RRA_F_END	0x08	/* Leg has been closed */
+
+struct rtpp_rra_hdr {
+    uint8_t version;
+    uint8_t flags;
+    uint16_t plen;		/* Length of the payload, network order */
+    uint32_t leg_id;		/* Network order */
+} __attribute__((__packed__));
+
 struct pkt_hdr_adhoc {
     union sockaddr_in_s addr;   /* Source address */
     double time;		/* Time of arrival */
@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2016 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Minimal io_uring(7) wrapper for the recording writer: queue up a number
+ * of writev(2)/close(2) requests, push them to the kernel with a single
+ * io_uring_enter(2) and wait for all of them to complete. Only the bits
+ * we need are implemented, so that we don't depend on the liburing. All
+ * functions must be called from the same thread.
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include "config_pp.h"
+#endif
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(HAVE_LINUX_IO_URING_H)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#endif
+
+#include "rtpp_record_uring.h"
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(IORING_FEAT_RW_CUR_POS)
+
+struct rtpp_record_uring {
+    int ring_fd;
+    unsigned int sq_entries;
+    void *sq_ptr;
+    size_t sq_size;
+    void *cq_ptr;
+    size_t cq_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+    /* Requests queued up but not yet submitted */
+    unsigned int sq_ltail;
+    unsigned int npending;
+};
+
+struct rtpp_record_uring *
+rtpp_record_uring_ctor(unsigned int entries)
+{
+    struct rtpp_record_uring *rup;
+    struct io_uring_params p;
+
+    rup = malloc(sizeof(*rup));
+    if (rup == NULL)
+        goto e0;
+    memset(rup, '\0', sizeof(*rup));
+    memset(&p, '\0', sizeof(p));
+    rup->ring_fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (rup->ring_fd < 0)
+        goto e1;
+    /*
+     * We rely on the offset of -1 meaning "current file position", so
+     * that files opened without O_APPEND keep their semantics.
+     */
+    if ((p.features & IORING_FEAT_RW_CUR_POS) == 0)
+        goto e2;
+    rup->sq_entries = p.sq_entries;
+    rup->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    rup->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (rup->cq_size > rup->sq_size)
+            rup->sq_size = rup->cq_size;
+        rup->cq_size = 0;
+    }
+    rup->sq_ptr = mmap(NULL, rup->sq_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, rup->ring_fd, IORING_OFF_SQ_RING);
+    if (rup->sq_ptr == MAP_FAILED)
+        goto e2;
+    if (rup->cq_size == 0) {
+        rup->cq_ptr = rup->sq_ptr;
+    } else {
+        rup->cq_ptr = mmap(NULL, rup->cq_size, PROT_READ | PROT_WRITE,
+          MAP_SHARED | MAP_POPULATE, rup->ring_fd, IORING_OFF_CQ_RING);
+        if (rup->cq_ptr == MAP_FAILED)
+            goto e3;
+    }
+    rup->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    rup->sqes = mmap(NULL, rup->sqes_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, rup->ring_fd, IORING_OFF_SQES);
+    if (rup->sqes == MAP_FAILED)
+        goto e4;
+    rup->sq_head = (unsigned int *)((char *)rup->sq_ptr + p.sq_off.head);
+    rup->sq_tail = (unsigned int *)((char *)rup->sq_ptr + p.sq_off.tail);
+    rup->sq_mask = (unsigned int *)((char *)rup->sq_ptr + p.sq_off.ring_mask);
+    rup->sq_array = (unsigned int *)((char *)rup->sq_ptr + p.sq_off.array);
+    rup->cq_head = (unsigned int *)((char *)rup->cq_ptr + p.cq_off.head);
+    rup->cq_tail = (unsigned int *)((char *)rup->cq_ptr + p.cq_off.tail);
+    rup->cq_mask = (unsigned int *)((char *)rup->cq_ptr + p.cq_off.ring_mask);
+    rup->cqes = (struct io_uring_cqe *)((char *)rup->cq_ptr + p.cq_off.cqes);
+    rup->sq_ltail = *rup->sq_tail;
+    return (rup);
+
+e4:
+    if (rup->cq_size != 0)
+        munmap(rup->cq_ptr, rup->cq_size);
+e3:
+    munmap(rup->sq_ptr, rup->sq_size);
+e2:
+    close(rup->ring_fd);
+e1:
+    free(rup);
+e0:
+    return (NULL);
+}
+
+void
+rtpp_record_uring_dtor(struct rtpp_record_uring *rup)
+{
+
+    munmap(rup->sqes, rup->sqes_size);
+    if (rup->cq_size != 0)
+        munmap(rup->cq_ptr, rup->cq_size);
+    munmap(rup->sq_ptr, rup->sq_size);
+    close(rup->ring_fd);
+    free(rup);
+}
+
+static struct io_uring_sqe *
+rtpp_record_uring_get_sqe(struct rtpp_record_uring *rup)
+{
+    struct io_uring_sqe *sqe;
+    unsigned int idx;
+
+    if (rup->sq_ltail - __atomic_load_n(rup->sq_head, __ATOMIC_ACQUIRE) >=
+      rup->sq_entries)
+        return (NULL);
+    idx = rup->sq_ltail & *rup->sq_mask;
+    sqe = &rup->sqes[idx];
+    memset(sqe, '\0', sizeof(*sqe));
+    rup->sq_array[idx] = idx;
+    rup->sq_ltail++;
+    rup->npending++;
+    return (sqe);
+}
+
+int
+rtpp_record_uring_writev(struct rtpp_record_uring *rup, int fd,
+  const struct iovec *iov, int iovcnt, void *udata)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = rtpp_record_uring_get_sqe(rup);
+    if (sqe == NULL)
+        return (-1);
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fd;
+    sqe->off = (uint64_t)-1;
+    sqe->addr = (uintptr_t)iov;
+    sqe->len = iovcnt;
+    sqe->user_data = (uintptr_t)udata;
+    return (0);
+}
+
+int
+rtpp_record_uring_close(struct rtpp_record_uring *rup, int fd, void *udata)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = rtpp_record_uring_get_sqe(rup);
+    if (sqe == NULL)
+        return (-1);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = (uintptr_t)udata;
+    return (0);
+}
+
+/*
+ * Submit everything that has been queued and wait for all of it to
+ * complete, invoking the callback with the result of each request.
+ */
+int
+rtpp_record_uring_run(struct rtpp_record_uring *rup, rtpp_record_uring_cb_t cb)
+{
+    struct io_uring_cqe *cqe;
+    unsigned int head, tail, nsubmit, ninflight;
+    int rval;
+
+    __atomic_store_n(rup->sq_tail, rup->sq_ltail, __ATOMIC_RELEASE);
+    nsubmit = rup->npending;
+    ninflight = 0;
+    while (nsubmit > 0 || ninflight > 0) {
+        rval = syscall(__NR_io_uring_enter, rup->ring_fd, nsubmit, 1,
+          IORING_ENTER_GETEVENTS, NULL, 0);
+        if (rval < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                continue;
+            return (-1);
+        }
+        if (rval == 0 && ninflight == 0)
+            return (-1);
+        nsubmit -= rval;
+        ninflight += rval;
+        head = *rup->cq_head;
+        tail = __atomic_load_n(rup->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            cqe = &rup->cqes[head & *rup->cq_mask];
+            cb((void *)(uintptr_t)cqe->user_data, cqe->res);
+            ninflight--;
+        }
+        __atomic_store_n(rup->cq_head, head, __ATOMIC_RELEASE);
+    }
+    rup->npending = 0;
+    return (0);
+}
+
+#else /* !HAVE_LINUX_IO_URING_H */
+
+struct rtpp_record_uring *
+rtpp_record_uring_ctor(unsigned int entries)
+{
+
+    return (NULL);
+}
+
+void
+rtpp_record_uring_dtor(struct rtpp_record_uring *rup)
+{
+
+    abort();
+}
+
+int
+rtpp_record_uring_writev(struct rtpp_record_uring *rup, int fd,
+  const struct iovec *iov, int iovcnt, void *udata)
+{
+
+    abort();
+}
+
+int
+rtpp_record_uring_close(struct rtpp_record_uring *rup, int fd, void *udata)
+{
+
+    abort();
+}
+
+int
+rtpp_record_uring_run(struct rtpp_record_uring *rup, rtpp_record_uring_cb_t cb)
+{
+
+    abort();
+}
+
+#endif
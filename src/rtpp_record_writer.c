@@ -0,0 +1,455 @@
+/*
+ * Copyright (c) 2016 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Writer thread for the session recordings. Recording channels fill
+ * their buffers in the packet processing thread and hand complete
+ * buffers over here, so that slow storage never stalls the media
+ * relay. All buffers for the same file found in a batch are pushed out
+ * with a single writev(2). Where io_uring(7) is available, all writes
+ * (and then closes) from a batch are submitted to the kernel at once
+ * instead. If the queue grows over the limit, new buffers are discarded
+ * and the number of packets lost is accounted.
+ */
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rtpp_log.h"
+#include "rtpp_types.h"
+#include "rtpp_refcnt.h"
+#include "rtpp_log_obj.h"
+#include "rtpp_queue.h"
+#include "rtpp_record_writer.h"
+#include "rtpp_record_uring.h"
+#include "rtpp_mallocs.h"
+#include "rtpp_stats.h"
+#include "rtpp_wi.h"
+#include "rtpp_wi_private.h"
+
+#define RTPP_RECORD_WRITER_BATCH 64
+/* Maximum number of buffers waiting to be written, 64MB in total */
+#define RTPP_RECORD_WRITER_MAXQ  1024
+
+/* All requests for the same file taken from the queue in one batch */
+struct rtpp_record_wrun {
+    struct rtpp_wi **wis;
+    int nwis;
+    struct rtpp_record_wreq *wrp;
+    struct iovec *iov;
+    int niov;
+    ssize_t len;
+    ssize_t res;
+};
+
+#define RTPP_RECORD_WRUN_NORES LONG_MIN
+
+struct rtpp_record_writer_priv {
+    struct rtpp_record_writer pub;
+    struct rtpp_queue *wqueue;
+    struct rtpp_wi *sigterm;
+    pthread_t thread_id;
+    struct rtpp_record_uring *uring;
+    struct rtpp_log *glog;
+    struct rtpp_stats *rtpp_stats;
+    struct {
+        int nbytes_written;
+        int npkts_dropped;
+    } stats_idx;
+};
+
+#define PUB2PVT(pubp) \
+  ((struct rtpp_record_writer_priv *)((char *)(pubp) - offsetof(struct rtpp_record_writer_priv, pub)))
+
+static int rtpp_record_writer_enqueue(struct rtpp_record_writer *,
+  const struct rtpp_record_wreq *, int);
+static void rtpp_record_writer_dtor(struct rtpp_record_writer *);
+
+static void
+iov_skip(struct iovec **iovp, int *iovcntp, size_t len)
+{
+    struct iovec *iov;
+    int iovcnt;
+
+    iov = *iovp;
+    iovcnt = *iovcntp;
+    while (iovcnt > 0 && len >= iov->iov_len) {
+        len -= iov->iov_len;
+        iov++;
+        iovcnt--;
+    }
+    if (iovcnt > 0) {
+        iov->iov_base = (char *)iov->iov_base + len;
+        iov->iov_len -= len;
+    }
+    *iovp = iov;
+    *iovcntp = iovcnt;
+}
+
+static ssize_t
+writev_all(int fd, struct iovec *iov, int iovcnt)
+{
+    ssize_t rval, total;
+
+    total = 0;
+    while (iovcnt > 0) {
+        rval = writev(fd, iov, iovcnt);
+        if (rval == -1) {
+            if (errno == EINTR)
+                continue;
+            return (-1);
+        }
+        total += rval;
+        /* Skip over whatever has been written, resume on short write */
+        iov_skip(&iov, &iovcnt, rval);
+    }
+    return (total);
+}
+
+static void
+rtpp_record_wrun_setres(void *arg, int res)
+{
+    struct rtpp_record_wrun *rp;
+
+    rp = (struct rtpp_record_wrun *)arg;
+    rp->res = res;
+}
+
+static void
+rtpp_record_writer_uring_fail(struct rtpp_record_writer_priv *pvt)
+{
+
+    RTPP_LOG(pvt->glog, RTPP_LOG_ERR, "io_uring submission has failed, "
+      "switching recording writer to writev(2)");
+    rtpp_record_uring_dtor(pvt->uring);
+    pvt->uring = NULL;
+}
+
+static void
+rtpp_record_writer_write(struct rtpp_record_writer_priv *pvt,
+  struct rtpp_record_wrun runs[], int nruns)
+{
+    struct rtpp_record_wrun *rp;
+    struct iovec *iov;
+    int i, iovcnt;
+    ssize_t rval;
+
+    if (pvt->uring != NULL) {
+        for (i = 0; i < nruns; i++) {
+            rp = &runs[i];
+            if (rp->niov == 0 || *rp->wrp->errp != 0)
+                continue;
+            if (rtpp_record_uring_writev(pvt->uring, rp->wrp->fd, rp->iov,
+              rp->niov, rp) != 0)
+                break;
+        }
+        if (rtpp_record_uring_run(pvt->uring, rtpp_record_wrun_setres) != 0)
+            rtpp_record_writer_uring_fail(pvt);
+    }
+    for (i = 0; i < nruns; i++) {
+        rp = &runs[i];
+        if (rp->niov == 0 || *rp->wrp->errp != 0)
+            continue;
+        iov = rp->iov;
+        iovcnt = rp->niov;
+        if (rp->res == RTPP_RECORD_WRUN_NORES) {
+            /* Not submitted */
+            rp->res = 0;
+        } else if (rp->res < 0 || rp->res == rp->len) {
+            continue;
+        }
+        /* Short write or not submitted at all, finish it synchronously */
+        iov_skip(&iov, &iovcnt, rp->res);
+        rval = writev_all(rp->wrp->fd, iov, iovcnt);
+        rp->res = (rval == -1) ? -1 : rp->res + rval;
+    }
+}
+
+static void
+rtpp_record_writer_close(struct rtpp_record_writer_priv *pvt,
+  struct rtpp_record_wrun runs[], int nruns)
+{
+    struct rtpp_record_wrun *rp;
+    int i, nclose;
+
+    nclose = 0;
+    if (pvt->uring != NULL) {
+        for (i = 0; i < nruns; i++) {
+            rp = &runs[i];
+            if (rp->wrp->closefd == 0)
+                continue;
+            if (rtpp_record_uring_close(pvt->uring, rp->wrp->fd, rp) != 0)
+                break;
+            rp->wrp->closefd = 0;
+            nclose++;
+        }
+        if (nclose > 0 &&
+          rtpp_record_uring_run(pvt->uring, rtpp_record_wrun_setres) != 0)
+            rtpp_record_writer_uring_fail(pvt);
+    }
+    for (i = 0; i < nruns; i++) {
+        rp = &runs[i];
+        if (rp->wrp->closefd != 0)
+            close(rp->wrp->fd);
+    }
+}
+
+static void
+rtpp_record_writer_flush(struct rtpp_record_writer_priv *pvt,
+  struct rtpp_record_wrun runs[], int nruns)
+{
+    struct rtpp_record_wrun *rp;
+    struct rtpp_record_wreq *wrp;
+    int i, j;
+
+    rtpp_record_writer_write(pvt, runs, nruns);
+    for (i = 0; i < nruns; i++) {
+        rp = &runs[i];
+        /* All requests in the run share the same file and the error flag */
+        if (rp->niov == 0 || *rp->wrp->errp != 0)
+            continue;
+        if (rp->res < 0) {
+            RTPP_ELOG(rp->wrp->log, RTPP_LOG_ERR, "error while recording "
+              "session (%s)", rp->wrp->proto);
+            /* Prevent further writing if error happens */
+            *rp->wrp->errp = 1;
+        } else {
+            CALL_METHOD(pvt->rtpp_stats, updatebyidx,
+              pvt->stats_idx.nbytes_written, rp->res);
+        }
+    }
+    rtpp_record_writer_close(pvt, runs, nruns);
+    for (i = 0; i < nruns; i++) {
+        rp = &runs[i];
+        for (j = 0; j < rp->nwis; j++) {
+            wrp = rtpp_wi_data_get_ptr(rp->wis[j], sizeof(*wrp), sizeof(*wrp));
+            if (wrp->buf != NULL)
+                free(wrp->buf);
+            if (wrp->done != NULL)
+                wrp->done(wrp->done_arg);
+            rtpp_wi_free(rp->wis[j]);
+        }
+    }
+}
+
+static void
+rtpp_record_writer_run(void *arg)
+{
+    struct rtpp_record_writer_priv *pvt;
+    struct rtpp_wi *wis[RTPP_RECORD_WRITER_BATCH];
+    struct rtpp_wi *rwis[RTPP_RECORD_WRITER_BATCH];
+    struct iovec iov[RTPP_RECORD_WRITER_BATCH];
+    struct rtpp_record_wrun runs[RTPP_RECORD_WRITER_BATCH], *rp;
+    struct rtpp_record_wreq *wrp;
+    int ridx[RTPP_RECORD_WRITER_BATCH];
+    int nwis, nruns, niov, i, j, shutdown;
+
+    pvt = (struct rtpp_record_writer_priv *)arg;
+    shutdown = 0;
+    for (;;) {
+        nwis = rtpp_queue_get_items(pvt->wqueue, wis,
+          RTPP_RECORD_WRITER_BATCH, 0);
+        /*
+         * Group requests by file, so that each file gets at most one
+         * write per batch. With several writes for the same file in
+         * flight at once the kernel would be free to reorder the data.
+         */
+        nruns = 0;
+        for (i = 0; i < nwis; i++) {
+            if (rtpp_wi_get_type(wis[i]) == RTPP_WI_TYPE_SGNL) {
+                rtpp_wi_free(wis[i]);
+                shutdown = 1;
+                ridx[i] = -1;
+                continue;
+            }
+            wrp = rtpp_wi_data_get_ptr(wis[i], sizeof(*wrp), sizeof(*wrp));
+            /* Final request for the file always ends the run */
+            for (j = 0; j < nruns; j++) {
+                if (runs[j].wrp->fd == wrp->fd && runs[j].wrp->closefd == 0)
+                    break;
+            }
+            rp = &runs[j];
+            if (j == nruns) {
+                memset(rp, '\0', sizeof(*rp));
+                rp->res = RTPP_RECORD_WRUN_NORES;
+                nruns++;
+            }
+            rp->wrp = wrp;
+            rp->nwis++;
+            if (wrp->len > 0) {
+                rp->niov++;
+                rp->len += wrp->len;
+            }
+            ridx[i] = j;
+        }
+        /* Lay out requests and buffers of each run back-to-back */
+        for (i = j = niov = 0; j < nruns; j++) {
+            rp = &runs[j];
+            rp->wis = &rwis[i];
+            rp->iov = &iov[niov];
+            i += rp->nwis;
+            niov += rp->niov;
+            rp->nwis = rp->niov = 0;
+        }
+        for (i = 0; i < nwis; i++) {
+            if (ridx[i] == -1)
+                continue;
+            rp = &runs[ridx[i]];
+            wrp = rtpp_wi_data_get_ptr(wis[i], sizeof(*wrp), sizeof(*wrp));
+            rp->wis[rp->nwis++] = wis[i];
+            if (wrp->len > 0) {
+                rp->iov[rp->niov].iov_base = wrp->buf;
+                rp->iov[rp->niov].iov_len = wrp->len;
+                rp->niov++;
+            }
+        }
+        if (nruns > 0)
+            rtpp_record_writer_flush(pvt, runs, nruns);
+        /*
+         * Channels released while processing the last batch could have
+         * queued their final requests after the sigterm, drain those too.
+         */
+        if (shutdown != 0 && rtpp_queue_get_length(pvt->wqueue) == 0)
+            break;
+    }
+}
+
+struct rtpp_record_writer *
+rtpp_record_writer_ctor(struct rtpp_log *glog, struct rtpp_stats *rtpp_stats,
+  int use_uring)
+{
+    struct rtpp_record_writer_priv *pvt;
+
+    pvt = rtpp_zmalloc(sizeof(struct rtpp_record_writer_priv));
+    if (pvt == NULL) {
+        goto e0;
+    }
+    pvt->wqueue = rtpp_queue_init(1, "rtpp_record_writer");
+    if (pvt->wqueue == NULL) {
+        goto e1;
+    }
+
+    /* Pre-allocate sigterm, so that we don't have any malloc() in dtor() */
+    pvt->sigterm = rtpp_wi_malloc_sgnl(SIGTERM, NULL, 0);
+    if (pvt->sigterm == NULL) {
+        goto e2;
+    }
+
+    pvt->rtpp_stats = rtpp_stats;
+    pvt->stats_idx.nbytes_written = CALL_METHOD(rtpp_stats, getidxbyname,
+      "rec_nbytes_written");
+    pvt->stats_idx.npkts_dropped = CALL_METHOD(rtpp_stats, getidxbyname,
+      "rec_npkts_dropped");
+
+    if (use_uring != 0) {
+        /* Room for one write or close per each request in the batch */
+        pvt->uring = rtpp_record_uring_ctor(RTPP_RECORD_WRITER_BATCH);
+        if (pvt->uring == NULL) {
+            RTPP_LOG(glog, RTPP_LOG_INFO, "io_uring is not available, "
+              "recording with writev(2)");
+        }
+    }
+
+    if (pthread_create(&pvt->thread_id, NULL, (void *(*)(void *))&rtpp_record_writer_run, pvt) != 0) {
+        goto e3;
+    }
+
+    CALL_SMETHOD(glog->rcnt, incref);
+    pvt->glog = glog;
+    pvt->pub.enqueue = &rtpp_record_writer_enqueue;
+    pvt->pub.dtor = &rtpp_record_writer_dtor;
+
+    return (&pvt->pub);
+
+e3:
+    if (pvt->uring != NULL)
+        rtpp_record_uring_dtor(pvt->uring);
+    rtpp_wi_free(pvt->sigterm);
+e2:
+    rtpp_queue_destroy(pvt->wqueue);
+e1:
+    free(pvt);
+e0:
+    return (NULL);
+}
+
+static void
+rtpp_record_writer_dtor(struct rtpp_record_writer *pub)
+{
+    struct rtpp_record_writer_priv *pvt;
+
+    pvt = PUB2PVT(pub);
+
+    rtpp_queue_put_item(pvt->sigterm, pvt->wqueue);
+    pthread_join(pvt->thread_id, NULL);
+    if (pvt->uring != NULL)
+        rtpp_record_uring_dtor(pvt->uring);
+    rtpp_queue_destroy(pvt->wqueue);
+    CALL_SMETHOD(pvt->glog->rcnt, decref);
+    free(pvt);
+}
+
+static int
+rtpp_record_writer_enqueue(struct rtpp_record_writer *pub,
+  const struct rtpp_record_wreq *wrp, int force)
+{
+    struct rtpp_record_writer_priv *pvt;
+    struct rtpp_record_wreq *wi_data;
+    struct rtpp_wi *wi;
+
+    pvt = PUB2PVT(pub);
+
+    if (force == 0 &&
+      rtpp_queue_get_length(pvt->wqueue) >= RTPP_RECORD_WRITER_MAXQ) {
+        goto drop;
+    }
+    wi = rtpp_wi_malloc_udata((void **)&wi_data, sizeof(*wi_data));
+    if (wi == NULL) {
+        goto drop;
+    }
+    memcpy(wi_data, wrp, sizeof(*wi_data));
+    if (wrp->rcnt != NULL) {
+        CALL_SMETHOD(wrp->rcnt, incref);
+        wi->sock_rcnt = wrp->rcnt;
+    }
+    rtpp_queue_put_item(wi, pvt->wqueue);
+    return (0);
+
+drop:
+    CALL_METHOD(pvt->rtpp_stats, updatebyidx, pvt->stats_idx.npkts_dropped,
+      wrp->npkts);
+    return (-1);
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2016 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef _RTPP_RECORD_WRITER_H_
+#define _RTPP_RECORD_WRITER_H_
+
+struct rtpp_record_writer;
+struct rtpp_refcnt;
+struct rtpp_log;
+struct rtpp_stats;
+
+/*
+ * Single buffer to be written out by the writer thread. Ownership of the
+ * buf is passed to the writer on successful enqueue, the rcnt (if any)
+ * is released once the buffer has been written and the done callback
+ * (if any) is invoked after that from the writer thread. With closefd
+ * set the fd is closed by the writer before the callback.
+ */
+struct rtpp_record_wreq {
+    int fd;
+    int closefd;
+    char *buf;
+    int len;
+    int npkts;
+    int *errp;
+    const char *proto;
+    struct rtpp_log *log;
+    struct rtpp_refcnt *rcnt;
+    void (*done)(void *);
+    void *done_arg;
+};
+
+DEFINE_METHOD(rtpp_record_writer, rtpp_record_writer_enqueue, int,
+  const struct rtpp_record_wreq *, int);
+DEFINE_METHOD(rtpp_record_writer, rtpp_record_writer_dtor, void);
+
+struct rtpp_record_writer {
+    rtpp_record_writer_enqueue_t enqueue;
+    rtpp_record_writer_dtor_t dtor;
+};
+
+#define RTPP_RECORD_BUFSIZE (64 * 1024)
+
+struct rtpp_record_writer *rtpp_record_writer_ctor(struct rtpp_log *,
+  struct rtpp_stats *, int);
+
+#endif
@@ -28,19 +28,18 @@
 
 #include <sys/types.h>
 #include <netinet/in.h>
-#include <fcntl.h>
 #include <limits.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
 
 #include "rtp.h"
 #include "rtp_packet.h"
 #include "rtpp_types.h"
 #include "rtpp_mallocs.h"
+#include "rtpp_pcache.h"
 #include "rtpp_refcnt.h"
 #include "rtpp_server.h"
 #include "rtpp_server_fin.h"
@@ -60,10 +59,15 @@ struct rtpp_server_priv {
     unsigned char buf[1024];
     rtp_hdr_t *rtp;
     unsigned char *pload;
-    int fd;
+    struct rtpp_pcache *pcache;
+    struct rtpp_pcache_fd *pfd;
     int loop;
     uint64_t dts;
     int ptime;
+    /* Pre-computed framing, the same for every packet in the train */
+    int rlen;
+    int rticks;
+    uint32_t ts_incr;
 };
 
 #define PUB2PVT(pubp)      ((struct rtpp_server_priv *)((char *)(pubp) - offsetof(struct rtpp_server_priv, pub)))
@@ -72,19 +76,73 @@ static void rtpp_server_dtor(struct rtpp_server_priv *);
 static struct rtp_packet *rtpp_server_get(struct rtpp_server *, double, int *);
 static uint32_t rtpp_server_get_ssrc(struct rtpp_server *);
 static uint16_t rtpp_server_get_seq(struct rtpp_server *);
+static double rtpp_server_get_deadline(struct rtpp_server *);
+
+static int
+rtpp_server_framing(rtp_type_t codec, int ptime, int *rlenp, int *rticksp)
+{
+    int bytes_per_frame, ticks_per_frame, number_of_frames;
+
+    switch (codec) {
+    case RTP_PCMU:
+    case RTP_PCMA:
+	bytes_per_frame = 8;
+	ticks_per_frame = 1;
+	break;
+
+    case RTP_G729:
+	/* 10 ms per 8 kbps G.729 frame */
+	bytes_per_frame = 10;
+	ticks_per_frame = 10;
+	break;
+
+    case RTP_G723:
+	/* 30 ms per 6.3 kbps G.723 frame */
+	bytes_per_frame = 24;
+	ticks_per_frame = 30;
+	break;
+
+    case RTP_GSM:
+	/* 20 ms per 13 kbps GSM frame */
+	bytes_per_frame = 33;
+	ticks_per_frame = 20;
+	break;
+
+    case RTP_G722:
+	bytes_per_frame = 8;
+	ticks_per_frame = 1;
+	break;
+
+    default:
+	return (-1);
+    }
+
+    number_of_frames = ptime / ticks_per_frame;
+    if (ptime % ticks_per_frame != 0)
+	number_of_frames++;
+
+    *rlenp = bytes_per_frame * number_of_frames;
+    *rticksp = ticks_per_frame * number_of_frames;
+    return (0);
+}
 
 struct rtpp_server *
-rtpp_server_ctor(const char *name, rtp_type_t codec, int loop, double dtime,
-  int ptime)
+rtpp_server_ctor(struct rtpp_pcache *pcache, const char *name,
+  rtp_type_t codec, int loop, double dtime, int ptime)
 {
     struct rtpp_server_priv *rp;
     struct rtpp_refcnt *rcnt;
-    int fd;
+    struct rtpp_pcache_fd *pfd;
     char path[PATH_MAX + 1];
+    int rlen, rticks;
 
-    sprintf(path, "%s.%d", name, codec);
-    fd = open(path, O_RDONLY);
-    if (fd == -1)
+    ptime = (ptime > 0) ? ptime : RTPS_TICKS_MIN;
+    if (rtpp_server_framing(codec, ptime, &rlen, &rticks) != 0)
+	goto e0;
+
+    snprintf(path, sizeof(path), "%s.%d", name, codec);
+    pfd = CALL_METHOD(pcache, open, path);
+    if (pfd == NULL)
 	goto e0;
 
     rp = rtpp_rzmalloc(sizeof(struct rtpp_server_priv), &rcnt);
@@ -95,9 +153,14 @@ rtpp_server_ctor(const char *name, rtp_type_t codec, int loop, double dtime,
 
     rp->btime = dtime;
     rp->dts = 0;
-    rp->fd = fd;
+    rp->pcache = pcache;
+    CALL_SMETHOD(pcache->rcnt, incref);
+    rp->pfd = pfd;
     rp->loop = (loop > 0) ? loop - 1 : loop;
-    rp->ptime = (ptime > 0) ? ptime : RTPS_TICKS_MIN;
+    rp->ptime = ptime;
+    rp->rlen = rlen;
+    rp->rticks = rticks;
+    rp->ts_incr = RTPS_SRATE * rticks / 1000;
 
     rp->rtp = (rtp_hdr_t *)rp->buf;
     rp->rtp->version = 2;
@@ -114,13 +177,14 @@ rtpp_server_ctor(const char *name, rtp_type_t codec, int loop, double dtime,
     rp->pub.get = &rtpp_server_get;
     rp->pub.get_ssrc = &rtpp_server_get_ssrc;
     rp->pub.get_seq = &rtpp_server_get_seq;
+    rp->pub.get_deadline = &rtpp_server_get_deadline;
     rtpp_gen_uid(&rp->pub.sruid);
 
     CALL_SMETHOD(rp->pub.rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_server_dtor,
       rp);
     return (&rp->pub);
 e1:
-    close(fd);
+    CALL_METHOD(pcache, close, pfd);
 e0:
     return (NULL);
 }
@@ -130,7 +194,8 @@ rtpp_server_dtor(struct rtpp_server_priv *rp)
 {
 
     rtpp_server_fin(&rp->pub);
-    close(rp->fd);
+    CALL_METHOD(rp->pcache, close, rp->pfd);
+    CALL_SMETHOD(rp->pcache->rcnt, decref);
     free(rp);
 }
 
@@ -138,8 +203,6 @@ static struct rtp_packet *
 rtpp_server_get(struct rtpp_server *self, double dtime, int *rval)
 {
     struct rtp_packet *pkt;
-    uint32_t ts;
-    int rlen, rticks, bytes_per_frame, ticks_per_frame, number_of_frames;
     int hlen;
     struct rtpp_server_priv *rp;
 
@@ -150,49 +213,6 @@ rtpp_server_get(struct rtpp_server *self, double dtime, int *rval)
 	return (NULL);
     }
 
-    switch (rp->rtp->pt) {
-    case RTP_PCMU:
-    case RTP_PCMA:
-	bytes_per_frame = 8;
-	ticks_per_frame = 1;
-	break;
-
-    case RTP_G729:
-	/* 10 ms per 8 kbps G.729 frame */
-	bytes_per_frame = 10;
-	ticks_per_frame = 10;
-	break;
-
-    case RTP_G723:
-	/* 30 ms per 6.3 kbps G.723 frame */
-	bytes_per_frame = 24;
-	ticks_per_frame = 30;
-	break;
-
-    case RTP_GSM:
-	/* 20 ms per 13 kbps GSM frame */
-	bytes_per_frame = 33;
-	ticks_per_frame = 20;
-	break;
-
-    case RTP_G722:
-	bytes_per_frame = 8;
-	ticks_per_frame = 1;
-	break;
-
-    default:
-	*rval = RTPS_ERROR;
-        return (NULL);
-    }
-
-    number_of_frames = rp->ptime / ticks_per_frame;
-    if (rp->ptime % ticks_per_frame != 0)
-	number_of_frames++;
-
-    rlen = bytes_per_frame * number_of_frames;
-    rticks = ticks_per_frame * number_of_frames;
-    rp->dts += rticks;
-
     pkt = rtp_packet_alloc();
     if (pkt == NULL) {
         *rval = RTPS_ENOMEM;
@@ -200,9 +220,11 @@ rtpp_server_get(struct rtpp_server *self, double dtime, int *rval)
     }
     hlen = RTP_HDR_LEN(rp->rtp);
 
-    if (read(rp->fd, pkt->data.buf + hlen, rlen) != rlen) {
-	if (rp->loop == 0 || lseek(rp->fd, 0, SEEK_SET) == -1 ||
-	  read(rp->fd, pkt->data.buf + hlen, rlen) != rlen) {
+    if (CALL_METHOD(rp->pcache, read, rp->pfd, pkt->data.buf + hlen, rp->rlen) != rp->rlen) {
+	if (rp->loop != 0)
+	    CALL_METHOD(rp->pcache, rewind, rp->pfd);
+	if (rp->loop == 0 ||
+	  CALL_METHOD(rp->pcache, read, rp->pfd, pkt->data.buf + hlen, rp->rlen) != rp->rlen) {
 	    *rval = RTPS_EOF;
             rtp_packet_free(pkt);
             return (NULL);
@@ -210,18 +232,19 @@ rtpp_server_get(struct rtpp_server *self, double dtime, int *rval)
 	if (rp->loop != -1)
 	    rp->loop -= 1;
     }
+    rp->dts += rp->rticks;
 
     if (rp->rtp->mbt != 0 && ntohs(rp->rtp->seq) != 0) {
 	rp->rtp->mbt = 0;
     }
 
-    ts = ntohl(rp->rtp->ts);
-    rp->rtp->ts = htonl(ts + (RTPS_SRATE * rticks / 1000));
+    /* Only seq and ts change from one packet of the train to the next */
+    rp->rtp->ts = htonl(ntohl(rp->rtp->ts) + rp->ts_incr);
     rp->rtp->seq = htons(ntohs(rp->rtp->seq) + 1);
 
     memcpy(&pkt->data.header, rp->rtp, hlen);
 
-    pkt->size = hlen + rlen;
+    pkt->size = hlen + rp->rlen;
     return (pkt);
 }
 
@@ -242,3 +265,12 @@ rtpp_server_get_seq(struct rtpp_server *self)
     rp = PUB2PVT(self);
     return (ntohs(rp->rtp->seq));
 }
+
+static double
+rtpp_server_get_deadline(struct rtpp_server *self)
+{
+    struct rtpp_server_priv *rp;
+
+    rp = PUB2PVT(self);
+    return (rp->btime + ((double)rp->dts / 1000.0));
+}
@@ -31,12 +31,14 @@
 
 struct rtpp_server;
 struct rtp_packet;
+struct rtpp_pcache;
 
 enum rtp_type;
 
 DEFINE_METHOD(rtpp_server, rtpp_server_get, struct rtp_packet *, double, int *);
 DEFINE_METHOD(rtpp_server, rtpp_server_get_ssrc, uint32_t);
 DEFINE_METHOD(rtpp_server, rtpp_server_get_seq, uint16_t);
+DEFINE_METHOD(rtpp_server, rtpp_server_get_deadline, double);
 
 #define	RTPS_LATER	(0)
 #define	RTPS_EOF	(-1)
@@ -48,6 +50,7 @@ struct rtpp_server {
     METHOD_ENTRY(rtpp_server_get, get);
     METHOD_ENTRY(rtpp_server_get_ssrc, get_ssrc);
     METHOD_ENTRY(rtpp_server_get_seq, get_seq);
+    METHOD_ENTRY(rtpp_server_get_deadline, get_deadline);
     /* Refcounter */
     struct rtpp_refcnt *rcnt;
     /* UID */
@@ -56,7 +59,7 @@ struct rtpp_server {
     uint64_t stuid;
 };
 
-struct rtpp_server *rtpp_server_ctor(const char *, enum rtp_type, int, double,
-  int);
+struct rtpp_server *rtpp_server_ctor(struct rtpp_pcache *, const char *,
+  enum rtp_type, int, double, int);
 
 #endif
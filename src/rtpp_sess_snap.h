@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2016 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef _RTPP_SESS_SNAP_H_
+#define _RTPP_SESS_SNAP_H_
+
+/*
+ * Point-in-time copy of the counters of a running session, as handed
+ * over to the modules' on_session_interval hook. Contains no pointers,
+ * so arrays of those can be copied and queued around as a whole.
+ * Requires rtpp_pcount.h, rtpp_pcnt_strm.h and rtpa_stats.h.
+ */
+
+struct rtpp_sess_snap_face {
+    struct rtpp_pcnts_strm ps;
+};
+
+struct rtpp_sess_snap_pipe {
+    struct rtpp_sess_snap_face o;
+    struct rtpp_sess_snap_face a;
+    struct rtpps_pcount pcnts;
+};
+
+struct rtpp_sess_snap {
+    uint64_t seuid;
+    /* Timestamp of when the snapshot has been taken */
+    double snap_ts;
+    struct rtpp_sess_snap_pipe rtp;
+    struct rtpp_sess_snap_pipe rtcp;
+    struct rtpa_stats rasto;
+    struct rtpa_stats rasta;
+};
+
+#define rtpp_sess_snap_OSIZE() (sizeof(struct rtpp_sess_snap))
+
+#endif
@@ -0,0 +1,304 @@
+/*
+ * Copyright (c) 2016 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rtpp_ssrc.h"
+#include "rtpa_stats.h"
+#include "rtpp_types.h"
+#include "rtpp_defines.h"
+#include "rtpp_mallocs.h"
+#include "rtpp_refcnt.h"
+#include "rtpp_analyzer.h"
+#include "rtpp_hash_table.h"
+#include "rtpp_pcount.h"
+#include "rtpp_pcnt_strm.h"
+#include "rtpp_pipe.h"
+#include "rtpp_stream.h"
+#include "rtpp_session.h"
+#include "rtpp_sess_snap.h"
+#include "rtpp_sess_wheel.h"
+#include "rtpp_time.h"
+#include "rtpp_timed.h"
+#include "rtpp_weakref.h"
+
+#define RTPP_SWHEEL_NSLOTS 16
+
+struct rtpp_sess_wheel_priv {
+    struct rtpp_sess_wheel pub;
+    struct rtpp_weakref_obj *sessions_wrt;
+    struct rtpp_timed_task *task;
+    rtpp_sess_wheel_cb_t cb_func;
+    void *cb_func_arg;
+    /* Held while the slot is processed, so that shutdown can sync with it */
+    pthread_mutex_t lock;
+    int stopped;
+    int nslots;
+    int cslot;
+    /*
+     * UIDs of the sessions found by the last pass over the sessions
+     * table, ordered by slot: sessions of the slot N are in the
+     * suids[soff[N]] .. suids[soff[N + 1] - 1].
+     */
+    uint64_t *suids;
+    int soff[RTPP_SWHEEL_NSLOTS + 1];
+};
+
+struct rtpp_sess_wheel_collect_args {
+    uint64_t *suids;
+    int nsuids;
+    int alen;
+};
+
+#define PUB2PVT(pubp) \
+  ((struct rtpp_sess_wheel_priv *)((char *)(pubp) - offsetof(struct rtpp_sess_wheel_priv, pub)))
+
+static void rtpp_sess_wheel_dtor(struct rtpp_sess_wheel_priv *);
+static void rtpp_sess_wheel_shutdown(struct rtpp_sess_wheel *);
+static enum rtpp_timed_cb_rvals rtpp_sess_wheel_tick(double, void *);
+
+struct rtpp_sess_wheel *
+rtpp_sess_wheel_ctor(struct rtpp_weakref_obj *sessions_wrt,
+  struct rtpp_timed *timed_cf, double ival, rtpp_sess_wheel_cb_t cb_func,
+  void *cb_func_arg)
+{
+    struct rtpp_sess_wheel_priv *pvt;
+    struct rtpp_refcnt *rcnt;
+
+    pvt = rtpp_rzmalloc(sizeof(struct rtpp_sess_wheel_priv), &rcnt);
+    if (pvt == NULL) {
+        goto e0;
+    }
+    pvt->pub.rcnt = rcnt;
+    if (pthread_mutex_init(&pvt->lock, NULL) != 0) {
+        goto e1;
+    }
+    pvt->sessions_wrt = sessions_wrt;
+    pvt->cb_func = cb_func;
+    pvt->cb_func_arg = cb_func_arg;
+    /* Slots cannot be advanced faster than the timed subsystem runs */
+    pvt->nslots = (int)(ival / TIMED_PERIOD);
+    if (pvt->nslots > RTPP_SWHEEL_NSLOTS) {
+        pvt->nslots = RTPP_SWHEEL_NSLOTS;
+    } else if (pvt->nslots < 1) {
+        pvt->nslots = 1;
+    }
+    pvt->task = CALL_METHOD(timed_cf, schedule_rc, ival / pvt->nslots,
+      pvt->pub.rcnt, rtpp_sess_wheel_tick, NULL, pvt);
+    if (pvt->task == NULL) {
+        goto e2;
+    }
+    pvt->pub.shutdown = &rtpp_sess_wheel_shutdown;
+    CALL_SMETHOD(pvt->pub.rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_sess_wheel_dtor,
+      pvt);
+    return (&pvt->pub);
+e2:
+    pthread_mutex_destroy(&pvt->lock);
+e1:
+    CALL_SMETHOD(pvt->pub.rcnt, decref);
+    free(pvt);
+e0:
+    return (NULL);
+}
+
+static void
+rtpp_sess_wheel_dtor(struct rtpp_sess_wheel_priv *pvt)
+{
+
+    CALL_SMETHOD(pvt->task->rcnt, decref);
+    pthread_mutex_destroy(&pvt->lock);
+    if (pvt->suids != NULL) {
+        free(pvt->suids);
+    }
+    free(pvt);
+}
+
+static void
+rtpp_sess_wheel_shutdown(struct rtpp_sess_wheel *self)
+{
+    struct rtpp_sess_wheel_priv *pvt;
+
+    pvt = PUB2PVT(self);
+    /*
+     * Once we have got the lock the callback is either not running or
+     * will see the flag and return CB_LAST on its next invocation.
+     */
+    pthread_mutex_lock(&pvt->lock);
+    pvt->stopped = 1;
+    pthread_mutex_unlock(&pvt->lock);
+    CALL_METHOD(pvt->task, cancel);
+}
+
+static int
+rtpp_sess_wheel_slot(uint64_t seuid, int nslots)
+{
+
+    /* UIDs are sequential with a stride, scramble them before taking mod */
+    return ((int)(((seuid * 0x9E3779B97F4A7C15ULL) >> 32) % nslots));
+}
+
+static int
+rtpp_sess_wheel_collect(void *dp, void *ap)
+{
+    struct rtpp_session *sp;
+    struct rtpp_sess_wheel_collect_args *cap;
+    uint64_t *tsuids;
+
+    sp = (struct rtpp_session *)dp;
+    cap = (struct rtpp_sess_wheel_collect_args *)ap;
+    if (cap->nsuids == cap->alen) {
+        tsuids = realloc(cap->suids, sizeof(cap->suids[0]) * cap->alen * 2);
+        if (tsuids == NULL) {
+            return (RTPP_WR_MATCH_BRK);
+        }
+        cap->suids = tsuids;
+        cap->alen *= 2;
+    }
+    cap->suids[cap->nsuids] = sp->seuid;
+    cap->nsuids++;
+    return (RTPP_WR_MATCH_CONT);
+}
+
+/*
+ * Makes a single pass over the sessions table and lays out UIDs of all
+ * sessions found by slot, the following nslots ticks then only have to
+ * look up sessions of their own slot.
+ */
+static void
+rtpp_sess_wheel_rebuild(struct rtpp_sess_wheel_priv *pvt)
+{
+    struct rtpp_sess_wheel_collect_args ca;
+    uint64_t *suids;
+    int i, slot, cnts[RTPP_SWHEEL_NSLOTS];
+
+    if (pvt->suids != NULL) {
+        free(pvt->suids);
+        pvt->suids = NULL;
+    }
+    memset(pvt->soff, '\0', sizeof(pvt->soff));
+    ca.nsuids = 0;
+    ca.alen = 16;
+    ca.suids = malloc(sizeof(ca.suids[0]) * ca.alen);
+    if (ca.suids == NULL) {
+        return;
+    }
+    CALL_METHOD(pvt->sessions_wrt, foreach, rtpp_sess_wheel_collect, &ca);
+    if (ca.nsuids == 0) {
+        free(ca.suids);
+        return;
+    }
+    suids = malloc(sizeof(suids[0]) * ca.nsuids);
+    if (suids == NULL) {
+        free(ca.suids);
+        return;
+    }
+    memset(cnts, '\0', sizeof(cnts));
+    for (i = 0; i < ca.nsuids; i++) {
+        cnts[rtpp_sess_wheel_slot(ca.suids[i], pvt->nslots)]++;
+    }
+    for (i = 0; i < pvt->nslots; i++) {
+        pvt->soff[i + 1] = pvt->soff[i] + cnts[i];
+        cnts[i] = pvt->soff[i];
+    }
+    for (i = 0; i < ca.nsuids; i++) {
+        slot = rtpp_sess_wheel_slot(ca.suids[i], pvt->nslots);
+        suids[cnts[slot]] = ca.suids[i];
+        cnts[slot]++;
+    }
+    free(ca.suids);
+    pvt->suids = suids;
+}
+
+static void
+rtpp_sess_wheel_snap_pipe(struct rtpp_pipe *pp, struct rtpp_sess_snap_pipe *spp)
+{
+
+    CALL_METHOD(pp->pcount, get_stats, &spp->pcnts);
+    CALL_METHOD(pp->stream[0]->pcnt_strm, get_stats, &spp->o.ps);
+    CALL_METHOD(pp->stream[1]->pcnt_strm, get_stats, &spp->a.ps);
+}
+
+static enum rtpp_timed_cb_rvals
+rtpp_sess_wheel_tick(double dtime, void *arg)
+{
+    struct rtpp_sess_wheel_priv *pvt;
+    struct rtpp_sess_snap *snaps, *ssp;
+    struct rtpp_session *sp;
+    int i, slot, nsnaps;
+
+    pvt = (struct rtpp_sess_wheel_priv *)arg;
+    pthread_mutex_lock(&pvt->lock);
+    if (pvt->stopped) {
+        pthread_mutex_unlock(&pvt->lock);
+        return (CB_LAST);
+    }
+    slot = pvt->cslot;
+    pvt->cslot = (pvt->cslot + 1) % pvt->nslots;
+    /*
+     * The sessions table is only walked once per interval, sessions that
+     * are created in between are picked up by the next pass.
+     */
+    if (slot == 0) {
+        rtpp_sess_wheel_rebuild(pvt);
+    }
+    if (pvt->soff[slot + 1] == pvt->soff[slot]) {
+        goto out;
+    }
+    snaps = malloc(sizeof(snaps[0]) * (pvt->soff[slot + 1] - pvt->soff[slot]));
+    if (snaps == NULL) {
+        goto out;
+    }
+    nsnaps = 0;
+    for (i = pvt->soff[slot]; i < pvt->soff[slot + 1]; i++) {
+        sp = CALL_METHOD(pvt->sessions_wrt, get_by_idx, pvt->suids[i]);
+        if (sp == NULL) {
+            /* Session is gone since the last pass */
+            continue;
+        }
+        ssp = &snaps[nsnaps];
+        ssp->seuid = sp->seuid;
+        ssp->snap_ts = dtime;
+        rtpp_sess_wheel_snap_pipe(sp->rtp, &ssp->rtp);
+        rtpp_sess_wheel_snap_pipe(sp->rtcp, &ssp->rtcp);
+        CALL_METHOD(sp->rtp->stream[0]->analyzer, get_stats, &ssp->rasto);
+        CALL_METHOD(sp->rtp->stream[1]->analyzer, get_stats, &ssp->rasta);
+        CALL_SMETHOD(sp->rcnt, decref);
+        nsnaps++;
+    }
+    if (nsnaps == 0) {
+        free(snaps);
+        goto out;
+    }
+    pvt->cb_func(pvt->cb_func_arg, snaps, nsnaps);
+out:
+    pthread_mutex_unlock(&pvt->lock);
+    return (CB_MORE);
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2016 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef _RTPP_SESS_WHEEL_H_
+#define _RTPP_SESS_WHEEL_H_
+
+/*
+ * Periodically takes snapshots of the counters of all active sessions.
+ * Sessions are spread over a number of slots of a timer wheel that is
+ * advanced by one slot every ival / nslots seconds, so that every
+ * session is visited once per ival and the work is evenly spread in
+ * time. The sessions table itself is only walked once per ival, at
+ * the start of each round. Snapshots of all sessions in the slot are
+ * passed to the callback in a single malloc()ed array, which the
+ * callback then owns.
+ */
+
+struct rtpp_sess_wheel;
+struct rtpp_refcnt;
+struct rtpp_sess_snap;
+struct rtpp_weakref_obj;
+struct rtpp_timed;
+
+typedef void (*rtpp_sess_wheel_cb_t)(void *, struct rtpp_sess_snap *, int);
+
+DEFINE_METHOD(rtpp_sess_wheel, rtpp_sess_wheel_shutdown, void);
+
+struct rtpp_sess_wheel {
+    METHOD_ENTRY(rtpp_sess_wheel_shutdown, shutdown);
+    struct rtpp_refcnt *rcnt;
+};
+
+struct rtpp_sess_wheel *rtpp_sess_wheel_ctor(struct rtpp_weakref_obj *,
+  struct rtpp_timed *, double, rtpp_sess_wheel_cb_t, void *);
+
+#endif
@@ -95,13 +95,13 @@ rtpp_session_ctor(struct rtpp_cfg_stable *cfs, struct common_cmd_args *ccap,
     }
     CALL_METHOD(log, setlevel, cfs->log_level);
     pub->rtp = rtpp_pipe_ctor(pub->seuid, cfs->rtp_streams_wrt,
-      cfs->servers_wrt, log, cfs->rtpp_stats, PIPE_RTP);
+      cfs->servers_wrt, log, cfs->rtpp_stats, PIPE_RTP, cfs->rtpa_policy);
     if (pub->rtp == NULL) {
         goto e2;
     }
     /* spb is RTCP twin session for this one. */
     pub->rtcp = rtpp_pipe_ctor(pub->seuid, cfs->rtcp_streams_wrt,
-      cfs->servers_wrt, log, cfs->rtpp_stats, PIPE_RTCP);
+      cfs->servers_wrt, log, cfs->rtpp_stats, PIPE_RTCP, NULL);
     if (pub->rtcp == NULL) {
         goto e3;
     }
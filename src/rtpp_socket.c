@@ -29,6 +29,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <stddef.h>
 #include <stdlib.h>
@@ -59,6 +60,7 @@ static int rtpp_socket_settos(struct rtpp_socket *, int);
 static int rtpp_socket_setrbuf(struct rtpp_socket *, int);
 static int rtpp_socket_setnonblock(struct rtpp_socket *);
 static int rtpp_socket_settimestamp(struct rtpp_socket *);
+static int rtpp_socket_setbusypoll(struct rtpp_socket *, int);
 static int rtpp_socket_send_pkt(struct rtpp_socket *, struct sthread_args *,
   const struct sockaddr *, int, struct rtp_packet *, struct rtpp_log *);
 static int rtpp_socket_send_pkt_na(struct rtpp_socket *, struct sthread_args *,
@@ -98,6 +100,7 @@ rtpp_socket_ctor(int domain, int type)
     pvt->pub.setrbuf = &rtpp_socket_setrbuf;
     pvt->pub.setnonblock = &rtpp_socket_setnonblock;
     pvt->pub.settimestamp = &rtpp_socket_settimestamp;
+    pvt->pub.setbusypoll = &rtpp_socket_setbusypoll;
     pvt->pub.send_pkt = &rtpp_socket_send_pkt;
     pvt->pub.send_pkt_na = &rtpp_socket_send_pkt_na;
     pvt->pub.rtp_recv = &rtpp_socket_rtp_recv_simple;
@@ -179,6 +182,21 @@ rtpp_socket_settimestamp(struct rtpp_socket *self)
     return (0);
 }
 
+static int
+rtpp_socket_setbusypoll(struct rtpp_socket *self, int usec)
+{
+#if defined(SO_BUSY_POLL)
+    struct rtpp_socket_priv *pvt;
+
+    pvt = PUB2PVT(self);
+    return (setsockopt(pvt->fd, SOL_SOCKET, SO_BUSY_POLL, &usec,
+      sizeof(usec)));
+#else
+    errno = ENOPROTOOPT;
+    return (-1);
+#endif
+}
+
 static int 
 rtpp_socket_send_pkt(struct rtpp_socket *self, struct sthread_args *str,
   const struct sockaddr *daddr, int addrlen, struct rtp_packet *pkt,
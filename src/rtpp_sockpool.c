@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2016 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/*
+ * Pool of pre-created RTP/RTCP socket pairs bound to the addresses given
+ * with -l. Creating and binding a pair of sockets, possibly retrying
+ * several ports, is the most expensive part of handling U/L commands,
+ * so a helper thread does it in advance and the command handler only
+ * has to pick a ready pair. If the pool for a given address is empty
+ * or the address is not pooled at all the caller falls back to creating
+ * sockets synchronously.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "rtpp_types.h"
+#include "rtpp_cfg_stable.h"
+#include "rtpp_defines.h"
+#include "rtpp_command.h"
+#include "rtpp_mallocs.h"
+#include "rtpp_network.h"
+#include "rtpp_refcnt.h"
+#include "rtpp_socket.h"
+#include "rtpp_sockpool.h"
+#include "rtpp_sockpool_fin.h"
+#include "rtpp_stats.h"
+
+#define RTPP_SOCKPOOL_NADDRS 2
+
+struct rtpp_sockpool_pair {
+    struct rtpp_socket *fds[2];
+    int port;
+};
+
+struct rtpp_sockpool_slot {
+    const struct sockaddr *addr;
+    struct rtpp_sockpool_pair *pairs;
+    int head;
+    int nready;
+    /* Last attempt to pre-create a pair failed, wait until next take */
+    int stalled;
+};
+
+struct rtpp_sockpool_priv {
+    struct rtpp_sockpool pub;
+    struct cfg *cf;
+    pthread_t thread_id;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int depth;
+    int nslots;
+    int shutdown;
+    struct {
+        int nhits;
+        int nmiss;
+    } stats_idx;
+    struct rtpp_sockpool_slot slots[RTPP_SOCKPOOL_NADDRS];
+};
+
+#define PUB2PVT(pubp) \
+  ((struct rtpp_sockpool_priv *)((char *)(pubp) - offsetof(struct rtpp_sockpool_priv, pub)))
+
+static void rtpp_sockpool_dtor(struct rtpp_sockpool_priv *);
+static int rtpp_sockpool_get(struct rtpp_sockpool *, const struct sockaddr *,
+  int *, struct rtpp_socket **);
+static void rtpp_sockpool_run(struct rtpp_sockpool_priv *);
+
+struct rtpp_sockpool *
+rtpp_sockpool_ctor(struct cfg *cf, int depth)
+{
+    struct rtpp_sockpool_priv *pvt;
+    struct rtpp_refcnt *rcnt;
+    int i;
+
+    pvt = rtpp_rzmalloc(sizeof(struct rtpp_sockpool_priv), &rcnt);
+    if (pvt == NULL) {
+        goto e0;
+    }
+    pvt->pub.rcnt = rcnt;
+    pvt->cf = cf;
+    pvt->depth = depth;
+    for (i = 0; i < RTPP_SOCKPOOL_NADDRS; i++) {
+        if (cf->stable->bindaddr[i] == NULL)
+            continue;
+        pvt->slots[pvt->nslots].addr = cf->stable->bindaddr[i];
+        pvt->slots[pvt->nslots].pairs = rtpp_zmalloc(depth *
+          sizeof(struct rtpp_sockpool_pair));
+        if (pvt->slots[pvt->nslots].pairs == NULL) {
+            goto e1;
+        }
+        pvt->nslots++;
+    }
+    if (pthread_mutex_init(&pvt->lock, NULL) != 0) {
+        goto e1;
+    }
+    if (pthread_cond_init(&pvt->cond, NULL) != 0) {
+        goto e2;
+    }
+    pvt->stats_idx.nhits = CALL_METHOD(cf->stable->rtpp_stats, getidxbyname,
+      "sockpool_nhits");
+    pvt->stats_idx.nmiss = CALL_METHOD(cf->stable->rtpp_stats, getidxbyname,
+      "sockpool_nmiss");
+    if (pthread_create(&pvt->thread_id, NULL,
+      (void *(*)(void *))&rtpp_sockpool_run, pvt) != 0) {
+        goto e3;
+    }
+    pvt->pub.get = &rtpp_sockpool_get;
+    CALL_SMETHOD(pvt->pub.rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_sockpool_dtor,
+      pvt);
+    return ((&pvt->pub));
+
+e3:
+    pthread_cond_destroy(&pvt->cond);
+e2:
+    pthread_mutex_destroy(&pvt->lock);
+e1:
+    for (i = 0; i < pvt->nslots; i++) {
+        free(pvt->slots[i].pairs);
+    }
+    CALL_SMETHOD(pvt->pub.rcnt, decref);
+    free(pvt);
+e0:
+    return (NULL);
+}
+
+static void
+rtpp_sockpool_dtor(struct rtpp_sockpool_priv *pvt)
+{
+    struct rtpp_sockpool_slot *spp;
+    struct rtpp_sockpool_pair *ppp;
+    int i;
+
+    rtpp_sockpool_fin(&pvt->pub);
+    pthread_mutex_lock(&pvt->lock);
+    pvt->shutdown = 1;
+    pthread_cond_signal(&pvt->cond);
+    pthread_mutex_unlock(&pvt->lock);
+    pthread_join(pvt->thread_id, NULL);
+
+    for (spp = &pvt->slots[0]; spp < &pvt->slots[pvt->nslots]; spp++) {
+        for (i = 0; i < spp->nready; i++) {
+            ppp = &spp->pairs[(spp->head + i) % pvt->depth];
+            CALL_SMETHOD(ppp->fds[0]->rcnt, decref);
+            CALL_SMETHOD(ppp->fds[1]->rcnt, decref);
+        }
+        free(spp->pairs);
+    }
+    pthread_cond_destroy(&pvt->cond);
+    pthread_mutex_destroy(&pvt->lock);
+    free(pvt);
+}
+
+static struct rtpp_sockpool_slot *
+rtpp_sockpool_needfill(struct rtpp_sockpool_priv *pvt)
+{
+    struct rtpp_sockpool_slot *spp, *rspp;
+
+    /* Pick the emptiest slot, so that all addresses are refilled evenly */
+    rspp = NULL;
+    for (spp = &pvt->slots[0]; spp < &pvt->slots[pvt->nslots]; spp++) {
+        if (spp->stalled != 0 || spp->nready == pvt->depth)
+            continue;
+        if (rspp == NULL || spp->nready < rspp->nready)
+            rspp = spp;
+    }
+    return (rspp);
+}
+
+static void
+rtpp_sockpool_run(struct rtpp_sockpool_priv *pvt)
+{
+    struct rtpp_sockpool_slot *spp;
+    struct rtpp_sockpool_pair *ppp;
+    struct rtpp_socket *fds[2];
+    int port, rval;
+
+    pthread_mutex_lock(&pvt->lock);
+    for (;;) {
+        spp = NULL;
+        while (pvt->shutdown == 0 && (spp = rtpp_sockpool_needfill(pvt)) == NULL) {
+            pthread_cond_wait(&pvt->cond, &pvt->lock);
+        }
+        if (pvt->shutdown != 0)
+            break;
+        pthread_mutex_unlock(&pvt->lock);
+        rval = rtpp_create_listener_sync(pvt->cf, (struct sockaddr *)spp->addr,
+          &port, fds);
+        pthread_mutex_lock(&pvt->lock);
+        if (rval == -1) {
+            spp->stalled = 1;
+            continue;
+        }
+        /* We are the only producer, so there is always room */
+        ppp = &spp->pairs[(spp->head + spp->nready) % pvt->depth];
+        ppp->fds[0] = fds[0];
+        ppp->fds[1] = fds[1];
+        ppp->port = port;
+        spp->nready++;
+    }
+    pthread_mutex_unlock(&pvt->lock);
+}
+
+static void
+rtpp_sockpool_drain(struct rtpp_socket *fd)
+{
+    char buf[256];
+    int sfd;
+
+    /*
+     * Socket has been bound for a while, discard anything that might
+     * have arrived before it was handed out to a session.
+     */
+    sfd = CALL_METHOD(fd, getfd);
+    while (recv(sfd, buf, sizeof(buf), MSG_DONTWAIT) >= 0)
+        continue;
+}
+
+static int
+rtpp_sockpool_get(struct rtpp_sockpool *self, const struct sockaddr *ia,
+  int *port, struct rtpp_socket **fds)
+{
+    struct rtpp_sockpool_priv *pvt;
+    struct rtpp_sockpool_slot *spp;
+    struct rtpp_sockpool_pair *ppp;
+
+    pvt = PUB2PVT(self);
+
+    for (spp = &pvt->slots[0]; spp < &pvt->slots[pvt->nslots]; spp++) {
+        if (spp->addr == ia || ishostseq(spp->addr, ia))
+            break;
+    }
+    if (spp == &pvt->slots[pvt->nslots]) {
+        return (-1);
+    }
+    pthread_mutex_lock(&pvt->lock);
+    if (spp->nready == 0) {
+        spp->stalled = 0;
+        pthread_cond_signal(&pvt->cond);
+        pthread_mutex_unlock(&pvt->lock);
+        CALL_METHOD(pvt->cf->stable->rtpp_stats, updatebyidx,
+          pvt->stats_idx.nmiss, 1);
+        return (-1);
+    }
+    ppp = &spp->pairs[spp->head];
+    fds[0] = ppp->fds[0];
+    fds[1] = ppp->fds[1];
+    *port = ppp->port;
+    spp->head = (spp->head + 1) % pvt->depth;
+    spp->nready--;
+    spp->stalled = 0;
+    pthread_cond_signal(&pvt->cond);
+    pthread_mutex_unlock(&pvt->lock);
+
+    rtpp_sockpool_drain(fds[0]);
+    rtpp_sockpool_drain(fds[1]);
+    CALL_METHOD(pvt->cf->stable->rtpp_stats, updatebyidx,
+      pvt->stats_idx.nhits, 1);
+    return (0);
+}
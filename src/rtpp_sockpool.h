@@ -1,6 +1,5 @@
 /*
- * Copyright (c) 2004-2006 Maxim Sobolev <sobomax@FreeBSD.org>
- * Copyright (c) 2006-2015 Sippy Software, Inc., http://www.sippysoft.com
+ * Copyright (c) 2016 Sippy Software, Inc., http://www.sippysoft.com
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -26,24 +25,18 @@
  *
  */
 
-#ifndef _RTPP_RINGBUF_H_
-#define _RTPP_RINGBUF_H_
+struct rtpp_sockpool;
+struct rtpp_refcnt;
+struct rtpp_socket;
+struct sockaddr;
+struct cfg;
 
-struct rtpp_ringbuf;
+DEFINE_METHOD(rtpp_sockpool, rtpp_sockpool_get, int, const struct sockaddr *,
+  int *, struct rtpp_socket **);
 
-DEFINE_METHOD(rtpp_ringbuf, rtpp_ringbuf_push, void, void *);
-DEFINE_METHOD(rtpp_ringbuf, rtpp_ringbuf_flush, void);
-DEFINE_METHOD(rtpp_ringbuf, rtpp_ringbuf_locate, int, void *);
-
-struct rtpp_ringbuf {
-    /* Refcounter */
+struct rtpp_sockpool {
     struct rtpp_refcnt *rcnt;
-
-    METHOD_ENTRY(rtpp_ringbuf_push, push);
-    METHOD_ENTRY(rtpp_ringbuf_flush, flush);
-    METHOD_ENTRY(rtpp_ringbuf_locate, locate);
+    METHOD_ENTRY(rtpp_sockpool_get, get);
 };
 
-struct rtpp_ringbuf *rtpp_ringbuf_ctor(size_t, int);
-
-#endif
+struct rtpp_sockpool *rtpp_sockpool_ctor(struct cfg *, int);
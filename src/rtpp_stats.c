@@ -93,12 +93,21 @@ static struct rtpp_stat_descr default_stats[] = {
     {.name = "npkts_resizer_out",    .descr = "Total number of RTP packets egress out of resizer (re-packetizer)", .type = RTPP_CNT_U64},
     {.name = "npkts_resizer_discard",.descr = "Total number of RTP packets dropped by the resizer (re-packetizer)", .type = RTPP_CNT_U64},
     {.name = "npkts_discard",        .descr = "Total number of RTP/RTPC packets discarded", .type = RTPP_CNT_U64},
+    {.name = "ntick_overruns",       .descr = "Number of times packet budget ran out with some sockets still having packets queued", .type = RTPP_CNT_U64},
     {.name = "total_duration",       .descr = "Cumulative duration of all sessions", .type = RTPP_CNT_DBL},
     {.name = "ncmds_rcvd",           .descr = "Total number of control commands received", .type = RTPP_CNT_U64},
     {.name = "ncmds_rcvd_ndups",     .descr = "Total number of duplicate control commands received", .type = RTPP_CNT_U64},
     {.name = "ncmds_succd",          .descr = "Total number of control commands successfully processed", .type = RTPP_CNT_U64},
     {.name = "ncmds_errs",           .descr = "Total number of control commands ended up with an error", .type = RTPP_CNT_U64},
     {.name = "ncmds_repld",          .descr = "Total number of control commands that had a reply generated", .type = RTPP_CNT_U64},
+    {.name = "rcache_nhits",         .descr = "Total number of control commands answered from the reply cache", .type = RTPP_CNT_U64},
+    {.name = "rcache_nmiss",         .descr = "Total number of reply cache lookups that found no entry", .type = RTPP_CNT_U64},
+    {.name = "rcache_nevict",        .descr = "Total number of reply cache entries evicted before expiry due to the memory limit", .type = RTPP_CNT_U64},
+    {.name = "sockpool_nhits",       .descr = "Total number of socket pairs taken from the pre-bound pool", .type = RTPP_CNT_U64},
+    {.name = "sockpool_nmiss",       .descr = "Total number of socket pairs created synchronously due to the pre-bound pool being empty", .type = RTPP_CNT_U64},
+    {.name = "rec_nbytes_written",   .descr = "Total number of bytes written into the session recordings", .type = RTPP_CNT_U64},
+    {.name = "rec_npkts_dropped",    .descr = "Total number of packets not recorded due to the recording writer being overloaded", .type = RTPP_CNT_U64},
+    {.name = "nmod_reqs_dropped",    .descr = "Total number of accounting requests not delivered due to the module falling behind", .type = RTPP_CNT_U64},
     {.name = "rtpa_nsent",           .descr = "Total number of uniqie RTP packets sent to us based on SEQ tracking", .type = RTPP_CNT_U64},
     {.name = "rtpa_nrcvd",           .descr = "Total number of unique RTP packets received by us based on SEQ tracking", .type = RTPP_CNT_U64},
     {.name = "rtpa_ndups",           .descr = "Total number of duplicate RTP packets received by us based on SEQ tracking", .type = RTPP_CNT_U64},
@@ -100,7 +100,7 @@ struct rtpp_stream_priv
 
 static void rtpp_stream_dtor(struct rtpp_stream_priv *);
 static int rtpp_stream_handle_play(struct rtpp_stream *, char *, char *,
-  int, struct rtpp_command *, int);
+  int, struct rtpp_command *, int, struct rtpp_pcache *);
 static void rtpp_stream_handle_noplay(struct rtpp_stream *);
 static int rtpp_stream_isplayer_active(struct rtpp_stream *);
 static void rtpp_stream_finish_playback(struct rtpp_stream *, uint64_t);
@@ -149,7 +149,7 @@ static const struct rtpp_stream_smethods rtpp_stream_smethods = {
 struct rtpp_stream *
 rtpp_stream_ctor(struct rtpp_log *log, struct rtpp_weakref_obj *servers_wrt,
   struct rtpp_stats *rtpp_stats, enum rtpp_stream_side side,
-  int pipe_type, uint64_t seuid)
+  int pipe_type, uint64_t seuid, struct rtpa_policy *rtpa_policy)
 {
     struct rtpp_stream_priv *pvt;
     struct rtpp_refcnt *rcnt;
@@ -163,7 +163,7 @@ rtpp_stream_ctor(struct rtpp_log *log, struct rtpp_weakref_obj *servers_wrt,
         goto e1;
     }
     if (pipe_type == PIPE_RTP) {
-        pvt->pub.analyzer = rtpp_analyzer_ctor(log);
+        pvt->pub.analyzer = rtpp_analyzer_ctor(log, rtpa_policy);
         if (pvt->pub.analyzer == NULL) {
             goto e3;
         }
@@ -232,9 +232,9 @@ rtpp_stream_dtor(struct rtpp_stream_priv *pvt)
              ssrc = "NONE";
          }
          RTPP_LOG(pvt->pub.log, RTPP_LOG_INFO, "RTP stream from %s: "
-           "SSRC=%s, ssrc_changes=%lu, psent=%lu, precvd=%lu, plost=%lu, pdups=%lu",
+           "SSRC=%s, ssrc_changes=%lu, psent=%lu, precvd=%lu, plost=%lu, pdups=%lu%s",
            actor, ssrc, rst.ssrc_changes, rst.psent, rst.precvd,
-           rst.plost, rst.pdups);
+           rst.plost, rst.pdups, rst.sampled ? " (sampled)" : "");
          if (rst.psent > 0) {
              CALL_METHOD(pvt->rtpp_stats, updatebyname, "rtpa_nsent", rst.psent);
          }
@@ -281,7 +281,8 @@ player_predestroy_cb(struct rtpp_stats *rtpp_stats)
 
 static int
 rtpp_stream_handle_play(struct rtpp_stream *self, char *codecs,
-  char *pname, int playcount, struct rtpp_command *cmd, int ptime)
+  char *pname, int playcount, struct rtpp_command *cmd, int ptime,
+  struct rtpp_pcache *pcache)
 {
     struct rtpp_stream_priv *pvt;
     int n;
@@ -303,7 +304,7 @@ rtpp_stream_handle_play(struct rtpp_stream *self, char *codecs,
         codecs = cp;
         if (*codecs != '\0')
             codecs++;
-        rsrv = rtpp_server_ctor(pname, n, playcount, cmd->dtime, ptime);
+        rsrv = rtpp_server_ctor(pcache, pname, n, playcount, cmd->dtime, ptime);
         if (rsrv == NULL) {
             RTPP_LOG(pvt->pub.log, RTPP_LOG_DBUG, "rtpp_server_ctor(\"%s\", %d, %d) failed",
               pname, n, playcount);
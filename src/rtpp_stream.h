@@ -43,9 +43,11 @@ struct rtpp_pcount;
 struct rtpp_netaddr;
 struct sthread_args;
 struct rtpp_acct_hold;
+struct rtpa_policy;
+struct rtpp_pcache;
 
 DEFINE_METHOD(rtpp_stream, rtpp_stream_handle_play, int, char *,
-  char *, int, struct rtpp_command *, int);
+  char *, int, struct rtpp_command *, int, struct rtpp_pcache *);
 DEFINE_METHOD(rtpp_stream, rtpp_stream_handle_noplay, void);
 DEFINE_METHOD(rtpp_stream, rtpp_stream_isplayer_active, int);
 DEFINE_METHOD(rtpp_stream, rtpp_stream_finish_playback, void, uint64_t);
@@ -142,6 +144,6 @@ struct rtpp_stream {
 
 struct rtpp_stream *rtpp_stream_ctor(struct rtpp_log *,
   struct rtpp_weakref_obj *, struct rtpp_stats *, enum rtpp_stream_side,
-  int, uint64_t);
+  int, uint64_t, struct rtpa_policy *);
 
 #endif
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2016 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "rtpp_types.h"
+#include "rtpp_mallocs.h"
+#include "rtpp_refcnt.h"
+#include "rtpp_time.h"
+#include "rtpp_ticker.h"
+
+struct rtpp_ticker_priv {
+    struct rtpp_ticker pub;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int kicked;
+};
+
+#define PUB2PVT(pubp) \
+  ((struct rtpp_ticker_priv *)((char *)(pubp) - offsetof(struct rtpp_ticker_priv, pub)))
+
+static void rtpp_ticker_dtor(struct rtpp_ticker_priv *);
+static void rtpp_ticker_sleep_until(struct rtpp_ticker *, double);
+static int rtpp_ticker_wait_until(struct rtpp_ticker *, double);
+static void rtpp_ticker_kick(struct rtpp_ticker *);
+
+struct rtpp_ticker *
+rtpp_ticker_ctor(void)
+{
+    struct rtpp_ticker_priv *pvt;
+    struct rtpp_refcnt *rcnt;
+    pthread_condattr_t cattr;
+
+    pvt = rtpp_rzmalloc(sizeof(struct rtpp_ticker_priv), &rcnt);
+    if (pvt == NULL) {
+        goto e0;
+    }
+    pvt->pub.rcnt = rcnt;
+    if (pthread_mutex_init(&pvt->lock, NULL) != 0) {
+        goto e1;
+    }
+    if (pthread_condattr_init(&cattr) != 0) {
+        goto e2;
+    }
+    /* RTPP_CLOCK_MONO is not accepted here, deadlines are converted */
+    if (pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC) != 0 ||
+      pthread_cond_init(&pvt->cond, &cattr) != 0) {
+        pthread_condattr_destroy(&cattr);
+        goto e2;
+    }
+    pthread_condattr_destroy(&cattr);
+    pvt->pub.sleep_until = &rtpp_ticker_sleep_until;
+    pvt->pub.wait_until = &rtpp_ticker_wait_until;
+    pvt->pub.kick = &rtpp_ticker_kick;
+    CALL_SMETHOD(pvt->pub.rcnt, attach, (rtpp_refcnt_dtor_t)&rtpp_ticker_dtor,
+      pvt);
+    return (&pvt->pub);
+e2:
+    pthread_mutex_destroy(&pvt->lock);
+e1:
+    CALL_SMETHOD(pvt->pub.rcnt, decref);
+    free(pvt);
+e0:
+    return (NULL);
+}
+
+static void
+rtpp_ticker_dtor(struct rtpp_ticker_priv *pvt)
+{
+
+    pthread_cond_destroy(&pvt->cond);
+    pthread_mutex_destroy(&pvt->lock);
+    free(pvt);
+}
+
+static void
+rtpp_ticker_sleep_until(struct rtpp_ticker *self, double deadline)
+{
+    struct timespec ts;
+
+    dtime2mtimespec(deadline, &ts);
+    while (clock_nanosleep(RTPP_CLOCK_MONO, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        continue;
+}
+
+static int
+rtpp_ticker_wait_until(struct rtpp_ticker *self, double deadline)
+{
+    struct rtpp_ticker_priv *pvt;
+    struct timespec ts;
+    double timeout;
+    int rval;
+
+    pvt = PUB2PVT(self);
+    timeout = deadline - getdtime();
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+        return (-1);
+    if (timeout > 0.0)
+        dtime2mtimespec(timespec2dtime(&ts) + timeout, &ts);
+    pthread_mutex_lock(&pvt->lock);
+    while (pvt->kicked == 0) {
+        if (pthread_cond_timedwait(&pvt->cond, &pvt->lock, &ts) != 0)
+            break;
+    }
+    rval = pvt->kicked;
+    pvt->kicked = 0;
+    pthread_mutex_unlock(&pvt->lock);
+    return (rval);
+}
+
+static void
+rtpp_ticker_kick(struct rtpp_ticker *self)
+{
+    struct rtpp_ticker_priv *pvt;
+
+    pvt = PUB2PVT(self);
+    pthread_mutex_lock(&pvt->lock);
+    pvt->kicked = 1;
+    pthread_cond_signal(&pvt->cond);
+    pthread_mutex_unlock(&pvt->lock);
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2016 Sippy Software, Inc., http://www.sippysoft.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+#ifndef _RTPP_TICKER_H_
+#define _RTPP_TICKER_H_
+
+/*
+ * Sleeping primitives for the tickless main loop. The sleep_until()
+ * sleeps to an absolute deadline on the monotonic clock and is used
+ * while there are active sessions, so that ticks do not drift. The
+ * wait_until() is used when idle and can be cut short by the command
+ * thread calling kick() after it has processed some commands.
+ */
+
+struct rtpp_ticker;
+struct rtpp_refcnt;
+
+DEFINE_METHOD(rtpp_ticker, rtpp_ticker_sleep_until, void, double);
+DEFINE_METHOD(rtpp_ticker, rtpp_ticker_wait_until, int, double);
+DEFINE_METHOD(rtpp_ticker, rtpp_ticker_kick, void);
+
+struct rtpp_ticker {
+    METHOD_ENTRY(rtpp_ticker_sleep_until, sleep_until);
+    METHOD_ENTRY(rtpp_ticker_wait_until, wait_until);
+    METHOD_ENTRY(rtpp_ticker_kick, kick);
+    struct rtpp_refcnt *rcnt;
+};
+
+struct rtpp_ticker *rtpp_ticker_ctor(void);
+
+#endif
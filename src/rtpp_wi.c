@@ -260,6 +260,14 @@ rtpp_wi_apis_getnamearg(struct rtpp_wi *wi, void **datap, size_t datalen)
     return ((const char *)wi->sendto);
 }
 
+const char *
+rtpp_wi_apis_getname(struct rtpp_wi *wi)
+{
+
+    assert(wi->wi_type == RTPP_WI_TYPE_API_STR);
+    return ((const char *)wi->sendto);
+}
+
 void
 rtpp_wi_free(struct rtpp_wi *wi)
 {